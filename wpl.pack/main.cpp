@@ -0,0 +1,53 @@
+#include "../WPL/WPL.h"
+#include <iostream>
+
+#pragma comment(lib, "WPL.lib")
+
+using namespace std;
+
+void addFiles(const string& path, vector<string>& files)
+{
+    WIN32_FIND_DATAA findData;
+    const auto search { FindFirstFileA((path + "\\*").c_str(), &findData) };
+
+    if (search == INVALID_HANDLE_VALUE)
+    {
+        files.push_back(path);
+        return;
+    }
+
+    do
+    {
+        if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        {
+            files.push_back(path + "\\" + findData.cFileName);
+        }
+    } while (FindNextFileA(search, &findData));
+
+    FindClose(search);
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "usage: WPL.Pack <archive> <file or directory>..." << endl;
+        return 1;
+    }
+
+    vector<string> files;
+
+    for (auto i = 2; i < argc; ++i)
+    {
+        addFiles(argv[i], files);
+    }
+
+    if (!wpl::PackArchive::build(argv[1], files))
+    {
+        cerr << "couldnt pack " << files.size() << " files into " << argv[1] << endl;
+        return 1;
+    }
+
+    cout << "packed " << files.size() << " files into " << argv[1] << endl;
+    return 0;
+}
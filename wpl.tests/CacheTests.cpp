@@ -0,0 +1,100 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    wpl::VideoFrame createFrame(REFERENCE_TIME pts, bool keyFrame)
+    {
+        wpl::VideoFrame frame {};
+        frame.pts = pts;
+        frame.duration = ONE_FRAME;
+        frame.keyFrame = keyFrame;
+        frame.pixels.resize(FRAME_BYTES);
+        return frame;
+    }
+
+    wpl::VideoFrame createImage(REFERENCE_TIME pts)
+    {
+        auto frame = createFrame(pts, false);
+        frame.width = 16;
+        frame.height = LONG(FRAME_BYTES / 64);
+        frame.stride = 64;
+
+        for (size_t i = 0; i < frame.pixels.size(); ++i)
+        {
+            frame.pixels[i] = BYTE(i % 4 == 3 ? 255 : i / 64 + i % 64 + pts / ONE_FRAME);
+        }
+
+        return frame;
+    }
+
+    TEST_CLASS(CacheTests)
+    {
+    public:
+        TEST_METHOD(FindCoversFrameDuration)
+        {
+            wpl::FrameCache frameCache(FRAME_BYTES * 4);
+
+            Assert::IsTrue(frameCache.insert(createFrame(0, true)), L"Error couldnt insert frame");
+            Assert::IsTrue(frameCache.insert(createFrame(ONE_FRAME, false)), L"Error couldnt insert frame");
+
+            auto frame = frameCache.find(0, ONE_FRAME + ONE_FRAME / 2);
+            Assert::IsNotNull(frame, L"Error position inside a cached frame missed");
+            Assert::AreEqual(ONE_FRAME, frame->pts);
+
+            Assert::IsNull(frameCache.find(0, ONE_FRAME * 3), L"Error position past the cache hit");
+            Assert::IsNull(frameCache.find(1, 0), L"Error other stream hit");
+            Assert::AreEqual(1ULL, frameCache.hits());
+            Assert::AreEqual(2ULL, frameCache.misses());
+        }
+
+        TEST_METHOD(EvictsDeltaFramesBeforeKeyFrames)
+        {
+            wpl::FrameCache frameCache(FRAME_BYTES * 3);
+
+            frameCache.insert(createFrame(0, true));
+            frameCache.insert(createFrame(ONE_FRAME, false));
+            frameCache.insert(createFrame(ONE_FRAME * 2, false));
+            frameCache.find(0, ONE_FRAME);
+            frameCache.insert(createFrame(ONE_FRAME * 3, true));
+
+            Assert::AreEqual(size_t(3), frameCache.size());
+            Assert::AreEqual(FRAME_BYTES * 3, frameCache.usedBytes());
+            Assert::IsNotNull(frameCache.find(0, 0), L"Error key frame was evicted");
+            Assert::IsNotNull(frameCache.find(0, ONE_FRAME), L"Error recently used frame was evicted");
+            Assert::IsNull(frameCache.find(0, ONE_FRAME * 2), L"Error least recently used frame was kept");
+        }
+
+        TEST_METHOD(ShrinkingBudgetEvicts)
+        {
+            wpl::FrameCache frameCache(FRAME_BYTES * 2);
+
+            frameCache.insert(createFrame(0, true));
+            frameCache.insert(createFrame(ONE_FRAME, false));
+            frameCache.setBudget(FRAME_BYTES);
+
+            Assert::AreEqual(size_t(1), frameCache.size());
+            Assert::IsNotNull(frameCache.find(0, 0), L"Error key frame was evicted");
+        }
+
+        TEST_METHOD(CompressedTierRoundTrip)
+        {
+            wpl::FrameCache frameCache(FRAME_BYTES, FRAME_BYTES * 2);
+
+            frameCache.insert(createImage(0));
+            frameCache.insert(createImage(ONE_FRAME));
+
+            Assert::AreEqual(size_t(1), frameCache.size());
+            Assert::AreEqual(size_t(1), frameCache.compressedSize());
+            Assert::IsTrue(frameCache.compressedBytes() < FRAME_BYTES, L"Error evicted frame wasnt compressed");
+
+            auto frame = frameCache.find(0, 0);
+            Assert::IsNotNull(frame, L"Error compressed frame missed");
+            Assert::IsTrue(frame->pixels == createImage(0).pixels, L"Error compressed frame changed");
+            Assert::AreEqual(1ULL, frameCache.compressedHits());
+            Assert::AreEqual(size_t(1), frameCache.compressedSize());
+        }
+    };
+}
@@ -18,5 +18,17 @@ namespace WPLTests
                 Assert::Fail(L"Error this file doesnt exist and should return false to indicate failure");
             }
         }
+
+        TEST_METHOD(TestCannotQueueMissingFile)
+        {
+            wpl::VideoPlayer videoPlayer;
+
+            if(videoPlayer.queueVideo("doesntexists.wmv"))
+            {
+                Assert::Fail(L"Error this file doesnt exist and should not be added to the queue");
+            }
+
+            Assert::AreEqual(size_t(0), videoPlayer.queuedVideos());
+        }
     };
 }
\ No newline at end of file
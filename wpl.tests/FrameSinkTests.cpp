@@ -0,0 +1,191 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+class CollectingSink : public wpl::FrameSink
+{
+public:
+    std::mutex lock;
+    std::vector<wpl::FrameView> held;
+    std::vector<REFERENCE_TIME> times;
+    bool valid { true };
+
+    void onFrame(wpl::FrameView frame) override
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        valid = valid && !frame.empty() && frame.width() > 0 && frame.height() > 0 && frame.plane(0) != nullptr && frame.stride(0) != 0;
+        times.push_back(frame.pts());
+
+        if (held.size() < 2)
+        {
+            held.push_back(std::move(frame));
+        }
+    }
+};
+
+namespace WPLTests
+{
+    TEST_CLASS(FrameSinkTests)
+    {
+    public:
+        TEST_METHOD(FrameViewStartsEmpty)
+        {
+            wpl::FrameView view;
+
+            Assert::IsTrue(view.empty());
+            Assert::IsTrue(view.plane(0) == nullptr);
+            Assert::IsTrue(view.plane(3) == nullptr);
+
+            view.release();
+            Assert::IsTrue(view.empty());
+        }
+
+        TEST_METHOD(FrameSinkReceivesFrames)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto sink { std::make_shared<CollectingSink>() };
+            const auto target { std::make_shared<wpl::SinkRenderer>(sink) };
+
+            Assert::IsTrue(videoPlayer.addRenderTarget(target), L"Error couldnt add sink");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(target->hasVideo(), L"Error sink not connected on open");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            Sleep(1000);
+
+            std::lock_guard<std::mutex> guard(sink->lock);
+            Assert::IsTrue(target->stats().delivered > 2, L"Error sink got no frames");
+            Assert::IsTrue(sink->valid, L"Error frame view was incomplete");
+            Assert::IsTrue(std::is_sorted(sink->times.begin(), sink->times.end()), L"Error frames out of order");
+
+            // Frames held by the consumer keep their planes until released,
+            // and playback carries on with the buffers that are left.
+            Assert::AreEqual(size_t(2), sink->held.size());
+            Assert::IsTrue(sink->held[0].plane(0) != nullptr, L"Error held frame lost its planes");
+
+            sink->held.clear();
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback stopped");
+        }
+
+        TEST_METHOD(HiddenFrameSinkDropsFrames)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto sink { std::make_shared<CollectingSink>() };
+            const auto target { std::make_shared<wpl::SinkRenderer>(sink) };
+
+            Assert::IsTrue(videoPlayer.addRenderTarget(target), L"Error couldnt add sink");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.setVisibility(wpl::Visibility::Minimised));
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            Sleep(500);
+
+            Assert::AreEqual(0ULL, target->stats().delivered, L"Error hidden sink got frames");
+            Assert::IsTrue(target->stats().dropped > 0, L"Error hidden sink didnt see frames");
+        }
+
+        TEST_METHOD(FrameSinkCarriesAspectMode)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto sink { std::make_shared<CollectingSink>() };
+            const auto target { std::make_shared<wpl::SinkRenderer>(sink) };
+
+            Assert::IsTrue(videoPlayer.setAspectMode(wpl::AspectMode::Letterbox));
+            Assert::IsTrue(videoPlayer.addRenderTarget(target), L"Error couldnt add sink");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            Sleep(500);
+
+            {
+                std::lock_guard<std::mutex> guard(sink->lock);
+                Assert::IsTrue(sink->held.size() > 0, L"Error sink got no frames");
+                Assert::IsTrue(sink->held[0].aspectMode() == wpl::AspectMode::Letterbox, L"Error frame lost the aspect mode");
+            }
+
+            // A change while playing reaches the frames that follow it.
+            Assert::IsTrue(videoPlayer.setAspectMode(wpl::AspectMode::Stretch));
+
+            Sleep(100);
+
+            {
+                std::lock_guard<std::mutex> guard(sink->lock);
+                sink->held.clear();
+            }
+
+            Sleep(500);
+
+            std::lock_guard<std::mutex> guard(sink->lock);
+            Assert::IsTrue(sink->held.size() > 0, L"Error sink got no frames");
+            Assert::IsTrue(sink->held[0].aspectMode() == wpl::AspectMode::Stretch, L"Error frame kept the old aspect mode");
+        }
+
+        TEST_METHOD(FrameSinkFollowsPlaylistHandoff)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto sink { std::make_shared<CollectingSink>() };
+            const auto target { std::make_shared<wpl::SinkRenderer>(sink) };
+
+            Assert::IsTrue(videoPlayer.addRenderTarget(target), L"Error couldnt add sink");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.queueVideo("demo.wmv"), L"Error couldnt queue file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            for (auto waited = 0; waited < PLAYBACK_TIMEOUT && videoPlayer.stats().transitions == 0; waited += 100)
+            {
+                videoPlayer.hasFinished();
+                Sleep(100);
+            }
+
+            Sleep(500);
+
+            {
+                std::lock_guard<std::mutex> guard(sink->lock);
+                const auto restart { std::is_sorted_until(sink->times.begin(), sink->times.end()) };
+
+                // The next clip was wired up while prerolling, so its frames
+                // follow straight on, none of them shown early.
+                Assert::AreEqual(1u, videoPlayer.stats().transitions, L"Error didnt hand off");
+                Assert::IsTrue(restart != sink->times.end(), L"Error sink got no frames after the handoff");
+                Assert::IsTrue(*restart < ONE_SECOND / 10, L"Error sink missed the start of the next clip");
+                Assert::IsTrue(std::is_sorted(restart, sink->times.end()), L"Error frames out of order after the handoff");
+                sink->held.clear();
+            }
+
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback stopped");
+            Assert::IsTrue(videoPlayer.removeRenderTarget(target), L"Error couldnt remove target after the handoff");
+            Assert::AreEqual(size_t(0), videoPlayer.renderTargetCount());
+        }
+
+        TEST_METHOD(FrameSinkDeliversPreferredFormat)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto sink { std::make_shared<CollectingSink>() };
+            const auto target { std::make_shared<wpl::SinkRenderer>(sink, std::vector<wpl::PixelFormat> { wpl::PixelFormat::Bgra }, 64) };
+
+            Assert::IsTrue(videoPlayer.addRenderTarget(target), L"Error couldnt add sink");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            Sleep(1000);
+
+            const auto stats { target->stats() };
+            Assert::IsTrue(stats.negotiated, L"Error no format chain");
+            Assert::IsTrue(stats.chain.delivered == wpl::PixelFormat::Bgra, L"Error wrong format delivered");
+            Assert::IsTrue(stats.chain.converted, L"Error BGRA handed out without opaque alpha");
+            Assert::AreEqual(stats.delivered, stats.converted, L"Error frame skipped conversion");
+
+            std::lock_guard<std::mutex> guard(sink->lock);
+            Assert::IsTrue(sink->held.size() > 0, L"Error sink got no frames");
+
+            const auto& frame { sink->held[0] };
+            Assert::IsTrue(frame.format() == wpl::PixelFormat::Bgra, L"Error frame in wrong format");
+            Assert::AreEqual(0L, frame.stride(0) % 64, L"Error rows not aligned");
+            Assert::AreEqual(BYTE(255), frame.plane(0)[3], L"Error pixel isnt opaque");
+        }
+    };
+}
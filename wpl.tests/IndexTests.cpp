@@ -0,0 +1,67 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(IndexTests)
+    {
+    public:
+        TEST_METHOD(SeekIndexIsCached)
+        {
+            DeleteFileA(wpl::SeekIndex::cachePath("demo.wmv").c_str());
+
+            wpl::SeekIndex seekIndex;
+            Assert::IsTrue(seekIndex.open("demo.wmv"), L"Error couldnt index file");
+            Assert::IsFalse(seekIndex.fromCache(), L"Error index loaded before it was written");
+
+            const auto keyFrames { seekIndex.size() };
+            Assert::IsTrue(keyFrames > 0, L"Error no key frames found");
+
+            wpl::SeekIndex cachedIndex;
+            Assert::IsTrue(cachedIndex.open("demo.wmv"), L"Error couldnt reopen index");
+            Assert::IsTrue(cachedIndex.fromCache(), L"Error index wasnt loaded from the sidecar");
+            Assert::AreEqual(keyFrames, cachedIndex.size());
+
+            auto keyFrame = cachedIndex.keyFrameBefore(ONE_SECOND * 2);
+            Assert::IsNotNull(keyFrame, L"Error no key frame before two seconds");
+            Assert::IsTrue(keyFrame->time <= ONE_SECOND * 2, L"Error key frame after the requested time");
+            Assert::IsTrue(cachedIndex.isKeyFrame(keyFrame->time, 0), L"Error indexed key frame not reported");
+        }
+
+        TEST_METHOD(SeekIndexBuiltOnFirstStepBack)
+        {
+            const auto cacheName { wpl::SeekIndex::cachePath("demo.wmv") };
+            DeleteFileA(cacheName.c_str());
+
+            Assert::IsTrue(cacheName.find("demo.wmv") == std::string::npos, L"Error sidecar kept next to the media");
+
+            wpl::VideoPlayer videoPlayer;
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            Sleep(1000);
+
+            Assert::IsTrue(GetFileAttributesA(cacheName.c_str()) == INVALID_FILE_ATTRIBUTES, L"Error file scanned again on open");
+            Assert::IsTrue(videoPlayer.stepBackward(), L"Error couldnt step back");
+
+            for (auto waited = 0; waited < PLAYBACK_TIMEOUT && GetFileAttributesA(cacheName.c_str()) == INVALID_FILE_ATTRIBUTES; waited += 100)
+            {
+                Sleep(100);
+            }
+
+            Assert::IsTrue(GetFileAttributesA(cacheName.c_str()) != INVALID_FILE_ATTRIBUTES, L"Error index wasnt built for stepping back");
+        }
+
+        TEST_METHOD(SeekIndexRejectsMissingFile)
+        {
+            wpl::SeekIndex seekIndex;
+
+            if (seekIndex.open("doesntexists.wmv"))
+            {
+                Assert::Fail(L"Error this file doesnt exist and should not be indexed");
+            }
+        }
+    };
+}
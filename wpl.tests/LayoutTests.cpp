@@ -0,0 +1,54 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(LayoutTests)
+    {
+    public:
+        TEST_METHOD(LetterboxCentresPicture)
+        {
+            const auto layout { wpl::layoutVideo(wpl::AspectMode::Letterbox, { 0, 0, 800, 500 }, 1920, 1080) };
+
+            Assert::AreEqual(0L, layout.picture.left);
+            Assert::AreEqual(25L, layout.picture.top);
+            Assert::AreEqual(800L, layout.picture.right);
+            Assert::AreEqual(475L, layout.picture.bottom);
+        }
+
+        TEST_METHOD(CropCutsSourceToWindow)
+        {
+            const auto layout { wpl::layoutVideo(wpl::AspectMode::Crop, { 0, 0, 800, 800 }, 1920, 1080) };
+
+            Assert::AreEqual(800L, layout.picture.right);
+            Assert::AreEqual(420L, layout.source.left);
+            Assert::AreEqual(1500L, layout.source.right);
+            Assert::AreEqual(1080L, layout.source.bottom);
+        }
+
+        TEST_METHOD(CanvasFillsBarsOnlyOnLayoutChange)
+        {
+            std::vector<BYTE> frame(64 * 36 * 4, 200), pixels(100 * 60 * 4, 7);
+
+            const wpl::Image source { wpl::PixelFormat::Bgra, 64, 36, { frame.data() }, { 64 * 4 } };
+            const wpl::Image target { wpl::PixelFormat::Bgra, 100, 60, { pixels.data() }, { 100 * 4 } };
+
+            wpl::FrameCanvas canvas;
+            Assert::IsTrue(canvas.draw(source, target), L"Error couldnt draw frame");
+            Assert::IsTrue(canvas.draw(source, target), L"Error couldnt draw frame");
+            Assert::AreEqual(1ULL, canvas.barFills(), L"Error bars filled again without a layout change");
+
+            Assert::AreEqual(BYTE(0), pixels[0], L"Error bar wasnt filled");
+            Assert::AreEqual(BYTE(200), pixels[30 * 400], L"Error picture wasnt drawn");
+
+            canvas.setAspectMode(wpl::AspectMode::Crop);
+            Assert::IsTrue(canvas.draw(source, target), L"Error couldnt draw frame");
+            Assert::AreEqual(2ULL, canvas.barFills());
+            Assert::AreEqual(BYTE(200), pixels[0], L"Error cropped picture didnt fill target");
+        }
+    };
+}
@@ -0,0 +1,107 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    wpl::VideoFrame createFrame(REFERENCE_TIME pts, bool keyFrame);
+
+    TEST_CLASS(MemoryTests)
+    {
+    public:
+        TEST_METHOD(GovernorShrinksCachesThenQueuesThenRefuses)
+        {
+            wpl::MemoryGovernor governor;
+            governor.setLimit(1000);
+            governor.adjustCache(0, 600);
+
+            Assert::AreEqual(size_t(1000), governor.cacheAllowance(600), L"Error cache cant grow into free memory");
+            Assert::AreEqual(size_t(800), governor.reserveBuffer(800, 100), L"Error caches didnt give way to buffers");
+            Assert::AreEqual(size_t(200), governor.cacheAllowance(600), L"Error caches werent asked to shrink");
+
+            Assert::AreEqual(size_t(200), governor.reserveBuffer(500, 100), L"Error queue wasnt shortened");
+            Assert::AreEqual(size_t(0), governor.reserveBuffer(500, 100), L"Error buffer granted past the limit");
+            Assert::IsFalse(governor.admitOpen(), L"Error open admitted past the limit");
+            Assert::AreEqual(2ULL, governor.refusedOpens());
+
+            governor.releaseBuffer(1000);
+            Assert::IsTrue(governor.admitOpen(), L"Error open refused after buffers were released");
+        }
+
+        TEST_METHOD(FrameCacheStaysWithinLimit)
+        {
+            auto& governor { wpl::MemoryGovernor::shared() };
+            const auto baseline { governor.usage().cacheBytes };
+            governor.setLimit(baseline + 4 * FRAME_BYTES);
+
+            wpl::FrameCache cache(16 * FRAME_BYTES);
+
+            for (auto i = 0; i < 8; ++i)
+            {
+                cache.insert(createFrame(i * ONE_FRAME, false));
+            }
+
+            Assert::IsTrue(cache.usedBytes() <= 4 * FRAME_BYTES, L"Error cache grew past the memory limit");
+            Assert::AreEqual(baseline + cache.usedBytes(), governor.usage().cacheBytes);
+
+            governor.setLimit(0);
+        }
+
+        TEST_METHOD(IdleCacheTrimsWhenLimitChanges)
+        {
+            auto& governor { wpl::MemoryGovernor::shared() };
+            const auto baseline { governor.usage().cacheBytes };
+
+            wpl::FrameCache cache(16 * FRAME_BYTES);
+
+            for (auto i = 0; i < 8; ++i)
+            {
+                cache.insert(createFrame(i * ONE_FRAME, false));
+            }
+
+            Assert::AreEqual(8 * FRAME_BYTES, cache.usedBytes());
+
+            // Nothing is inserted after the limit drops, the owner only checks in.
+            governor.setLimit(baseline + 2 * FRAME_BYTES);
+            cache.trim();
+
+            Assert::IsTrue(cache.usedBytes() <= 2 * FRAME_BYTES, L"Error idle cache kept memory past the limit");
+
+            // A buffer granted over the caches asks them to give way again.
+            governor.setLimit(baseline + 4 * FRAME_BYTES);
+            const auto trims { governor.trimRequests() };
+            const auto reserved { governor.reserveBuffer(3 * FRAME_BYTES, FRAME_BYTES) };
+
+            Assert::AreEqual(3 * FRAME_BYTES, reserved, L"Error caches didnt give way to buffers");
+            Assert::IsTrue(governor.trimRequests() != trims, L"Error caches werent asked to trim");
+
+            cache.trim();
+
+            const auto usage { governor.usage() };
+            Assert::IsTrue(usage.bufferBytes + usage.cacheBytes <= governor.limitBytes(), L"Error total stayed past the limit");
+
+            governor.releaseBuffer(reserved);
+            governor.setLimit(0);
+        }
+
+        TEST_METHOD(PlayerReportsOutOfMemory)
+        {
+            auto& governor { wpl::MemoryGovernor::shared() };
+            wpl::VideoPlayer videoPlayer;
+
+            governor.setLimit(1);
+            const auto reserved { governor.reserveBuffer(1, 1) };
+
+            Assert::IsFalse(videoPlayer.openVideo("demo.wmv"), L"Error open admitted past the limit");
+            Assert::IsTrue(videoPlayer.lastError() == wpl::PlayerError::OutOfMemory, L"Error refusal not reported");
+
+            governor.releaseBuffer(reserved);
+            governor.setLimit(0);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.lastError() == wpl::PlayerError::None, L"Error stale error reported");
+            Assert::AreEqual(size_t(0), videoPlayer.memoryUsage().bufferBytes);
+        }
+    };
+}
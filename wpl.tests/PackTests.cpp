@@ -0,0 +1,58 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <fstream>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(PackTests)
+    {
+    public:
+        TEST_METHOD(PackArchiveRoundTrip)
+        {
+            Assert::IsTrue(wpl::PackArchive::build("clips.wpk", { "demo.wmv" }), L"Error couldnt build archive");
+
+            wpl::PackArchive archive;
+            Assert::IsTrue(archive.open("clips.wpk"), L"Error couldnt open archive");
+            Assert::AreEqual(size_t(1), archive.size());
+            Assert::AreEqual(std::string("demo.wmv"), archive.names().front());
+
+            std::ifstream file("demo.wmv", std::ios::binary);
+            const std::vector<BYTE> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            wpl::PackEntry entry;
+            Assert::IsTrue(archive.find("demo.wmv", &entry), L"Error packed file not found");
+            Assert::AreEqual(static_cast<unsigned long long>(contents.size()), entry.size);
+            Assert::IsTrue(std::equal(contents.begin(), contents.end(), entry.data), L"Error packed bytes differ");
+            Assert::AreEqual(size_t(0), reinterpret_cast<uintptr_t>(entry.data) % 4096, L"Error payload isnt page aligned");
+            Assert::IsFalse(archive.find("missing.wmv", &entry), L"Error found a file that wasnt packed");
+        }
+
+        TEST_METHOD(PackArchiveRejectsDuplicates)
+        {
+            if (wpl::PackArchive::build("duplicates.wpk", { "demo.wmv", "demo.wmv" }))
+            {
+                Assert::Fail(L"Error two entries with the same name were packed");
+            }
+        }
+
+        TEST_METHOD(PackNamesResolveAfterMount)
+        {
+            Assert::IsTrue(wpl::PackArchive::build("mounted.wpk", { "demo.wmv" }), L"Error couldnt build archive");
+            Assert::IsTrue(wpl::mountPack("mounted.wpk"), L"Error couldnt mount archive");
+
+            wpl::PackEntry entry;
+            Assert::IsTrue(wpl::findPackEntry("pack://demo.wmv", &entry) != nullptr, L"Error mounted entry not found");
+            Assert::IsTrue(wpl::findPackEntry("demo.wmv", &entry) == nullptr, L"Error plain filenames arent packed");
+
+            wpl::VideoPlayer videoPlayer;
+            Assert::IsFalse(videoPlayer.openVideo("pack://missing.wmv"), L"Error opened a missing packed file");
+
+            wpl::unmountPacks();
+            Assert::IsTrue(wpl::findPackEntry("pack://demo.wmv", &entry) == nullptr, L"Error entry outlived unmount");
+        }
+    };
+}
@@ -0,0 +1,61 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(ProbeTests)
+    {
+    public:
+        TEST_METHOD(ProbeReadsHeaders)
+        {
+            wpl::MediaInfo mediaInfo;
+
+            Assert::IsTrue(wpl::probe("demo.wmv", &mediaInfo), L"Error couldnt probe file");
+            Assert::IsTrue(mediaInfo.container == wpl::ContainerType::Asf, L"Error wrong container");
+            Assert::IsTrue(mediaInfo.duration > 0, L"Error no duration");
+
+            wpl::VideoPlayer videoPlayer;
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(std::abs(videoPlayer.duration() - mediaInfo.duration) < ONE_SECOND, L"Error probe disagrees with the graph");
+
+            auto video = std::find_if(mediaInfo.streams.begin(), mediaInfo.streams.end(), [](const wpl::StreamInfo& stream) {
+                return stream.type == wpl::StreamType::Video;
+            });
+
+            Assert::IsTrue(video != mediaInfo.streams.end(), L"Error no video stream");
+            Assert::IsTrue(video->width > 0 && video->height > 0, L"Error no dimensions");
+            Assert::IsFalse(video->codec.empty(), L"Error no codec");
+        }
+
+        TEST_METHOD(ProbeRejectsMissingFile)
+        {
+            wpl::MediaInfo mediaInfo;
+
+            if (wpl::probe("doesntexists.wmv", &mediaInfo))
+            {
+                Assert::Fail(L"Error this file doesnt exist and should not be probed");
+            }
+        }
+
+        TEST_METHOD(ProbeDirectoryFindsVideos)
+        {
+            auto media = wpl::probeDirectory(".", 2);
+
+            auto demo = std::find_if(media.begin(), media.end(), [](const wpl::MediaInfo& mediaInfo) {
+                return mediaInfo.filename.find("demo.wmv") != std::string::npos;
+            });
+
+            Assert::IsTrue(demo != media.end(), L"Error directory scan missed the demo file");
+            Assert::IsTrue(demo->duration > 0, L"Error no duration");
+
+            // Running on the shared workers, one lane or many find the same files.
+            Assert::AreEqual(media.size(), wpl::probeDirectory(".", 1).size(), L"Error single lane scan differs");
+            Assert::AreEqual(media.size(), wpl::probeDirectory(".", 64).size(), L"Error wide scan differs");
+        }
+    };
+}
@@ -0,0 +1,59 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <fstream>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(ReadAheadTests)
+    {
+    public:
+        TEST_METHOD(ReadAheadMatchesFile)
+        {
+            std::ifstream file("demo.wmv", std::ios::binary);
+            const std::vector<BYTE> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+            wpl::ReadAheadReader reader;
+            Assert::IsTrue(reader.open("demo.wmv", 1024 * 1024), L"Error couldnt open file");
+            Assert::AreEqual(static_cast<unsigned long long>(contents.size()), reader.size());
+
+            std::vector<BYTE> buffer(100000);
+            auto totalRead { 0ULL };
+
+            for (size_t offset = 0; offset < contents.size(); offset += 70001)
+            {
+                const auto expected { std::min(buffer.size(), contents.size() - offset) };
+                totalRead += expected;
+                Assert::AreEqual(expected, reader.read(offset, buffer.size(), buffer.data()));
+                Assert::IsTrue(std::equal(buffer.begin(), buffer.begin() + expected, contents.begin() + offset), L"Error read ahead returned wrong bytes");
+            }
+
+            Assert::AreEqual(size_t(0), reader.read(contents.size(), buffer.size(), buffer.data()));
+            Assert::AreEqual(totalRead, reader.stats().bytesRead);
+        }
+
+        TEST_METHOD(ReadAheadRejectsMissingFile)
+        {
+            wpl::ReadAheadReader reader;
+
+            if (reader.open("doesntexists.avi", 1024 * 1024))
+            {
+                Assert::Fail(L"Error this file doesnt exist and should not be opened");
+            }
+        }
+
+        TEST_METHOD(ReadAheadPlayerFallsBack)
+        {
+            wpl::VideoPlayer videoPlayer;
+
+            Assert::IsFalse(videoPlayer.setReadAhead(0, -ONE_SECOND), L"Error negative window accepted");
+            Assert::IsTrue(videoPlayer.setReadAhead(4 * 1024 * 1024, 2 * ONE_SECOND), L"Error couldnt enable read ahead");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::AreEqual(0ULL, videoPlayer.stats().bytesPrefetched);
+        }
+    };
+}
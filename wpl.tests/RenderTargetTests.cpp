@@ -0,0 +1,43 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(RenderTargetTests)
+    {
+    public:
+        TEST_METHOD(RenderTargetRejectsDuplicates)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto target { std::make_shared<wpl::EVR>() };
+
+            Assert::IsFalse(videoPlayer.addRenderTarget(nullptr), L"Error null target accepted");
+            Assert::IsTrue(videoPlayer.addRenderTarget(target), L"Error couldnt add target");
+            Assert::IsFalse(videoPlayer.addRenderTarget(target), L"Error same target added twice");
+            Assert::AreEqual(size_t(1), videoPlayer.renderTargetCount());
+        }
+
+        TEST_METHOD(RenderTargetAttachesAtRuntime)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto first { std::make_shared<wpl::EVR>() };
+            const auto second { std::make_shared<wpl::EVR>() };
+
+            Assert::IsTrue(videoPlayer.addRenderTarget(first), L"Error couldnt add target");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(first->hasVideo(), L"Error target not connected on open");
+
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.addRenderTarget(second), L"Error couldnt add target while playing");
+            Assert::IsTrue(second->hasVideo(), L"Error target not connected while playing");
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback didnt resume");
+
+            Assert::IsTrue(videoPlayer.removeRenderTarget(first), L"Error couldnt remove target");
+            Assert::IsFalse(videoPlayer.removeRenderTarget(first), L"Error target removed twice");
+            Assert::AreEqual(size_t(1), videoPlayer.renderTargetCount());
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback didnt resume");
+        }
+    };
+}
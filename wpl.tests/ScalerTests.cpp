@@ -0,0 +1,118 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(ScalerTests)
+    {
+    public:
+        TEST_METHOD(ScalerKeepsFlatColour)
+        {
+            std::vector<BYTE> luma(64 * 48, 90), chroma(32 * 24, 200);
+            std::vector<BYTE> scaledLuma(17 * 9), scaledBlue(9 * 5), scaledRed(9 * 5);
+
+            const wpl::Image source { wpl::PixelFormat::I420, 64, 48, { luma.data(), chroma.data(), chroma.data() }, { 64, 32, 32 } };
+            const wpl::Image target { wpl::PixelFormat::I420, 17, 9, { scaledLuma.data(), scaledBlue.data(), scaledRed.data() }, { 17, 9, 9 } };
+
+            for (const auto filter : { wpl::ScaleFilter::Bilinear, wpl::ScaleFilter::Bicubic, wpl::ScaleFilter::Box })
+            {
+                Assert::IsTrue(wpl::scaleImage(source, target, filter), L"Error couldnt scale image");
+                Assert::IsTrue(std::all_of(scaledLuma.begin(), scaledLuma.end(), [](BYTE value) { return value == 90; }), L"Error luma changed");
+                Assert::IsTrue(std::all_of(scaledRed.begin(), scaledRed.end(), [](BYTE value) { return value == 200; }), L"Error chroma changed");
+            }
+        }
+
+        TEST_METHOD(BoxFilterAveragesArea)
+        {
+            wpl::VideoFrame frame {};
+            frame.width = 4;
+            frame.height = 4;
+            frame.stride = 16;
+            frame.pixels.resize(64);
+
+            for (size_t i = 0; i < frame.pixels.size(); ++i)
+            {
+                frame.pixels[i] = BYTE((i / 4 + i / 16) % 2 ? 255 : 0);
+            }
+
+            wpl::VideoFrame thumbnail;
+            Assert::IsTrue(wpl::scaleFrame(frame, &thumbnail, 2, 2, wpl::ScaleFilter::Box), L"Error couldnt scale frame");
+            Assert::AreEqual(size_t(16), thumbnail.pixels.size());
+
+            for (const auto value : thumbnail.pixels)
+            {
+                Assert::IsTrue(value == 127 || value == 128, L"Error box filter didnt average");
+            }
+        }
+
+        TEST_METHOD(ScalerConvertsI420ToBgra)
+        {
+            std::vector<BYTE> luma(40 * 30), chroma(20 * 15, 128), pixels(23 * 11 * 4);
+
+            const wpl::Image source { wpl::PixelFormat::I420, 40, 30, { luma.data(), chroma.data(), chroma.data() }, { 40, 20, 20 } };
+            const wpl::Image target { wpl::PixelFormat::Bgra, 23, 11, { pixels.data() }, { 23 * 4 } };
+
+            for (const auto level : { BYTE(16), BYTE(235) })
+            {
+                std::fill(luma.begin(), luma.end(), level);
+                Assert::IsTrue(wpl::scaleImage(source, target, wpl::ScaleFilter::Bicubic), L"Error couldnt convert image");
+
+                const auto expected { BYTE(level == 16 ? 0 : 255) };
+
+                for (size_t i = 0; i < pixels.size(); i += 4)
+                {
+                    Assert::IsTrue(pixels[i] == expected && pixels[i + 1] == expected && pixels[i + 2] == expected, L"Error grey level converted wrongly");
+                    Assert::AreEqual(BYTE(255), pixels[i + 3], L"Error pixel isnt opaque");
+                }
+            }
+        }
+
+        TEST_METHOD(ScalerRejectsMismatchedFormats)
+        {
+            std::vector<BYTE> pixels(16 * 16 * 4);
+
+            const wpl::Image source { wpl::PixelFormat::Bgra, 16, 16, { pixels.data() }, { 64 } };
+            const wpl::Image target { wpl::PixelFormat::I420, 8, 8, { pixels.data(), pixels.data(), pixels.data() }, { 8, 4, 4 } };
+            const wpl::Image empty { wpl::PixelFormat::Bgra, 0, 8, { pixels.data() }, { 0 } };
+
+            Assert::IsFalse(wpl::scaleImage(source, target), L"Error mismatched formats accepted");
+            Assert::IsFalse(wpl::scaleImage(source, empty), L"Error empty target accepted");
+        }
+
+        TEST_METHOD(ConvertImageReshufflesChroma)
+        {
+            std::vector<BYTE> nv12(32 * 16 * 3 / 2);
+            std::vector<BYTE> luma(32 * 16), blue(16 * 8), red(16 * 8);
+            std::vector<BYTE> roundTrip(nv12.size());
+            std::vector<BYTE> pixels(32 * 16 * 4);
+
+            for (size_t i = 0; i < nv12.size(); ++i)
+            {
+                nv12[i] = static_cast<BYTE>(i * 7 + 3);
+            }
+
+            const wpl::Image source { wpl::PixelFormat::Nv12, 32, 16, { nv12.data(), nv12.data() + 32 * 16 }, { 32, 32 } };
+            const wpl::Image planar { wpl::PixelFormat::I420, 32, 16, { luma.data(), blue.data(), red.data() }, { 32, 16, 16 } };
+            const wpl::Image back { wpl::PixelFormat::Nv12, 32, 16, { roundTrip.data(), roundTrip.data() + 32 * 16 }, { 32, 32 } };
+            const wpl::Image target { wpl::PixelFormat::Bgra, 32, 16, { pixels.data() }, { 32 * 4 } };
+
+            Assert::IsTrue(wpl::convertImage(source, planar), L"Error NV12 to I420 failed");
+            Assert::AreEqual(nv12[32 * 16 + 10], blue[5], L"Error blue sample moved");
+            Assert::AreEqual(nv12[32 * 16 + 11], red[5], L"Error red sample moved");
+
+            Assert::IsTrue(wpl::convertImage(planar, back), L"Error I420 to NV12 failed");
+            Assert::IsTrue(nv12 == roundTrip, L"Error round trip changed the frame");
+
+            Assert::IsTrue(wpl::convertImage(source, target), L"Error NV12 to BGRA failed");
+            Assert::AreEqual(BYTE(255), pixels[4 * 17 + 3], L"Error pixel isnt opaque");
+
+            Assert::IsFalse(wpl::convertImage(target, planar), L"Error BGRA to YUV accepted");
+            Assert::IsFalse(wpl::scaleImage(source, target), L"Error scaler took NV12");
+        }
+    };
+}
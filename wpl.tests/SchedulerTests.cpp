@@ -0,0 +1,106 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <fstream>
+#include <memory>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    TEST_CLASS(SchedulerTests)
+    {
+    public:
+        TEST_METHOD(SchedulerRunsEveryTask)
+        {
+            wpl::TaskScheduler scheduler(4);
+            std::vector<std::future<int>> results;
+
+            for (auto i = 0; i < 1000; ++i)
+            {
+                results.push_back(scheduler.submit([i]() { return i; }, std::chrono::steady_clock::now(), i % 2 ? wpl::TaskPriority::Background : wpl::TaskPriority::Foreground));
+            }
+
+            auto total { 0 };
+
+            for (auto& result : results)
+            {
+                total += result.get();
+            }
+
+            Assert::AreEqual(999 * 1000 / 2, total);
+            Assert::AreEqual(1000ULL, scheduler.stats().completed);
+        }
+
+        TEST_METHOD(SchedulerOrdersByPriorityThenDeadline)
+        {
+            wpl::TaskScheduler scheduler(1);
+            std::promise<void> gate;
+            std::vector<int> order;
+
+            const auto now { std::chrono::steady_clock::now() };
+            const auto opened { gate.get_future().share() };
+            auto blocker { scheduler.submit([opened]() { opened.wait(); }, now) };
+
+            auto background { scheduler.submit([&]() { order.push_back(1); }, now, wpl::TaskPriority::Background) };
+            auto later { scheduler.submit([&]() { order.push_back(2); }, now + std::chrono::seconds(5)) };
+            auto sooner { scheduler.submit([&]() { order.push_back(3); }, now + std::chrono::seconds(2)) };
+
+            gate.set_value();
+            background.get();
+
+            Assert::IsTrue(order == std::vector<int>({ 3, 2, 1 }), L"Error tasks ran out of order");
+        }
+
+        TEST_METHOD(PlayerUsesSharedScheduler)
+        {
+            wpl::VideoPlayer videoPlayer;
+            const auto completed { wpl::TaskScheduler::shared().stats().completed };
+
+            Assert::IsTrue(videoPlayer.setPriority(wpl::TaskPriority::Background), L"Error couldnt set priority");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.queueVideo("demo.wmv"), L"Error couldnt queue file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            Sleep(1000);
+
+            // The seek index is only built on the first step backwards.
+            Assert::IsTrue(videoPlayer.stepBackward(), L"Error couldnt step back");
+
+            for (auto waited = 0; waited < PLAYBACK_TIMEOUT && wpl::TaskScheduler::shared().stats().completed < completed + 2; waited += 100)
+            {
+                Sleep(100);
+            }
+
+            Assert::IsTrue(wpl::TaskScheduler::shared().stats().completed >= completed + 2, L"Error index and preroll didnt run on the scheduler");
+        }
+
+        TEST_METHOD(FailingPrerollsDontStallWorkers)
+        {
+            {
+                std::ofstream broken("broken.wmv", std::ios::binary);
+                broken << "not a video file";
+            }
+
+            // Twice as many prerolls as workers, each failing to open before
+            // anything reaches the scheduler.
+            const auto prerolls { wpl::TaskScheduler::shared().threads() * 2 };
+            std::vector<std::unique_ptr<wpl::VideoPlayer>> players;
+
+            for (size_t i = 0; i < prerolls; ++i)
+            {
+                players.emplace_back(std::make_unique<wpl::VideoPlayer>());
+                Assert::IsTrue(players.back()->queueVideo("broken.wmv"), L"Error couldnt queue file");
+                Assert::AreEqual(size_t(0), players.back()->queuedVideos(), L"Error broken file stayed queued");
+            }
+
+            auto probe { wpl::TaskScheduler::shared().submit([]() { return true; }, std::chrono::steady_clock::now()) };
+
+            Assert::IsTrue(probe.wait_for(std::chrono::milliseconds(PLAYBACK_TIMEOUT)) == std::future_status::ready, L"Error failing prerolls stalled the workers");
+
+            players.clear();
+            DeleteFileA("broken.wmv");
+        }
+    };
+}
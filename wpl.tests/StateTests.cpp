@@ -99,5 +99,670 @@ namespace WPLTests
             SDL_DestroyWindow(window);
             SDL_Quit();
         }
+
+        TEST_METHOD(UnthrottledFinishedTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setClockMode(wpl::ClockMode::Unthrottled), L"Error couldnt set clock mode");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            SDL_AddTimer(PLAYBACK_TIMEOUT, timeout, nullptr);
+
+            auto quit = false;
+
+            while (!quit) {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                        quit = true;
+                    }
+                }
+
+                if (videoPlayer.hasFinished())
+                    quit = true;
+            }
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(ManualClockFinishedTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsFalse(videoPlayer.advanceClock(ONE_SECOND), L"Error advanced a real time clock");
+            Assert::IsTrue(videoPlayer.setClockMode(wpl::ClockMode::Manual), L"Error couldnt set clock mode");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsFalse(videoPlayer.setClockMode(wpl::ClockMode::RealTime), L"Error changed clock while playing");
+
+            SDL_AddTimer(PLAYBACK_TIMEOUT, timeout, nullptr);
+
+            auto quit = false;
+
+            while (!quit) {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                        quit = true;
+                    }
+                }
+
+                videoPlayer.advanceClock(ONE_SECOND);
+
+                if (videoPlayer.hasFinished())
+                    quit = true;
+            }
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(LoopTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setClockMode(wpl::ClockMode::Unthrottled), L"Error couldnt set clock mode");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.setLooping(true), L"Error couldnt enable looping");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            SDL_AddTimer(PLAYBACK_TIMEOUT, timeout, nullptr);
+
+            auto quit = false;
+
+            while (!quit) {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                        quit = true;
+                    }
+                }
+
+                Assert::IsFalse(videoPlayer.hasFinished(), L"Error looping video reported it had finished");
+
+                if (videoPlayer.stats().loops >= 2)
+                    quit = true;
+            }
+
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error player stopped while looping");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(PlaylistTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setClockMode(wpl::ClockMode::Unthrottled), L"Error couldnt set clock mode");
+            Assert::IsTrue(videoPlayer.queueVideo("demo.wmv"), L"Error couldnt queue file");
+            Assert::IsTrue(videoPlayer.queueVideo("demo.wmv"), L"Error couldnt queue file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play queued file");
+
+            SDL_AddTimer(PLAYBACK_TIMEOUT, timeout, nullptr);
+
+            auto quit = false;
+
+            while (!quit) {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                        quit = true;
+                    }
+                }
+
+                if (videoPlayer.hasFinished())
+                    quit = true;
+            }
+
+            Assert::AreEqual(2u, videoPlayer.stats().transitions, L"Error didnt play every queued file");
+            Assert::AreEqual(size_t(0), videoPlayer.queuedVideos(), L"Error queue wasnt drained");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(HandoffRevealTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error couldnt open file");
+            Assert::IsTrue(videoPlayer.queueVideo("demo.wmv"), L"Error couldnt queue file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            SDL_AddTimer(PLAYBACK_TIMEOUT, timeout, nullptr);
+
+            // Polling slowly means the app notices the handoff well after it
+            // happened, which must not delay showing the next clip. Messages
+            // are still pumped often, as any app does, which is what carries
+            // the reveal.
+            for (auto waited = 0; videoPlayer.stats().transitions == 0; waited += 10)
+            {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                    }
+                }
+
+                if (waited % 250 == 0)
+                    videoPlayer.hasFinished();
+
+                Sleep(10);
+            }
+
+            Assert::IsTrue(videoPlayer.stats().handoffPosition < ONE_SECOND / 10, L"Error next clip wasnt revealed on its first frame");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(SoftReopenTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(CACHE_BYTES), L"Error couldnt set cache budget");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+
+            // The last seek is served from the cache, so the graph is left
+            // at another position than the frame on show.
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 3), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+            Assert::AreEqual(1ULL, videoPlayer.stats().cacheHits, L"Error seek wasnt served from the cache");
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt reopen file");
+            Assert::AreEqual(1u, videoPlayer.stats().softReopens, L"Error reopen rebuilt the whole graph");
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Stopped, L"Error reopened file wasnt stopped");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play reopened file");
+            Assert::IsTrue(videoPlayer.position() < ONE_SECOND, L"Error reopened graph seeked to the old frame");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(RedundantRedrawTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            for (auto i = 0; i < 3; ++i)
+            {
+                Assert::IsTrue(videoPlayer.updateVideoWindow(), L"Error couldnt update window");
+                Assert::IsTrue(videoPlayer.repaint(), L"Error couldnt repaint");
+            }
+
+            Assert::AreEqual(3ULL, videoPlayer.stats().elidedUpdates, L"Error unchanged window was repositioned");
+            Assert::AreEqual(2ULL, videoPlayer.stats().elidedRepaints, L"Error unchanged frame was repainted");
+
+            videoPlayer.invalidateVideoWindow();
+            Assert::IsTrue(videoPlayer.updateVideoWindow(), L"Error couldnt update window");
+            Assert::AreEqual(3ULL, videoPlayer.stats().elidedUpdates, L"Error exposed window wasnt repositioned");
+
+            SDL_SetWindowSize(window, 640, 360);
+            Assert::IsTrue(videoPlayer.updateVideoWindow(), L"Error couldnt update window");
+            Assert::AreEqual(3ULL, videoPlayer.stats().elidedUpdates, L"Error resized window wasnt repositioned");
+
+            // A paused window may have been uncovered without anyone saying
+            // so, so its repaints are never skipped.
+            const auto elidedRepaints { videoPlayer.stats().elidedRepaints };
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.repaint(), L"Error couldnt repaint");
+            Assert::IsTrue(videoPlayer.repaint(), L"Error couldnt repaint");
+            Assert::AreEqual(elidedRepaints, videoPlayer.stats().elidedRepaints, L"Error paused frame wasnt repainted");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(HiddenPlaybackTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.setVisibility(wpl::Visibility::Minimised), L"Error couldnt hide player");
+
+            const auto hiddenAt { videoPlayer.position() };
+            const auto elided { videoPlayer.stats().elidedUpdates };
+
+            Sleep(500);
+            Assert::IsTrue(videoPlayer.updateVideoWindow(), L"Error couldnt update window");
+            Assert::AreEqual(elided + 1, videoPlayer.stats().elidedUpdates, L"Error hidden window was repositioned");
+            Assert::IsTrue(videoPlayer.position() > hiddenAt, L"Error clock stopped while hidden");
+
+            Assert::IsTrue(videoPlayer.setVisibility(wpl::Visibility::Visible), L"Error couldnt show player");
+            Assert::IsTrue(videoPlayer.visibility() == wpl::Visibility::Visible);
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback stopped");
+
+            // Showing the player again repositions it once, after which an
+            // unchanged window is skipped just as before it was hidden.
+            Assert::IsTrue(videoPlayer.updateVideoWindow(), L"Error couldnt update window");
+            Assert::IsTrue(videoPlayer.repaint(), L"Error couldnt repaint");
+
+            const auto shownElided { videoPlayer.stats().elidedUpdates };
+            const auto shownRepaints { videoPlayer.stats().elidedRepaints };
+
+            Assert::IsTrue(videoPlayer.updateVideoWindow(), L"Error couldnt update window");
+            Assert::IsTrue(videoPlayer.repaint(), L"Error couldnt repaint");
+            Assert::AreEqual(shownElided + 1, videoPlayer.stats().elidedUpdates, L"Error visible window was repositioned again");
+            Assert::AreEqual(shownRepaints + 1, videoPlayer.stats().elidedRepaints, L"Error visible frame was repainted again");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(PosterFrameTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setPosterFrame(true, ONE_SECOND), L"Error couldnt enable poster frame");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.hasFirstFrame(), L"Error poster wasnt shown on open");
+            Assert::IsTrue(videoPlayer.stats().firstPaintTime > 0, L"Error time to first paint wasnt measured");
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Stopped, L"Error poster left the player running");
+            Assert::IsTrue(videoPlayer.position() < ONE_FRAME, L"Error poster didnt rewind");
+
+            Assert::IsTrue(videoPlayer.setPosterFrame(false), L"Error couldnt disable poster frame");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt reopen file");
+            Assert::IsFalse(videoPlayer.hasFirstFrame(), L"Error first frame reported before play");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+
+            const auto deadline { GetTickCount() + PLAYBACK_TIMEOUT };
+
+            while (!videoPlayer.hasFirstFrame() && GetTickCount() < deadline)
+            {
+                videoPlayer.hasFinished();
+                Sleep(10);
+            }
+
+            Assert::IsTrue(videoPlayer.hasFirstFrame(), L"Error first frame never reported");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(LowLatencyTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.setLowLatency(true), L"Error couldnt switch to low latency while playing");
+            Assert::IsTrue(videoPlayer.isLowLatency());
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback didnt resume");
+
+            Assert::IsTrue(videoPlayer.setLowLatency(false), L"Error couldnt switch back");
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Playing, L"Error playback didnt resume");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(PlayerPoolTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::PlayerPool playerPool(2);
+            Assert::AreEqual(size_t(2), playerPool.available(), L"Error pool wasnt filled");
+
+            auto videoPlayer = playerPool.acquire(wmInfo.info.win.window);
+            Assert::AreEqual(size_t(1), playerPool.available(), L"Error player wasnt taken from the pool");
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::NoVideo, L"Error pooled player already had a video");
+            Assert::IsTrue(videoPlayer.setLooping(true));
+            Assert::IsTrue(videoPlayer.setLowLatency(true));
+            Assert::IsTrue(videoPlayer.setClockMode(wpl::ClockMode::Manual));
+            Assert::IsTrue(videoPlayer.setVisibility(wpl::Visibility::Occluded));
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(CACHE_BYTES));
+            Assert::IsTrue(videoPlayer.addRenderTarget(std::make_shared<wpl::EVR>()));
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.queueVideo("demo.wmv"), L"Error couldnt queue file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+
+            playerPool.release(std::move(videoPlayer));
+            Assert::AreEqual(size_t(2), playerPool.available(), L"Error player wasnt returned to the pool");
+
+            // Both pooled players are taken, so one of them is the released one.
+            auto first = playerPool.acquire(wmInfo.info.win.window);
+            auto second = playerPool.acquire(wmInfo.info.win.window);
+
+            for (auto reused : { &first, &second })
+            {
+                Assert::IsFalse(reused->isLooping(), L"Error looping carried over");
+                Assert::IsFalse(reused->isLowLatency(), L"Error low latency carried over");
+                Assert::IsTrue(reused->clockMode() == wpl::ClockMode::RealTime, L"Error clock mode carried over");
+                Assert::IsTrue(reused->visibility() == wpl::Visibility::Visible, L"Error visibility carried over");
+                Assert::AreEqual(size_t(0), reused->renderTargetCount(), L"Error render targets carried over");
+                Assert::AreEqual(size_t(0), reused->queuedVideos(), L"Error playlist carried over");
+                Assert::AreEqual(0ULL, reused->stats().cacheMisses, L"Error stats carried over");
+
+                Assert::IsTrue(reused->openVideo("demo.wmv"), L"Error warmed up player didnt load file");
+                Assert::IsTrue(reused->hasVideo(), L"Error warmed up renderer wasnt connected");
+                Assert::IsTrue(reused->seek(ONE_SECOND), L"Error couldnt seek");
+                Assert::AreEqual(size_t(0), reused->memoryUsage().cacheBytes, L"Error cache budget carried over");
+            }
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(ScrubCacheTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(CACHE_BYTES), L"Error couldnt set cache budget");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+
+            Assert::AreEqual(2ULL, videoPlayer.stats().cacheMisses, L"Error new positions didnt miss");
+            Assert::AreEqual(1ULL, videoPlayer.stats().cacheHits, L"Error revisited position wasnt cached");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(CompressedCacheHitTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(CACHE_BYTES, CACHE_BYTES), L"Error couldnt set cache budget");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+
+            const auto heldBytes { videoPlayer.memoryUsage().cacheBytes };
+            auto start { std::chrono::steady_clock::now() };
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+            const auto decodeTime { std::chrono::steady_clock::now() - start };
+
+            // Room for one frame, so the next one pushes this into the compressed tier.
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(videoPlayer.memoryUsage().cacheBytes - heldBytes, CACHE_BYTES));
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+
+            start = std::chrono::steady_clock::now();
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+            const auto hitTime { std::chrono::steady_clock::now() - start };
+
+            Assert::AreEqual(1ULL, videoPlayer.stats().compressedCacheHits, L"Error revisited position wasnt compressed");
+            Assert::IsTrue(hitTime < decodeTime, L"Error decompressing was slower than decoding");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(ScrubCacheIsOptInTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+
+            Assert::AreEqual(0ULL, videoPlayer.stats().cacheHits, L"Error frames were cached without a budget");
+            Assert::AreEqual(size_t(0), videoPlayer.memoryUsage().cacheBytes, L"Error cache used memory without a budget");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(FrameStepTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(CACHE_BYTES), L"Error couldnt set cache budget");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.stepForward(), L"Error couldnt step forward");
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Paused, L"Error stepping didnt pause");
+            Assert::IsTrue(videoPlayer.stepBackward(), L"Error couldnt step back");
+            Assert::AreEqual(1ULL, videoPlayer.stats().cacheHits, L"Error stepping back over a decoded frame missed");
+
+            Assert::IsTrue(videoPlayer.stepBackward(), L"Error couldnt step back into previous group of pictures");
+            Assert::IsTrue(videoPlayer.stepBackward(), L"Error couldnt step back");
+            Assert::AreEqual(2ULL, videoPlayer.stats().cacheHits, L"Error group of pictures wasnt buffered");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(StepThenReopenTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.setFrameCacheBudget(CACHE_BYTES), L"Error couldnt set cache budget");
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND * 2), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.stepForward(), L"Error couldnt step forward");
+            Assert::IsTrue(videoPlayer.stepBackward(), L"Error couldnt step back");
+            Assert::AreEqual(1ULL, videoPlayer.stats().cacheHits, L"Error step wasnt served from the cache");
+            Assert::IsTrue(videoPlayer.setRate(2.0), L"Error couldnt set rate");
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt reopen file");
+            Assert::AreEqual(1.0, videoPlayer.rate(), L"Error rate carried over");
+            Assert::AreEqual(0LL, videoPlayer.position(), L"Error reopened file didnt start at the beginning");
+
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play reopened file");
+            Assert::IsTrue(videoPlayer.position() < ONE_SECOND, L"Error playback resumed at the previous clip's frame");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(ReversePlaybackTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.setRate(-4.0), L"Error couldnt set a negative rate");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play backwards");
+
+            SDL_AddTimer(PLAYBACK_TIMEOUT, timeout, nullptr);
+
+            auto quit = false;
+
+            while (!quit) {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                        quit = true;
+                    }
+                }
+
+                if (videoPlayer.hasFinished())
+                    quit = true;
+            }
+
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Paused, L"Error reverse playback didnt stop at the start");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
+
+        TEST_METHOD(ReverseRunsWithoutPollingTest)
+        {
+            SDL_Init(SDL_INIT_VIDEO);
+            SDL_Window * window = SDL_CreateWindow("", 100, 100, 800, 500, SDL_WINDOW_SHOWN);
+
+            SDL_SysWMinfo wmInfo;
+            SDL_VERSION(&wmInfo.version);
+            SDL_GetWindowWMInfo(window, &wmInfo);
+
+            wpl::VideoPlayer videoPlayer(wmInfo.info.win.window);
+
+            Assert::IsTrue(videoPlayer.openVideo("demo.wmv"), L"Error didnt load file");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play file");
+            Assert::IsTrue(videoPlayer.pause(), L"Error couldnt pause file");
+            Assert::IsTrue(videoPlayer.seek(ONE_SECOND), L"Error couldnt seek");
+            Assert::IsTrue(videoPlayer.setRate(-4.0), L"Error couldnt set a negative rate");
+            Assert::IsTrue(videoPlayer.play(), L"Error couldnt play backwards");
+
+            // Only messages are pumped, which is enough to drive the steps.
+            for (auto waited = 0; waited < PLAYBACK_TIMEOUT && videoPlayer.playbackState() == wpl::PlaybackState::Playing; waited += 10)
+            {
+                SDL_Event event;
+                while (SDL_PollEvent(&event)) {
+                    if (event.type == SDL_QUIT) {
+                        Assert::Fail();
+                    }
+                }
+
+                Sleep(10);
+            }
+
+            Assert::IsTrue(videoPlayer.playbackState() == wpl::PlaybackState::Paused, L"Error reverse playback didnt reach the start");
+            Assert::IsTrue(videoPlayer.hasFinished(), L"Error reaching the start wasnt reported");
+
+            // A second of frames spans a group of pictures or two, each of
+            // which is decoded once rather than once per frame.
+            Assert::IsTrue(videoPlayer.stats().reverseDecodes > 0, L"Error reverse playback didnt decode a group");
+            Assert::IsTrue(videoPlayer.stats().reverseDecodes < 10, L"Error reverse playback decoded a group per frame");
+
+            SDL_DestroyWindow(window);
+            SDL_Quit();
+        }
     };
 }
\ No newline at end of file
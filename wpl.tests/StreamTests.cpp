@@ -0,0 +1,81 @@
+#include "CppUnitTest.h"
+#include "Tests.h"
+
+#include <fstream>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace WPLTests
+{
+    std::vector<BYTE> readFile(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        return std::vector<BYTE>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    std::thread writePipe(HANDLE pipe, const std::vector<BYTE>& contents)
+    {
+        return std::thread([pipe, &contents]() {
+            size_t offset { 0 };
+            DWORD written { 0 };
+
+            while (offset < contents.size() && WriteFile(pipe, contents.data() + offset, static_cast<DWORD>(std::min<size_t>(contents.size() - offset, 4096)), &written, nullptr))
+            {
+                offset += written;
+            }
+
+            CloseHandle(pipe);
+        });
+    }
+
+    TEST_CLASS(StreamTests)
+    {
+    public:
+        TEST_METHOD(StreamReaderKeepsBoundedBuffer)
+        {
+            HANDLE readEnd, writeEnd;
+            Assert::IsTrue(CreatePipe(&readEnd, &writeEnd, nullptr, 0) == TRUE, L"Error couldnt create pipe");
+
+            const auto contents { readFile("demo.wmv") };
+            auto writer { writePipe(writeEnd, contents) };
+
+            wpl::StreamReader reader;
+            Assert::IsTrue(reader.open(readEnd, 1024 * 1024), L"Error couldnt open pipe");
+
+            std::vector<BYTE> buffer(100000);
+            unsigned long long offset { 0 };
+
+            while (const auto bytesRead = reader.read(offset, buffer.size(), buffer.data()))
+            {
+                Assert::IsTrue(std::equal(buffer.begin(), buffer.begin() + bytesRead, contents.begin() + offset), L"Error stream returned wrong bytes");
+                offset += bytesRead;
+            }
+
+            Assert::AreEqual(static_cast<unsigned long long>(contents.size()), offset);
+            Assert::AreEqual(size_t(0), reader.read(0, buffer.size(), buffer.data()), L"Error discarded data was returned");
+            Assert::IsTrue(reader.stats().latencySamples > 0, L"Error source latency wasnt measured");
+
+            reader.close();
+            writer.join();
+            CloseHandle(readEnd);
+        }
+
+        TEST_METHOD(OpenStreamRejectsUnknownContainer)
+        {
+            HANDLE readEnd, writeEnd;
+            Assert::IsTrue(CreatePipe(&readEnd, &writeEnd, nullptr, 0) == TRUE, L"Error couldnt create pipe");
+
+            const auto contents { readFile("demo.wmv") };
+            auto writer { writePipe(writeEnd, contents) };
+
+            wpl::VideoPlayer videoPlayer;
+            Assert::IsFalse(videoPlayer.openStream(readEnd), L"Error ASF cant be demuxed from a pipe");
+            Assert::IsFalse(videoPlayer.isSeekable(), L"Error nothing is loaded");
+            Assert::IsTrue(videoPlayer.lastError() == wpl::PlayerError::Unsupported, L"Error container failure not reported as unsupported");
+
+            CloseHandle(readEnd);
+            writer.join();
+        }
+    };
+}
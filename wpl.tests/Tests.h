@@ -13,6 +13,10 @@
 #pragma comment(lib, "WPL.lib")
 
 #define PLAYBACK_TIMEOUT 15000
+#define ONE_SECOND 10000000LL
+#define ONE_FRAME 400000LL
+#define FRAME_BYTES size_t(1024)
+#define CACHE_BYTES size_t(64 * 1024 * 1024)
 
 template <typename... ParamTypes>
 void setTimeout(int milliseconds, std::function<void()> func)
@@ -0,0 +1,676 @@
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto MinimumMatch {4};
+const auto LastLiterals {8};
+const auto MaximumOffset {65535};
+const auto HashBits {14};
+
+unsigned int readWord(const BYTE * source)
+{
+    unsigned int word;
+    std::memcpy(&word, source, sizeof(word));
+    return word;
+}
+
+void writeLength(std::vector<BYTE>& output, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        output.push_back(255);
+    }
+
+    output.push_back(static_cast<BYTE>(length));
+}
+
+bool readLength(const BYTE *& input, const BYTE * end, size_t * length)
+{
+    BYTE next { 255 };
+
+    while (next == 255)
+    {
+        if (input == end)
+        {
+            return false;
+        }
+
+        next = *input++;
+        *length += next;
+    }
+
+    return true;
+}
+
+void writeSequence(std::vector<BYTE>& output, const BYTE * literals, size_t literalLength, size_t offset, size_t matchLength)
+{
+    const auto literalToken { std::min<size_t>(literalLength, 15) };
+    const auto matchToken { matchLength == 0 ? 0 : std::min<size_t>(matchLength - MinimumMatch, 15) };
+
+    output.push_back(static_cast<BYTE>(literalToken << 4 | matchToken));
+
+    if (literalToken == 15)
+    {
+        writeLength(output, literalLength - 15);
+    }
+
+    output.insert(output.end(), literals, literals + literalLength);
+
+    if (matchLength == 0)
+    {
+        return;
+    }
+
+    output.push_back(static_cast<BYTE>(offset & 0xFF));
+    output.push_back(static_cast<BYTE>(offset >> 8));
+
+    if (matchToken == 15)
+    {
+        writeLength(output, matchLength - MinimumMatch - 15);
+    }
+}
+
+void compressBlock(const BYTE * input, size_t size, std::vector<BYTE>& output)
+{
+    std::vector<int> table(size_t(1) << HashBits, -1);
+    size_t anchor { 0 };
+    size_t position { 0 };
+
+    while (size >= LastLiterals && position + LastLiterals <= size)
+    {
+        const auto word { readWord(input + position) };
+        const auto hash { (word * 2654435761u) >> (32 - HashBits) };
+        const auto candidate { table[hash] };
+
+        table[hash] = static_cast<int>(position);
+
+        if (candidate < 0 || position - candidate > MaximumOffset || readWord(input + candidate) != word)
+        {
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+
+        auto matchLength { size_t(MinimumMatch) };
+
+        while (position + matchLength + LastLiterals <= size && input[candidate + matchLength] == input[position + matchLength])
+        {
+            ++matchLength;
+        }
+
+        writeSequence(output, input + anchor, position - anchor, position - candidate, matchLength);
+        position += matchLength;
+        anchor = position;
+    }
+
+    writeSequence(output, input + anchor, size - anchor, 0, 0);
+}
+
+// Largest output compressBlock can produce, for literals that never match.
+size_t compressedBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Matches at least a word back never overlap within a word, so they copy
+// eight bytes at a time; closer matches repeat a short run and go bytewise.
+BYTE * copyMatch(BYTE * output, const BYTE * match, size_t offset, size_t length)
+{
+    if (offset >= 8)
+    {
+        for (; length >= 8; length -= 8, output += 8, match += 8)
+        {
+            std::memcpy(output, match, 8);
+        }
+    }
+
+    for (; length > 0; --length)
+    {
+        *output++ = *match++;
+    }
+
+    return output;
+}
+
+bool decompressBlock(const BYTE * input, size_t size, BYTE * output, size_t outputSize)
+{
+    const auto inputEnd { input + size };
+    const auto outputStart { output };
+    const auto outputEnd { output + outputSize };
+
+    while (input < inputEnd)
+    {
+        const auto token { *input++ };
+        auto literalLength { size_t(token >> 4) };
+
+        if (literalLength == 15 && !readLength(input, inputEnd, &literalLength))
+        {
+            return false;
+        }
+
+        if (literalLength > size_t(inputEnd - input) || literalLength > size_t(outputEnd - output))
+        {
+            return false;
+        }
+
+        output = std::copy_n(input, literalLength, output);
+        input += literalLength;
+
+        if (input == inputEnd)
+        {
+            break;
+        }
+
+        if (inputEnd - input < 2)
+        {
+            return false;
+        }
+
+        const auto offset { size_t(input[0]) | size_t(input[1]) << 8 };
+        auto matchLength { size_t(token & 0x0F) };
+
+        input += 2;
+
+        if (matchLength == 15 && !readLength(input, inputEnd, &matchLength))
+        {
+            return false;
+        }
+
+        matchLength += MinimumMatch;
+
+        if (offset == 0 || offset > size_t(output - outputStart) || matchLength > size_t(outputEnd - output))
+        {
+            return false;
+        }
+
+        output = copyMatch(output, output - offset, offset, matchLength);
+    }
+
+    return output == outputEnd;
+}
+
+void subtractRow(const BYTE * row, const BYTE * above, BYTE * output, size_t length)
+{
+    size_t i { 0 };
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const auto current { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) };
+        const auto previous { _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + i)) };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_sub_epi8(current, previous));
+    }
+
+    for (; i < length; ++i)
+    {
+        output[i] = static_cast<BYTE>(row[i] - above[i]);
+    }
+}
+
+void addRow(BYTE * row, const BYTE * above, size_t length)
+{
+    size_t i { 0 };
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const auto current { _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)) };
+        const auto previous { _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + i)) };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_add_epi8(current, previous));
+    }
+
+    for (; i < length; ++i)
+    {
+        row[i] = static_cast<BYTE>(row[i] + above[i]);
+    }
+}
+
+void interleavePlanes(const BYTE * planes, size_t planeSize, BYTE * output)
+{
+    size_t pixel { 0 };
+
+    for (; pixel + 16 <= planeSize; pixel += 16)
+    {
+        const auto blue { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + pixel)) };
+        const auto green { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + planeSize + pixel)) };
+        const auto red { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + planeSize * 2 + pixel)) };
+        const auto alpha { _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes + planeSize * 3 + pixel)) };
+
+        const auto blueGreenLow { _mm_unpacklo_epi8(blue, green) };
+        const auto blueGreenHigh { _mm_unpackhi_epi8(blue, green) };
+        const auto redAlphaLow { _mm_unpacklo_epi8(red, alpha) };
+        const auto redAlphaHigh { _mm_unpackhi_epi8(red, alpha) };
+        const auto target { reinterpret_cast<__m128i*>(output + pixel * 4) };
+
+        _mm_storeu_si128(target, _mm_unpacklo_epi16(blueGreenLow, redAlphaLow));
+        _mm_storeu_si128(target + 1, _mm_unpackhi_epi16(blueGreenLow, redAlphaLow));
+        _mm_storeu_si128(target + 2, _mm_unpacklo_epi16(blueGreenHigh, redAlphaHigh));
+        _mm_storeu_si128(target + 3, _mm_unpackhi_epi16(blueGreenHigh, redAlphaHigh));
+    }
+
+    for (; pixel < planeSize; ++pixel)
+    {
+        output[pixel * 4] = planes[pixel];
+        output[pixel * 4 + 1] = planes[planeSize + pixel];
+        output[pixel * 4 + 2] = planes[planeSize * 2 + pixel];
+        output[pixel * 4 + 3] = planes[planeSize * 3 + pixel];
+    }
+}
+
+std::vector<BYTE> encodeFrame(const VideoFrame& frame)
+{
+    const auto stride { static_cast<size_t>(frame.stride) };
+    const auto rows { static_cast<size_t>(frame.height) };
+    const auto planeSize { frame.pixels.size() / 4 };
+
+    std::vector<BYTE> residual(frame.pixels.size());
+    std::vector<BYTE> planes(frame.pixels.size());
+    std::vector<BYTE> output;
+
+    std::copy_n(frame.pixels.data(), stride, residual.data());
+
+    for (size_t row = 1; row < rows; ++row)
+    {
+        subtractRow(&frame.pixels[row * stride], &frame.pixels[(row - 1) * stride], &residual[row * stride], stride);
+    }
+
+    for (size_t pixel = 0; pixel < planeSize; ++pixel)
+    {
+        planes[pixel] = residual[pixel * 4];
+        planes[planeSize + pixel] = residual[pixel * 4 + 1];
+        planes[planeSize * 2 + pixel] = residual[pixel * 4 + 2];
+        planes[planeSize * 3 + pixel] = residual[pixel * 4 + 3];
+    }
+
+    output.reserve(frame.pixels.size() / 4);
+    compressBlock(planes.data(), planes.size(), output);
+    output.shrink_to_fit();
+    return output;
+}
+
+bool decodeFrame(const VideoFrame& compressed, VideoFrame * frame)
+{
+    const auto stride { static_cast<size_t>(compressed.stride) };
+    const auto size { stride * static_cast<size_t>(compressed.height) };
+    const auto planeSize { size / 4 };
+
+    std::vector<BYTE> planes(size);
+
+    if (size % 4 != 0 || !decompressBlock(compressed.pixels.data(), compressed.pixels.size(), planes.data(), size))
+    {
+        return false;
+    }
+
+    frame->stream = compressed.stream;
+    frame->pts = compressed.pts;
+    frame->duration = compressed.duration;
+    frame->width = compressed.width;
+    frame->height = compressed.height;
+    frame->stride = compressed.stride;
+    frame->keyFrame = compressed.keyFrame;
+    frame->pixels.resize(size);
+
+    interleavePlanes(planes.data(), planeSize, frame->pixels.data());
+
+    for (size_t row = 1; row < static_cast<size_t>(compressed.height); ++row)
+    {
+        addRow(&frame->pixels[row * stride], &frame->pixels[(row - 1) * stride], stride);
+    }
+
+    return true;
+}
+
+FrameCache::FrameCache(size_t budgetBytes, size_t compressedBudgetBytes)
+    : budget(budgetBytes),
+      used(0),
+      compressedBudget(compressedBudgetBytes),
+      compressedUsed(0),
+      reported(0),
+      trimmedAt(MemoryGovernor::shared().trimRequests()),
+      hitCount(0),
+      missCount(0),
+      compressedHitCount(0)
+{
+}
+
+FrameCache::FrameCache(FrameCache&& other)
+    : FrameCache()
+{
+    swap(other);
+}
+
+FrameCache::~FrameCache()
+{
+    clear();
+}
+
+FrameCache& FrameCache::operator=(FrameCache&& other)
+{
+    swap(other);
+    return *this;
+}
+
+void FrameCache::swap(FrameCache& other)
+{
+    std::swap(keyFrames, other.keyFrames);
+    std::swap(frames, other.frames);
+    std::swap(compressedFrames, other.compressedFrames);
+    std::swap(index, other.index);
+    std::swap(compressedIndex, other.compressedIndex);
+    std::swap(budget, other.budget);
+    std::swap(used, other.used);
+    std::swap(compressedBudget, other.compressedBudget);
+    std::swap(compressedUsed, other.compressedUsed);
+    std::swap(reported, other.reported);
+    std::swap(trimmedAt, other.trimmedAt);
+    std::swap(hitCount, other.hitCount);
+    std::swap(missCount, other.missCount);
+    std::swap(compressedHitCount, other.compressedHitCount);
+}
+
+FrameCache::FrameList& FrameCache::listFor(const VideoFrame& frame)
+{
+    return frame.keyFrame ? keyFrames : frames;
+}
+
+FrameCache::FrameIndex::iterator FrameCache::covering(FrameIndex& frameIndex, int stream, REFERENCE_TIME position)
+{
+    auto entry { frameIndex.upper_bound(FrameKey(stream, position)) };
+
+    if (entry == frameIndex.begin())
+    {
+        return frameIndex.end();
+    }
+
+    --entry;
+
+    const auto& frame { *entry->second };
+    const auto duration { std::max(frame.duration, 1LL) };
+
+    return entry->first.first == stream && position < frame.pts + duration ? entry : frameIndex.end();
+}
+
+const VideoFrame * FrameCache::find(int stream, REFERENCE_TIME position)
+{
+    trim();
+
+    const auto entry { covering(index, stream, position) };
+
+    if (entry != index.end())
+    {
+        auto& frameList { listFor(*entry->second) };
+        frameList.splice(frameList.begin(), frameList, entry->second);
+
+        ++hitCount;
+        return &*entry->second;
+    }
+
+    const auto compressedEntry { covering(compressedIndex, stream, position) };
+
+    if (compressedEntry != compressedIndex.end())
+    {
+        const auto frame { promote(compressedEntry) };
+
+        if (frame != nullptr)
+        {
+            ++hitCount;
+            ++compressedHitCount;
+            return frame;
+        }
+    }
+
+    ++missCount;
+    report();
+    return nullptr;
+}
+
+const VideoFrame * FrameCache::promote(FrameIndex::iterator entry)
+{
+    VideoFrame frame;
+    const auto decoded { decodeFrame(*entry->second, &frame) };
+    const auto key { entry->first };
+
+    eraseCompressed(entry);
+
+    if (!decoded || !insert(std::move(frame)))
+    {
+        return nullptr;
+    }
+
+    return &*index.find(key)->second;
+}
+
+bool FrameCache::insert(VideoFrame frame)
+{
+    const auto bytes { frame.pixels.size() };
+    const auto key { FrameKey(frame.stream, frame.pts) };
+
+    const auto allowance { MemoryGovernor::shared().cacheAllowance(reported) };
+
+    if (bytes > budget)
+    {
+        return false;
+    }
+
+    if (bytes > allowance)
+    {
+        shrink(allowance);
+        report();
+        return false;
+    }
+
+    const auto existing { index.find(key) };
+
+    if (existing != index.end())
+    {
+        erase(existing);
+    }
+
+    const auto existingCompressed { compressedIndex.find(key) };
+
+    if (existingCompressed != compressedIndex.end())
+    {
+        eraseCompressed(existingCompressed);
+    }
+
+    shrink(allowance - bytes);
+    evict(bytes, allowance);
+
+    auto& frameList { listFor(frame) };
+    frameList.push_front(std::move(frame));
+    index[key] = frameList.begin();
+    used += bytes;
+    report();
+    return true;
+}
+
+void FrameCache::erase(FrameIndex::iterator entry)
+{
+    auto& frameList { listFor(*entry->second) };
+
+    used -= entry->second->pixels.size();
+    frameList.erase(entry->second);
+    index.erase(entry);
+}
+
+void FrameCache::eraseCompressed(FrameIndex::iterator entry)
+{
+    compressedUsed -= entry->second->pixels.size();
+    compressedFrames.erase(entry->second);
+    compressedIndex.erase(entry);
+}
+
+void FrameCache::compress(VideoFrame frame)
+{
+    const auto frameBytes { static_cast<size_t>(frame.stride) * static_cast<size_t>(frame.height) };
+
+    if (frame.stride <= 0 || frame.height <= 0 || frameBytes != frame.pixels.size() || frameBytes % 4 != 0)
+    {
+        return;
+    }
+
+    frame.pixels = encodeFrame(frame);
+
+    const auto bytes { frame.pixels.size() };
+    const auto key { FrameKey(frame.stream, frame.pts) };
+
+    if (bytes > compressedBudget)
+    {
+        return;
+    }
+
+    evictCompressed(bytes);
+
+    compressedFrames.push_front(std::move(frame));
+    compressedIndex[key] = compressedFrames.begin();
+    compressedUsed += bytes;
+}
+
+// Compressing allocates the compressed copy before the governor hears of
+// it, so a victim is only compressed while the worst case still fits in
+// the allowance; otherwise it is dropped.
+void FrameCache::evict(size_t required, size_t limit)
+{
+    while (used + required > budget && !index.empty())
+    {
+        auto& victims { frames.empty() ? keyFrames : frames };
+        auto victim { std::move(victims.back()) };
+
+        victims.pop_back();
+        index.erase(FrameKey(victim.stream, victim.pts));
+        used -= victim.pixels.size();
+
+        const auto held { used + compressedUsed + required };
+
+        if (compressedBudget > 0 && held <= limit && compressedBound(victim.pixels.size()) <= limit - held)
+        {
+            compress(std::move(victim));
+        }
+    }
+}
+
+void FrameCache::evictCompressed(size_t required)
+{
+    while (compressedUsed + required > compressedBudget && !compressedIndex.empty())
+    {
+        const auto& victim { compressedFrames.back() };
+        eraseCompressed(compressedIndex.find(FrameKey(victim.stream, victim.pts)));
+    }
+}
+
+// Drops frames outright, without compressing them, until the cache fits in
+// what the memory governor can currently spare.
+void FrameCache::shrink(size_t limit)
+{
+    while (used + compressedUsed > limit && !compressedIndex.empty())
+    {
+        const auto& victim { compressedFrames.back() };
+        eraseCompressed(compressedIndex.find(FrameKey(victim.stream, victim.pts)));
+    }
+
+    while (used + compressedUsed > limit && !index.empty())
+    {
+        const auto& victims { frames.empty() ? keyFrames : frames };
+        const auto& victim { victims.back() };
+        erase(index.find(FrameKey(victim.stream, victim.pts)));
+    }
+}
+
+void FrameCache::report()
+{
+    const auto current { used + compressedUsed };
+
+    if (current != reported)
+    {
+        MemoryGovernor::shared().adjustCache(reported, current);
+        reported = current;
+    }
+}
+
+void FrameCache::setBudget(size_t budgetBytes)
+{
+    budget = budgetBytes;
+    evict(0, MemoryGovernor::shared().cacheAllowance(reported));
+    report();
+}
+
+// Gives memory back once the governor has lowered its limit or granted a
+// buffer, without waiting for the next insert. Owners call this from their
+// own thread whenever they are idle.
+void FrameCache::trim()
+{
+    const auto requests { MemoryGovernor::shared().trimRequests() };
+
+    if (requests == trimmedAt)
+    {
+        return;
+    }
+
+    trimmedAt = requests;
+    shrink(MemoryGovernor::shared().cacheAllowance(reported));
+    report();
+}
+
+void FrameCache::setCompressedBudget(size_t budgetBytes)
+{
+    compressedBudget = budgetBytes;
+    evictCompressed(0);
+    report();
+}
+
+void FrameCache::clear()
+{
+    index.clear();
+    compressedIndex.clear();
+    keyFrames.clear();
+    frames.clear();
+    compressedFrames.clear();
+    used = 0;
+    compressedUsed = 0;
+    report();
+}
+
+size_t FrameCache::budgetBytes() const
+{
+    return budget;
+}
+
+size_t FrameCache::usedBytes() const
+{
+    return used;
+}
+
+size_t FrameCache::compressedBudgetBytes() const
+{
+    return compressedBudget;
+}
+
+size_t FrameCache::compressedBytes() const
+{
+    return compressedUsed;
+}
+
+size_t FrameCache::size() const
+{
+    return index.size();
+}
+
+size_t FrameCache::compressedSize() const
+{
+    return compressedIndex.size();
+}
+
+unsigned long long FrameCache::hits() const
+{
+    return hitCount;
+}
+
+unsigned long long FrameCache::misses() const
+{
+    return missCount;
+}
+
+unsigned long long FrameCache::compressedHits() const
+{
+    return compressedHitCount;
+}
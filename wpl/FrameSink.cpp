@@ -0,0 +1,1531 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto InputPinName {L"Input"};
+const auto SinkFilterName {L"WPL Frame Sink"};
+const auto ConvertedBuffers {long(3)};
+
+const CLSID CLSID_FrameSink { 0x3C5B9E24, 0x7A61, 0x4D8F, { 0xB2, 0x0E, 0x95, 0x4F, 0x1A, 0xC7, 0x68, 0x3D } };
+const GUID SubtypeI420 { 0x30323449, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 } };
+
+template<typename T>
+void safeRelease(T ** comPtr)
+{
+    if (comPtr != nullptr && *comPtr)
+    {
+        (*comPtr)->Release();
+        (*comPtr) = nullptr;
+    }
+}
+
+bool copyMediaType(const AM_MEDIA_TYPE& source, AM_MEDIA_TYPE * copy)
+{
+    *copy = source;
+    copy->cbFormat = 0;
+    copy->pbFormat = nullptr;
+
+    if (source.cbFormat > 0 && source.pbFormat != nullptr)
+    {
+        copy->pbFormat = static_cast<BYTE*>(CoTaskMemAlloc(source.cbFormat));
+
+        if (copy->pbFormat == nullptr)
+        {
+            copy->pUnk = nullptr;
+            return false;
+        }
+
+        std::memcpy(copy->pbFormat, source.pbFormat, source.cbFormat);
+        copy->cbFormat = source.cbFormat;
+    }
+
+    if (copy->pUnk != nullptr)
+    {
+        copy->pUnk->AddRef();
+    }
+
+    return true;
+}
+
+void clearMediaType(AM_MEDIA_TYPE * type)
+{
+    CoTaskMemFree(type->pbFormat);
+    safeRelease(&type->pUnk);
+    *type = {};
+}
+
+const BITMAPINFOHEADER * videoHeader(const AM_MEDIA_TYPE& type, RECT * source)
+{
+    if (type.formattype == FORMAT_VideoInfo && type.cbFormat >= sizeof(VIDEOINFOHEADER) && type.pbFormat != nullptr)
+    {
+        const auto header { reinterpret_cast<const VIDEOINFOHEADER*>(type.pbFormat) };
+        *source = header->rcSource;
+        return &header->bmiHeader;
+    }
+
+    if (type.formattype == FORMAT_VideoInfo2 && type.cbFormat >= sizeof(VIDEOINFOHEADER2) && type.pbFormat != nullptr)
+    {
+        const auto header { reinterpret_cast<const VIDEOINFOHEADER2*>(type.pbFormat) };
+        *source = header->rcSource;
+        return &header->bmiHeader;
+    }
+
+    return nullptr;
+}
+
+bool supportedType(const AM_MEDIA_TYPE& type)
+{
+    RECT source;
+    const auto header { videoHeader(type, &source) };
+
+    return type.majortype == MEDIATYPE_Video && header != nullptr && header->biWidth > 0 && header->biHeight != 0 &&
+        (type.subtype == SubtypeI420 || type.subtype == MEDIASUBTYPE_IYUV || type.subtype == MEDIASUBTYPE_YV12 ||
+         type.subtype == MEDIASUBTYPE_NV12 || type.subtype == MEDIASUBTYPE_RGB32);
+}
+
+PixelFormat subtypeFormat(const GUID& subtype)
+{
+    if (subtype == MEDIASUBTYPE_RGB32)
+    {
+        return PixelFormat::Bgra;
+    }
+
+    return subtype == MEDIASUBTYPE_NV12 ? PixelFormat::Nv12 : PixelFormat::I420;
+}
+
+GUID formatSubtype(PixelFormat format)
+{
+    switch (format)
+    {
+    case PixelFormat::Bgra:
+        return MEDIASUBTYPE_RGB32;
+    case PixelFormat::Nv12:
+        return MEDIASUBTYPE_NV12;
+    default:
+        return SubtypeI420;
+    }
+}
+
+// Row pitches of the planes in a decoder buffer. For planar YUV biWidth is
+// the luma pitch, which may include padding, and the chroma pitch follows
+// from it: half of it for I420 and YV12, all of it for interleaved NV12.
+void decodedStrides(const BITMAPINFOHEADER& header, PixelFormat format, LONG * strides)
+{
+    strides[0] = format == PixelFormat::Bgra ? header.biWidth * 4 : header.biWidth;
+    strides[1] = format == PixelFormat::Bgra ? 0 : format == PixelFormat::Nv12 ? strides[0] : strides[0] / 2;
+    strides[2] = format == PixelFormat::I420 ? strides[0] / 2 : 0;
+}
+
+// Whether every row of every plane lies inside the sample buffer, which
+// catches a crop taken from rcSource that reaches past the frame.
+bool planesInside(const Image& image, const BYTE * buffer, LONG length)
+{
+    const auto pairs { (image.width + 1) / 2 };
+    const auto chromaRows { (image.height + 1) / 2 };
+    const LONG rows[] { image.height, chromaRows, chromaRows };
+    const LONG bytes[] { image.format == PixelFormat::Bgra ? image.width * 4 : image.width, image.format == PixelFormat::Nv12 ? pairs * 2 : pairs, pairs };
+
+    for (auto plane = 0; plane < 3; ++plane)
+    {
+        if (image.planes[plane] == nullptr)
+        {
+            continue;
+        }
+
+        const auto first { image.planes[plane] - buffer };
+        const auto last { first + static_cast<ptrdiff_t>(rows[plane] - 1) * image.strides[plane] };
+
+        if (std::min(first, last) < 0 || std::max(first, last) + bytes[plane] > length)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Points an image at the planes inside a sample buffer without copying them.
+// Bottom-up RGB starts at the last row with a negative stride, YV12 swaps its
+// chroma planes back into I420 order, and rcSource trims any padding.
+bool describeFrame(const AM_MEDIA_TYPE& type, BYTE * buffer, LONG length, Image * image)
+{
+    RECT source;
+    LONG strides[3];
+    const auto header { supportedType(type) ? videoHeader(type, &source) : nullptr };
+
+    if (header == nullptr || buffer == nullptr)
+    {
+        return false;
+    }
+
+    const auto format { subtypeFormat(type.subtype) };
+    const auto rows { std::abs(header->biHeight) };
+    const auto cropped { source.right > source.left && source.bottom > source.top };
+
+    decodedStrides(*header, format, strides);
+
+    *image = {};
+    image->format = format;
+    image->width = cropped ? std::min(source.right, header->biWidth) - source.left : header->biWidth;
+    image->height = cropped ? std::min(source.bottom, rows) - source.top : rows;
+
+    if (image->width <= 0 || image->height <= 0 || (cropped && (source.left < 0 || source.top < 0)))
+    {
+        return false;
+    }
+
+    if (format == PixelFormat::Bgra)
+    {
+        const auto stride { strides[0] };
+
+        if (length < static_cast<long long>(stride) * rows)
+        {
+            return false;
+        }
+
+        image->planes[0] = buffer;
+        image->strides[0] = stride;
+
+        if (header->biHeight > 0)
+        {
+            image->planes[0] += static_cast<ptrdiff_t>(rows - 1) * stride;
+            image->strides[0] = -stride;
+        }
+
+        if (cropped)
+        {
+            image->planes[0] += static_cast<ptrdiff_t>(source.top) * image->strides[0] + source.left * 4;
+        }
+
+        return planesInside(*image, buffer, length);
+    }
+
+    const auto chromaRows { (rows + 1) / 2 };
+    const auto lumaBytes { static_cast<ptrdiff_t>(strides[0]) * rows };
+    const auto chromaBytes { static_cast<ptrdiff_t>(strides[1]) * chromaRows };
+    const auto chromaPlanes { format == PixelFormat::Nv12 ? 1 : 2 };
+    const auto swapped { type.subtype == MEDIASUBTYPE_YV12 };
+
+    if (length < lumaBytes + chromaPlanes * chromaBytes)
+    {
+        return false;
+    }
+
+    image->planes[0] = buffer;
+    image->planes[swapped ? 2 : 1] = buffer + lumaBytes;
+    std::copy(strides, strides + 3, image->strides);
+
+    if (format == PixelFormat::I420)
+    {
+        image->planes[swapped ? 1 : 2] = buffer + lumaBytes + chromaBytes;
+    }
+
+    // NV12 chroma pairs are two bytes wide, so an even left edge moves its
+    // plane by as many bytes as it moves the luma plane.
+    if (cropped)
+    {
+        const auto left { source.left & ~1L };
+        const auto top { source.top & ~1L };
+
+        image->planes[0] += static_cast<ptrdiff_t>(top) * strides[0] + left;
+        image->planes[1] += static_cast<ptrdiff_t>(top / 2) * strides[1] + (format == PixelFormat::Nv12 ? left : left / 2);
+
+        if (format == PixelFormat::I420)
+        {
+            image->planes[2] += static_cast<ptrdiff_t>(top / 2) * strides[2] + left / 2;
+        }
+    }
+
+    return planesInside(*image, buffer, length);
+}
+
+// Bytes read and written for each pair of pixels by a single-pass
+// conversion, three for a YUV frame and eight for BGRA. Nothing converts
+// BGRA back to YUV.
+int formatCost(PixelFormat from, PixelFormat to)
+{
+    const auto bytes = [](PixelFormat format) { return format == PixelFormat::Bgra ? 8 : 3; };
+    return from == PixelFormat::Bgra && to != PixelFormat::Bgra ? -1 : bytes(from) + bytes(to);
+}
+
+LONG alignUp(LONG value, LONG alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Picks what the sink delivers for a decoded type and returns its cost, or
+// -1 when no preferred format can be reached. The decoder's buffer goes out
+// untouched when its format is wanted and its rows are aligned, except for
+// RGB32 whose alpha byte decoders leave undefined, so asking for BGRA always
+// gets an opaque copy. Ties go to the format preferred first. With no
+// preferences frames arrive in whatever format the decoder chose.
+int chooseFormat(const AM_MEDIA_TYPE& type, const std::vector<PixelFormat>& formats, LONG alignment, FormatChain * chain)
+{
+    RECT source;
+    LONG strides[3];
+    const auto header { supportedType(type) ? videoHeader(type, &source) : nullptr };
+
+    if (header == nullptr)
+    {
+        return -1;
+    }
+
+    const auto decoded { subtypeFormat(type.subtype) };
+    decodedStrides(*header, decoded, strides);
+
+    const auto aligned { std::all_of(strides, strides + 3, [&](LONG stride) { return stride % alignment == 0; }) };
+    auto best { -1 };
+
+    if (formats.empty())
+    {
+        *chain = { decoded, decoded, !aligned };
+        return aligned ? 0 : formatCost(decoded, decoded);
+    }
+
+    for (const auto format : formats)
+    {
+        const auto passthrough { format == decoded && aligned && decoded != PixelFormat::Bgra };
+        const auto cost { passthrough ? 0 : formatCost(decoded, format) };
+
+        if (cost >= 0 && (best < 0 || cost < best))
+        {
+            best = cost;
+            *chain = { decoded, format, !passthrough };
+        }
+    }
+
+    return best;
+}
+
+// Lays a converted frame out in a pooled buffer with every plane and row
+// starting on the alignment. Returns the bytes needed; the plane pointers
+// are only filled in when a buffer is given.
+LONG layoutFrame(PixelFormat format, LONG width, LONG height, LONG alignment, BYTE * buffer, Image * image)
+{
+    const auto pairs { (width + 1) / 2 };
+    const auto chromaRows { (height + 1) / 2 };
+    const LONG strides[] {
+        alignUp(format == PixelFormat::Bgra ? width * 4 : width, alignment),
+        format == PixelFormat::Bgra ? 0 : alignUp(format == PixelFormat::Nv12 ? pairs * 2 : pairs, alignment),
+        format == PixelFormat::I420 ? alignUp(pairs, alignment) : 0
+    };
+    const LONG bytes[] { strides[0] * height, strides[1] * chromaRows, strides[2] * chromaRows };
+    LONG offset { 0 };
+
+    *image = {};
+    image->format = format;
+    image->width = width;
+    image->height = height;
+
+    for (auto plane = 0; plane < 3 && bytes[plane] > 0; ++plane)
+    {
+        image->planes[plane] = buffer != nullptr ? buffer + offset : nullptr;
+        image->strides[plane] = strides[plane];
+        offset += alignUp(bytes[plane], alignment);
+    }
+
+    return offset;
+}
+
+class FrameSinkPin : public IPin, public IMemInputPin
+{
+    FrameSinkFilter * filter;
+    IPin * connectedPin;
+    AM_MEDIA_TYPE mediaType;
+    std::vector<PixelFormat> formats;
+    LONG alignment;
+    FormatChain chain;
+    IMemAllocator * pool;
+    mutable std::mutex typeLock;
+
+    HRESULT negotiate(const AM_MEDIA_TYPE& type);
+    void releasePool();
+public:
+    FrameSinkPin(FrameSinkFilter * owner, std::vector<PixelFormat> preferredFormats, LONG strideAlignment);
+    ~FrameSinkPin();
+
+    bool isConnected() const;
+    bool formatChain(FormatChain * current) const;
+    bool prepare(IMediaSample * sample, IMediaSample ** output, Image * image) const;
+    REFERENCE_TIME frameDuration() const;
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    HRESULT STDMETHODCALLTYPE Connect(IPin * receivePin, const AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE ReceiveConnection(IPin * connector, const AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE Disconnect() override;
+    HRESULT STDMETHODCALLTYPE ConnectedTo(IPin ** pin) override;
+    HRESULT STDMETHODCALLTYPE ConnectionMediaType(AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE QueryPinInfo(PIN_INFO * info) override;
+    HRESULT STDMETHODCALLTYPE QueryDirection(PIN_DIRECTION * direction) override;
+    HRESULT STDMETHODCALLTYPE QueryId(LPWSTR * id) override;
+    HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE EnumMediaTypes(IEnumMediaTypes ** types) override;
+    HRESULT STDMETHODCALLTYPE QueryInternalConnections(IPin ** pins, ULONG * count) override;
+    HRESULT STDMETHODCALLTYPE EndOfStream() override;
+    HRESULT STDMETHODCALLTYPE BeginFlush() override;
+    HRESULT STDMETHODCALLTYPE EndFlush() override;
+    HRESULT STDMETHODCALLTYPE NewSegment(REFERENCE_TIME start, REFERENCE_TIME stop, double rate) override;
+
+    HRESULT STDMETHODCALLTYPE GetAllocator(IMemAllocator ** allocator) override;
+    HRESULT STDMETHODCALLTYPE NotifyAllocator(IMemAllocator * allocator, BOOL readOnly) override;
+    HRESULT STDMETHODCALLTYPE GetAllocatorRequirements(ALLOCATOR_PROPERTIES * properties) override;
+    HRESULT STDMETHODCALLTYPE Receive(IMediaSample * sample) override;
+    HRESULT STDMETHODCALLTYPE ReceiveMultiple(IMediaSample ** samples, long count, long * processed) override;
+    HRESULT STDMETHODCALLTYPE ReceiveCanBlock() override;
+};
+
+// A renderer with no window of its own. Each sample is held back until it is
+// due on the graph clock and then handed to the sink on the streaming thread.
+// It has no IMediaSeeking, so the graph does not wait for it to finish.
+class wpl::FrameSinkFilter : public IBaseFilter
+{
+    std::shared_ptr<FrameSink> sink;
+    FrameSinkPin * inputPin;
+    IReferenceClock * syncSource;
+    IFilterGraph * filterGraph;
+    std::wstring filterName;
+    FILTER_STATE filterState;
+    REFERENCE_TIME startTime;
+    REFERENCE_TIME segmentStart;
+    std::mutex stateLock;
+    std::condition_variable stateChanged;
+    HANDLE clockEvent;
+    bool flushing;
+    bool prerolled;
+    bool endOfStream;
+    std::atomic<bool> visible;
+    std::atomic<AspectMode> layout;
+    std::atomic<unsigned long long> delivered;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<unsigned long long> converted;
+    LONG referenceCount;
+
+    HRESULT waitUntilDue(const REFERENCE_TIME * due);
+    void wakeStreaming();
+public:
+    FrameSinkFilter(std::shared_ptr<FrameSink> frameSink, std::vector<PixelFormat> formats, LONG alignment);
+    ~FrameSinkFilter();
+
+    FrameSinkPin * pin() const;
+    bool isStopped();
+    void setVisible(bool show);
+    void setAspectMode(AspectMode mode);
+    SinkStats stats() const;
+
+    HRESULT render(IMediaSample * sample);
+    HRESULT finishStream();
+    void setFlushing(bool flush);
+    void setSegment(REFERENCE_TIME start);
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    HRESULT STDMETHODCALLTYPE GetClassID(CLSID * classId) override;
+    HRESULT STDMETHODCALLTYPE Stop() override;
+    HRESULT STDMETHODCALLTYPE Pause() override;
+    HRESULT STDMETHODCALLTYPE Run(REFERENCE_TIME start) override;
+    HRESULT STDMETHODCALLTYPE GetState(DWORD timeout, FILTER_STATE * state) override;
+    HRESULT STDMETHODCALLTYPE SetSyncSource(IReferenceClock * clock) override;
+    HRESULT STDMETHODCALLTYPE GetSyncSource(IReferenceClock ** clock) override;
+    HRESULT STDMETHODCALLTYPE EnumPins(IEnumPins ** pins) override;
+    HRESULT STDMETHODCALLTYPE FindPin(LPCWSTR id, IPin ** pin) override;
+    HRESULT STDMETHODCALLTYPE QueryFilterInfo(FILTER_INFO * info) override;
+    HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph * graph, LPCWSTR name) override;
+    HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR * vendorInfo) override;
+};
+
+FrameView::FrameView()
+    : sample(nullptr), picture(), presentationTime(0), layout(AspectMode::Stretch)
+{
+}
+
+FrameView::FrameView(IMediaSample * source, const Image& image, REFERENCE_TIME pts, AspectMode mode)
+    : sample(source), picture(image), presentationTime(pts), layout(mode)
+{
+    if (sample != nullptr)
+    {
+        sample->AddRef();
+    }
+}
+
+FrameView::FrameView(FrameView&& other)
+    : sample(other.sample), picture(other.picture), presentationTime(other.presentationTime), layout(other.layout)
+{
+    other.sample = nullptr;
+    other.picture = {};
+}
+
+FrameView::~FrameView()
+{
+    release();
+}
+
+FrameView& FrameView::operator=(FrameView&& other)
+{
+    if (this != &other)
+    {
+        release();
+        sample = other.sample;
+        picture = other.picture;
+        presentationTime = other.presentationTime;
+        layout = other.layout;
+        other.sample = nullptr;
+        other.picture = {};
+    }
+
+    return *this;
+}
+
+// The planes point into the decoder's own sample, so the buffer only goes
+// back to its allocator once every view of it has been released. Holding
+// more views than the allocator has buffers stalls decoding.
+void FrameView::release()
+{
+    safeRelease(&sample);
+    picture = {};
+}
+
+bool FrameView::empty() const
+{
+    return picture.planes[0] == nullptr;
+}
+
+PixelFormat FrameView::format() const
+{
+    return picture.format;
+}
+
+LONG FrameView::width() const
+{
+    return picture.width;
+}
+
+LONG FrameView::height() const
+{
+    return picture.height;
+}
+
+const BYTE * FrameView::plane(int index) const
+{
+    return index >= 0 && index < 3 ? picture.planes[index] : nullptr;
+}
+
+LONG FrameView::stride(int index) const
+{
+    return index >= 0 && index < 3 ? picture.strides[index] : 0;
+}
+
+REFERENCE_TIME FrameView::pts() const
+{
+    return presentationTime;
+}
+
+AspectMode FrameView::aspectMode() const
+{
+    return layout;
+}
+
+const Image& FrameView::image() const
+{
+    return picture;
+}
+
+FrameSinkPin::FrameSinkPin(FrameSinkFilter * owner, std::vector<PixelFormat> preferredFormats, LONG strideAlignment)
+    : filter(owner),
+      connectedPin(nullptr),
+      mediaType(),
+      formats(std::move(preferredFormats)),
+      alignment(strideAlignment),
+      chain(),
+      pool(nullptr)
+{
+}
+
+FrameSinkPin::~FrameSinkPin()
+{
+    releasePool();
+    safeRelease(&connectedPin);
+    clearMediaType(&mediaType);
+}
+
+// Settles the chain for a new decoded type and, when the decoder's buffers
+// cannot be handed out as they are, commits a pool of buffers sized for the
+// converted frames. Called with the type lock held.
+HRESULT FrameSinkPin::negotiate(const AM_MEDIA_TYPE& type)
+{
+    FormatChain next {};
+    IMemAllocator * nextPool { nullptr };
+    RECT source;
+    Image layout;
+
+    if (chooseFormat(type, formats, alignment, &next) < 0)
+    {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    if (next.converted)
+    {
+        const auto header { videoHeader(type, &source) };
+        const auto bytes { layoutFrame(next.delivered, header->biWidth, std::abs(header->biHeight), alignment, nullptr, &layout) };
+        ALLOCATOR_PROPERTIES request { ConvertedBuffers, bytes, alignment, 0 };
+        ALLOCATOR_PROPERTIES actual {};
+
+        auto hr { CoCreateInstance(CLSID_MemoryAllocator, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&nextPool)) };
+        hr = SUCCEEDED(hr) ? nextPool->SetProperties(&request, &actual) : hr;
+        hr = SUCCEEDED(hr) && actual.cbBuffer < bytes ? E_OUTOFMEMORY : hr;
+        hr = SUCCEEDED(hr) ? nextPool->Commit() : hr;
+
+        if (FAILED(hr))
+        {
+            safeRelease(&nextPool);
+            return hr;
+        }
+    }
+
+    releasePool();
+    pool = nextPool;
+    chain = next;
+    return S_OK;
+}
+
+// Frames the consumer still holds keep their buffers; a decommitted pool
+// frees each one as it comes back.
+void FrameSinkPin::releasePool()
+{
+    if (pool != nullptr)
+    {
+        pool->Decommit();
+        safeRelease(&pool);
+    }
+}
+
+bool FrameSinkPin::isConnected() const
+{
+    std::lock_guard<std::mutex> guard(typeLock);
+    return connectedPin != nullptr;
+}
+
+bool FrameSinkPin::formatChain(FormatChain * current) const
+{
+    std::lock_guard<std::mutex> guard(typeLock);
+    *current = chain;
+    return connectedPin != nullptr;
+}
+
+// Returns the sample to deliver, either the decoder's own or a pooled one
+// holding the frame in the negotiated format. A converted frame no longer
+// pins the decoder's buffer, but when the consumer holds every pooled one
+// the frame is dropped rather than stalling the stream.
+bool FrameSinkPin::prepare(IMediaSample * sample, IMediaSample ** output, Image * image) const
+{
+    BYTE * buffer { nullptr };
+    Image decoded;
+    IMemAllocator * outputPool { nullptr };
+    auto format { PixelFormat::Bgra };
+
+    *output = nullptr;
+
+    if (FAILED(sample->GetPointer(&buffer)))
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(typeLock);
+
+        if (!describeFrame(mediaType, buffer, sample->GetActualDataLength(), &decoded))
+        {
+            return false;
+        }
+
+        outputPool = pool;
+        format = chain.delivered;
+
+        if (outputPool != nullptr)
+        {
+            outputPool->AddRef();
+        }
+    }
+
+    if (outputPool == nullptr)
+    {
+        *output = sample;
+        (*output)->AddRef();
+        *image = decoded;
+        return true;
+    }
+
+    BYTE * target { nullptr };
+    auto hr { outputPool->GetBuffer(output, nullptr, nullptr, AM_GBF_NOWAIT) };
+    hr = SUCCEEDED(hr) ? (*output)->GetPointer(&target) : hr;
+
+    const auto bytes { SUCCEEDED(hr) ? layoutFrame(format, decoded.width, decoded.height, alignment, target, image) : 0 };
+    hr = SUCCEEDED(hr) && bytes <= (*output)->GetSize() && convertImage(decoded, *image) ? (*output)->SetActualDataLength(bytes) : E_FAIL;
+
+    if (FAILED(hr))
+    {
+        safeRelease(output);
+    }
+
+    outputPool->Release();
+    return SUCCEEDED(hr);
+}
+
+REFERENCE_TIME FrameSinkPin::frameDuration() const
+{
+    std::lock_guard<std::mutex> guard(typeLock);
+
+    if (mediaType.formattype == FORMAT_VideoInfo && mediaType.cbFormat >= sizeof(VIDEOINFOHEADER))
+    {
+        return reinterpret_cast<const VIDEOINFOHEADER*>(mediaType.pbFormat)->AvgTimePerFrame;
+    }
+
+    if (mediaType.formattype == FORMAT_VideoInfo2 && mediaType.cbFormat >= sizeof(VIDEOINFOHEADER2))
+    {
+        return reinterpret_cast<const VIDEOINFOHEADER2*>(mediaType.pbFormat)->AvgTimePerFrame;
+    }
+
+    return 0;
+}
+
+HRESULT FrameSinkPin::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown || riid == IID_IPin)
+    {
+        *object = static_cast<IPin*>(this);
+    }
+    else if (riid == IID_IMemInputPin)
+    {
+        *object = static_cast<IMemInputPin*>(this);
+    }
+    else
+    {
+        *object = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG FrameSinkPin::AddRef()
+{
+    return filter->AddRef();
+}
+
+ULONG FrameSinkPin::Release()
+{
+    return filter->Release();
+}
+
+HRESULT FrameSinkPin::Connect(IPin *, const AM_MEDIA_TYPE *)
+{
+    return E_UNEXPECTED;
+}
+
+HRESULT FrameSinkPin::ReceiveConnection(IPin * connector, const AM_MEDIA_TYPE * type)
+{
+    if (connector == nullptr || type == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (!filter->isStopped())
+    {
+        return VFW_E_NOT_STOPPED;
+    }
+
+    if (!supportedType(*type))
+    {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    std::lock_guard<std::mutex> guard(typeLock);
+
+    if (connectedPin != nullptr)
+    {
+        return VFW_E_ALREADY_CONNECTED;
+    }
+
+    const auto hr { negotiate(*type) };
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (!copyMediaType(*type, &mediaType))
+    {
+        releasePool();
+        return E_OUTOFMEMORY;
+    }
+
+    connectedPin = connector;
+    connectedPin->AddRef();
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::Disconnect()
+{
+    std::lock_guard<std::mutex> guard(typeLock);
+
+    if (connectedPin == nullptr)
+    {
+        return S_FALSE;
+    }
+
+    releasePool();
+    safeRelease(&connectedPin);
+    clearMediaType(&mediaType);
+    chain = {};
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::ConnectedTo(IPin ** pin)
+{
+    if (pin == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> guard(typeLock);
+    *pin = connectedPin;
+
+    if (connectedPin == nullptr)
+    {
+        return VFW_E_NOT_CONNECTED;
+    }
+
+    connectedPin->AddRef();
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::ConnectionMediaType(AM_MEDIA_TYPE * type)
+{
+    if (type == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> guard(typeLock);
+
+    if (connectedPin == nullptr)
+    {
+        *type = {};
+        return VFW_E_NOT_CONNECTED;
+    }
+
+    return copyMediaType(mediaType, type) ? S_OK : E_OUTOFMEMORY;
+}
+
+HRESULT FrameSinkPin::QueryPinInfo(PIN_INFO * info)
+{
+    if (info == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    info->pFilter = filter;
+    info->pFilter->AddRef();
+    info->dir = PINDIR_INPUT;
+    wcsncpy_s(info->achName, InputPinName, _TRUNCATE);
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::QueryDirection(PIN_DIRECTION * direction)
+{
+    if (direction == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *direction = PINDIR_INPUT;
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::QueryId(LPWSTR * id)
+{
+    if (id == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    const auto bytes { (wcslen(InputPinName) + 1) * sizeof(WCHAR) };
+    *id = static_cast<LPWSTR>(CoTaskMemAlloc(bytes));
+
+    if (*id == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    std::memcpy(*id, InputPinName, bytes);
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::QueryAccept(const AM_MEDIA_TYPE * type)
+{
+    FormatChain candidate;
+    return type != nullptr && chooseFormat(*type, formats, alignment, &candidate) >= 0 ? S_OK : S_FALSE;
+}
+
+// Only the major type and preferred subtypes are offered, in the consumer's
+// order. The upstream filter fills in the format block, which it alone knows.
+HRESULT FrameSinkPin::EnumMediaTypes(IEnumMediaTypes ** types)
+{
+    if (types == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::vector<AM_MEDIA_TYPE> preferred;
+
+    for (const auto format : formats.empty() ? std::vector<PixelFormat> { PixelFormat::I420 } : formats)
+    {
+        AM_MEDIA_TYPE partial {};
+        partial.majortype = MEDIATYPE_Video;
+        partial.subtype = formatSubtype(format);
+        partial.formattype = GUID_NULL;
+        preferred.push_back(partial);
+    }
+
+    *types = new MediaTypeEnumerator(std::move(preferred), 0);
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::QueryInternalConnections(IPin **, ULONG *)
+{
+    return E_NOTIMPL;
+}
+
+HRESULT FrameSinkPin::EndOfStream()
+{
+    return filter->finishStream();
+}
+
+HRESULT FrameSinkPin::BeginFlush()
+{
+    filter->setFlushing(true);
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::EndFlush()
+{
+    filter->setFlushing(false);
+    return S_OK;
+}
+
+HRESULT FrameSinkPin::NewSegment(REFERENCE_TIME start, REFERENCE_TIME, double)
+{
+    filter->setSegment(start);
+    return S_OK;
+}
+
+// Upstream keeps its own allocator, which for a tee output is the one
+// feeding every other renderer, so the samples reaching us are shared.
+HRESULT FrameSinkPin::GetAllocator(IMemAllocator ** allocator)
+{
+    if (allocator == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *allocator = nullptr;
+    return VFW_E_NO_ALLOCATOR;
+}
+
+HRESULT FrameSinkPin::NotifyAllocator(IMemAllocator * allocator, BOOL)
+{
+    return allocator != nullptr ? S_OK : E_POINTER;
+}
+
+HRESULT FrameSinkPin::GetAllocatorRequirements(ALLOCATOR_PROPERTIES *)
+{
+    return E_NOTIMPL;
+}
+
+HRESULT FrameSinkPin::Receive(IMediaSample * sample)
+{
+    AM_MEDIA_TYPE * changed { nullptr };
+
+    if (sample == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    // Decoders announce a new stride or size on the first sample that uses
+    // it, which may need a different chain or a bigger pool.
+    if (sample->GetMediaType(&changed) == S_OK && changed != nullptr)
+    {
+        std::lock_guard<std::mutex> guard(typeLock);
+
+        if (supportedType(*changed) && SUCCEEDED(negotiate(*changed)))
+        {
+            clearMediaType(&mediaType);
+            copyMediaType(*changed, &mediaType);
+        }
+
+        clearMediaType(changed);
+        CoTaskMemFree(changed);
+    }
+
+    return filter->render(sample);
+}
+
+HRESULT FrameSinkPin::ReceiveMultiple(IMediaSample ** samples, long count, long * processed)
+{
+    auto hr { S_OK };
+    long done { 0 };
+
+    if (samples == nullptr || processed == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    while (done < count && hr == S_OK)
+    {
+        hr = Receive(samples[done++]);
+    }
+
+    *processed = done;
+    return hr;
+}
+
+HRESULT FrameSinkPin::ReceiveCanBlock()
+{
+    return S_OK;
+}
+
+FrameSinkFilter::FrameSinkFilter(std::shared_ptr<FrameSink> frameSink, std::vector<PixelFormat> formats, LONG alignment)
+    : sink(std::move(frameSink)),
+      inputPin(nullptr),
+      syncSource(nullptr),
+      filterGraph(nullptr),
+      filterName(SinkFilterName),
+      filterState(State_Stopped),
+      startTime(0),
+      segmentStart(0),
+      clockEvent(CreateEvent(nullptr, FALSE, FALSE, nullptr)),
+      flushing(false),
+      prerolled(false),
+      endOfStream(false),
+      visible(true),
+      layout(AspectMode::Stretch),
+      delivered(0),
+      dropped(0),
+      converted(0),
+      referenceCount(1)
+{
+    inputPin = new FrameSinkPin(this, std::move(formats), alignment);
+}
+
+FrameSinkFilter::~FrameSinkFilter()
+{
+    delete inputPin;
+    safeRelease(&syncSource);
+
+    if (clockEvent != nullptr)
+    {
+        CloseHandle(clockEvent);
+    }
+}
+
+FrameSinkPin * FrameSinkFilter::pin() const
+{
+    return inputPin;
+}
+
+bool FrameSinkFilter::isStopped()
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+    return filterState == State_Stopped;
+}
+
+void FrameSinkFilter::setVisible(bool show)
+{
+    visible = show;
+}
+
+void FrameSinkFilter::setAspectMode(AspectMode mode)
+{
+    layout = mode;
+}
+
+SinkStats FrameSinkFilter::stats() const
+{
+    SinkStats current {};
+
+    current.negotiated = inputPin->formatChain(&current.chain);
+    current.delivered = delivered;
+    current.dropped = dropped;
+    current.converted = converted;
+    return current;
+}
+
+// Any state change or flush has to reach a thread parked on the clock as
+// well as one parked on the condition variable.
+void FrameSinkFilter::wakeStreaming()
+{
+    stateChanged.notify_all();
+    SetEvent(clockEvent);
+}
+
+// Returns S_OK once the sample should be shown. The first sample after a
+// pause or a flush is shown straight away so a paused graph has a picture;
+// later ones wait for Run and then for their time on the graph clock.
+HRESULT FrameSinkFilter::waitUntilDue(const REFERENCE_TIME * due)
+{
+    std::unique_lock<std::mutex> lock(stateLock);
+
+    for (;;)
+    {
+        if (filterState == State_Stopped)
+        {
+            return VFW_E_WRONG_STATE;
+        }
+
+        if (flushing)
+        {
+            return S_FALSE;
+        }
+
+        if (filterState == State_Paused)
+        {
+            if (!prerolled)
+            {
+                prerolled = true;
+                stateChanged.notify_all();
+                return S_OK;
+            }
+
+            stateChanged.wait(lock);
+            continue;
+        }
+
+        if (syncSource == nullptr || due == nullptr)
+        {
+            return S_OK;
+        }
+
+        const auto clock { syncSource };
+        const auto dueTime { startTime + *due };
+        const auto base { startTime };
+        REFERENCE_TIME now { 0 };
+        DWORD_PTR cookie { 0 };
+
+        clock->AddRef();
+        lock.unlock();
+
+        const auto waiting { SUCCEEDED(clock->GetTime(&now)) && now < dueTime &&
+            SUCCEEDED(clock->AdviseTime(base, *due, reinterpret_cast<HEVENT>(clockEvent), &cookie)) };
+
+        if (waiting)
+        {
+            WaitForSingleObject(clockEvent, INFINITE);
+            clock->Unadvise(cookie);
+        }
+
+        clock->Release();
+        lock.lock();
+
+        if (!waiting && filterState == State_Running && !flushing)
+        {
+            return S_OK;
+        }
+    }
+}
+
+HRESULT FrameSinkFilter::render(IMediaSample * sample)
+{
+    REFERENCE_TIME start { 0 };
+    REFERENCE_TIME stop { 0 };
+    IMediaSample * output { nullptr };
+    Image image;
+
+    const auto timed { SUCCEEDED(sample->GetTime(&start, &stop)) };
+    const auto hr { waitUntilDue(timed ? &start : nullptr) };
+
+    if (hr != S_OK)
+    {
+        return hr;
+    }
+
+    if (!visible || !inputPin->prepare(sample, &output, &image))
+    {
+        ++dropped;
+        return S_OK;
+    }
+
+    REFERENCE_TIME segment { 0 };
+
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        segment = segmentStart;
+    }
+
+    sink->onFrame(FrameView(output, image, timed ? segment + start : -1, layout));
+    converted += output != sample ? 1 : 0;
+    ++delivered;
+
+    output->Release();
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::finishStream()
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+
+    if (filterState == State_Stopped || flushing)
+    {
+        return VFW_E_WRONG_STATE;
+    }
+
+    endOfStream = true;
+    prerolled = true;
+    stateChanged.notify_all();
+    return S_OK;
+}
+
+void FrameSinkFilter::setFlushing(bool flush)
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+
+    flushing = flush;
+
+    if (!flush)
+    {
+        endOfStream = false;
+        prerolled = filterState != State_Paused;
+    }
+
+    wakeStreaming();
+}
+
+void FrameSinkFilter::setSegment(REFERENCE_TIME start)
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+    segmentStart = start;
+}
+
+HRESULT FrameSinkFilter::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown || riid == IID_IPersist || riid == IID_IMediaFilter || riid == IID_IBaseFilter)
+    {
+        *object = static_cast<IBaseFilter*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG FrameSinkFilter::AddRef()
+{
+    return InterlockedIncrement(&referenceCount);
+}
+
+ULONG FrameSinkFilter::Release()
+{
+    const auto count { InterlockedDecrement(&referenceCount) };
+
+    if (count == 0)
+    {
+        delete this;
+    }
+
+    return count;
+}
+
+HRESULT FrameSinkFilter::GetClassID(CLSID * classId)
+{
+    if (classId == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *classId = CLSID_FrameSink;
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::Stop()
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+
+    filterState = State_Stopped;
+    prerolled = false;
+    endOfStream = false;
+    wakeStreaming();
+    return S_OK;
+}
+
+// Pausing from Run keeps the picture already shown, so only a pause from
+// Stop has to wait for a new frame.
+HRESULT FrameSinkFilter::Pause()
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+
+    prerolled = filterState == State_Running || endOfStream;
+    filterState = State_Paused;
+    wakeStreaming();
+    return prerolled || !inputPin->isConnected() ? S_OK : S_FALSE;
+}
+
+HRESULT FrameSinkFilter::Run(REFERENCE_TIME start)
+{
+    std::lock_guard<std::mutex> guard(stateLock);
+
+    startTime = start;
+    filterState = State_Running;
+    wakeStreaming();
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::GetState(DWORD timeout, FILTER_STATE * state)
+{
+    if (state == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::unique_lock<std::mutex> lock(stateLock);
+    const auto settled = [&]() { return filterState != State_Paused || prerolled || !inputPin->isConnected(); };
+
+    stateChanged.wait_for(lock, std::chrono::milliseconds(timeout), settled);
+    *state = filterState;
+    return settled() ? S_OK : VFW_S_STATE_INTERMEDIATE;
+}
+
+HRESULT FrameSinkFilter::SetSyncSource(IReferenceClock * clock)
+{
+    if (clock != nullptr)
+    {
+        clock->AddRef();
+    }
+
+    std::lock_guard<std::mutex> guard(stateLock);
+    safeRelease(&syncSource);
+    syncSource = clock;
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::GetSyncSource(IReferenceClock ** clock)
+{
+    if (clock == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> guard(stateLock);
+    *clock = syncSource;
+
+    if (syncSource != nullptr)
+    {
+        syncSource->AddRef();
+    }
+
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::EnumPins(IEnumPins ** pins)
+{
+    if (pins == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *pins = new PinEnumerator(inputPin, 0);
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::FindPin(LPCWSTR id, IPin ** pin)
+{
+    if (id == nullptr || pin == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *pin = wcscmp(id, InputPinName) == 0 ? inputPin : nullptr;
+
+    if (*pin == nullptr)
+    {
+        return VFW_E_NOT_FOUND;
+    }
+
+    (*pin)->AddRef();
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::QueryFilterInfo(FILTER_INFO * info)
+{
+    if (info == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    wcsncpy_s(info->achName, filterName.c_str(), _TRUNCATE);
+    info->pGraph = filterGraph;
+
+    if (filterGraph != nullptr)
+    {
+        filterGraph->AddRef();
+    }
+
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::JoinFilterGraph(IFilterGraph * graph, LPCWSTR name)
+{
+    filterGraph = graph;
+    filterName = name != nullptr ? name : SinkFilterName;
+    return S_OK;
+}
+
+HRESULT FrameSinkFilter::QueryVendorInfo(LPWSTR *)
+{
+    return E_NOTIMPL;
+}
+
+// Allocators only align to powers of two, so anything else falls back to
+// no alignment at all.
+SinkRenderer::SinkRenderer(std::shared_ptr<FrameSink> frameSink, std::vector<PixelFormat> preferredFormats, LONG strideAlignment)
+    : sink(std::move(frameSink)),
+      formats(std::move(preferredFormats)),
+      alignment(strideAlignment > 0 && (strideAlignment & (strideAlignment - 1)) == 0 ? strideAlignment : 1),
+      sinkFilter(nullptr),
+      layout(AspectMode::Stretch),
+      visible(true)
+{
+}
+
+SinkRenderer::~SinkRenderer()
+{
+    safeRelease(&sinkFilter);
+}
+
+// A fresh filter per graph, as with EVR, since the old graph may still hold
+// the previous one while a queued video takes over.
+bool SinkRenderer::addToGraph(IGraphBuilder * graph, HWND)
+{
+    safeRelease(&sinkFilter);
+
+    if (sink == nullptr)
+    {
+        return false;
+    }
+
+    sinkFilter = new FrameSinkFilter(sink, formats, alignment);
+    sinkFilter->setVisible(visible);
+    sinkFilter->setAspectMode(layout);
+
+    if (FAILED(graph->AddFilter(sinkFilter, SinkFilterName)))
+    {
+        safeRelease(&sinkFilter);
+        return false;
+    }
+
+    return true;
+}
+
+bool SinkRenderer::finaliseGraph(IGraphBuilder *)
+{
+    return sinkFilter != nullptr;
+}
+
+bool SinkRenderer::updateVideoWindow(HWND, const LPRECT)
+{
+    return true;
+}
+
+bool SinkRenderer::hasVideo() const
+{
+    return sinkFilter != nullptr && sinkFilter->pin()->isConnected();
+}
+
+bool SinkRenderer::repaint()
+{
+    return true;
+}
+
+REFERENCE_TIME SinkRenderer::frameDuration() const
+{
+    return sinkFilter != nullptr ? sinkFilter->pin()->frameDuration() : 0;
+}
+
+bool SinkRenderer::captureFrame(VideoFrame *)
+{
+    return false;
+}
+
+bool SinkRenderer::presentFrame(const VideoFrame *)
+{
+    return false;
+}
+
+// Sinks have no window to lay frames out in, so the mode travels with
+// every frame for the consumer to apply, for example with layoutVideo.
+bool SinkRenderer::setAspectMode(AspectMode mode)
+{
+    layout = mode;
+
+    if (sinkFilter != nullptr)
+    {
+        sinkFilter->setAspectMode(mode);
+    }
+
+    return true;
+}
+
+bool SinkRenderer::setVisible(bool show)
+{
+    visible = show;
+
+    if (sinkFilter != nullptr)
+    {
+        sinkFilter->setVisible(show);
+    }
+
+    return true;
+}
+
+int SinkRenderer::conversionCost(const AM_MEDIA_TYPE& type) const
+{
+    FormatChain chain;
+    return chooseFormat(type, formats, alignment, &chain);
+}
+
+IBaseFilter * SinkRenderer::filter() const
+{
+    return sinkFilter;
+}
+
+// The copy feeds the same sink, so frames keep arriving there across a
+// handoff, though stats() only counts those that passed through this one.
+std::shared_ptr<VideoRenderer> SinkRenderer::clone() const
+{
+    const auto copy { std::make_shared<SinkRenderer>(sink, formats, alignment) };
+    copy->layout = layout;
+    copy->visible = visible;
+    return copy;
+}
+
+SinkStats SinkRenderer::stats() const
+{
+    return sinkFilter != nullptr ? sinkFilter->stats() : SinkStats {};
+}
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <immintrin.h>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto BarColour {0xFF000000U};
+
+LONG rectWidth(const RECT& rect)
+{
+    return rect.right - rect.left;
+}
+
+LONG rectHeight(const RECT& rect)
+{
+    return rect.bottom - rect.top;
+}
+
+bool sameRect(const RECT& first, const RECT& second)
+{
+    return first.left == second.left && first.top == second.top && first.right == second.right && first.bottom == second.bottom;
+}
+
+LONG scaledLength(LONG length, LONG numerator, LONG denominator)
+{
+    return std::max<LONG>(static_cast<LONG>((static_cast<long long>(length) * numerator + denominator / 2) / denominator), 1);
+}
+
+// Bars are written once per layout change and not read again by us, so
+// streaming stores keep them from pushing the frame out of the cache.
+void fillRect(const Image& target, const RECT& rect)
+{
+    const auto colour { _mm_set1_epi32(static_cast<int>(BarColour)) };
+
+    for (auto y = rect.top; y < rect.bottom; ++y)
+    {
+        auto * row { reinterpret_cast<DWORD*>(target.planes[0] + static_cast<ptrdiff_t>(y) * target.strides[0]) };
+        auto x { rect.left };
+
+        for (; x < rect.right && reinterpret_cast<uintptr_t>(row + x) % 16 != 0; ++x)
+        {
+            row[x] = BarColour;
+        }
+
+        for (; x + 4 <= rect.right; x += 4)
+        {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(row + x), colour);
+        }
+
+        for (; x < rect.right; ++x)
+        {
+            row[x] = BarColour;
+        }
+    }
+
+    _mm_sfence();
+}
+
+// A view of the part of the frame that is shown. I420 chroma is sampled
+// every other pixel, so cropped edges are moved onto even pixels.
+Image sourceView(const Image& frame, RECT * source)
+{
+    auto view { frame };
+
+    if (frame.format == PixelFormat::Bgra)
+    {
+        view.planes[0] += static_cast<ptrdiff_t>(source->top) * frame.strides[0] + source->left * 4;
+    }
+    else
+    {
+        source->left &= ~1L;
+        source->top &= ~1L;
+        view.planes[0] += static_cast<ptrdiff_t>(source->top) * frame.strides[0] + source->left;
+
+        for (auto plane = 1; plane < 3; ++plane)
+        {
+            view.planes[plane] += static_cast<ptrdiff_t>(source->top / 2) * frame.strides[plane] + source->left / 2;
+        }
+    }
+
+    view.width = rectWidth(*source);
+    view.height = rectHeight(*source);
+    return view;
+}
+
+VideoLayout wpl::layoutVideo(AspectMode mode, const RECT& bounds, LONG width, LONG height)
+{
+    VideoLayout layout { bounds, { 0, 0, width, height } };
+
+    const auto boundsWidth { rectWidth(bounds) };
+    const auto boundsHeight { rectHeight(bounds) };
+
+    if (mode == AspectMode::Stretch || width <= 0 || height <= 0 || boundsWidth <= 0 || boundsHeight <= 0)
+    {
+        return layout;
+    }
+
+    const auto boundsWider { static_cast<long long>(boundsWidth) * height > static_cast<long long>(boundsHeight) * width };
+
+    if (mode == AspectMode::Letterbox)
+    {
+        const auto pictureWidth { boundsWider ? scaledLength(boundsHeight, width, height) : boundsWidth };
+        const auto pictureHeight { boundsWider ? boundsHeight : scaledLength(boundsWidth, height, width) };
+
+        layout.picture.left = bounds.left + (boundsWidth - pictureWidth) / 2;
+        layout.picture.top = bounds.top + (boundsHeight - pictureHeight) / 2;
+        layout.picture.right = layout.picture.left + pictureWidth;
+        layout.picture.bottom = layout.picture.top + pictureHeight;
+        return layout;
+    }
+
+    const auto sourceWidth { boundsWider ? width : scaledLength(height, boundsWidth, boundsHeight) };
+    const auto sourceHeight { boundsWider ? scaledLength(width, boundsHeight, boundsWidth) : height };
+
+    layout.source.left = (width - sourceWidth) / 2;
+    layout.source.top = (height - sourceHeight) / 2;
+    layout.source.right = layout.source.left + sourceWidth;
+    layout.source.bottom = layout.source.top + sourceHeight;
+    return layout;
+}
+
+FrameCanvas::FrameCanvas()
+    : aspectMode(AspectMode::Letterbox), destination(), filledBounds(), filledPicture(), filledTarget(nullptr), fills(0)
+{
+}
+
+void FrameCanvas::setAspectMode(AspectMode mode)
+{
+    aspectMode = mode;
+}
+
+void FrameCanvas::setDestination(const RECT * rect)
+{
+    destination = rect ? *rect : RECT {};
+}
+
+void FrameCanvas::invalidate()
+{
+    filledTarget = nullptr;
+}
+
+bool FrameCanvas::draw(const Image& frame, const Image& target, ScaleFilter filter)
+{
+    if (target.format != PixelFormat::Bgra || frame.format == PixelFormat::Nv12 || frame.width <= 0 || frame.height <= 0)
+    {
+        return false;
+    }
+
+    const RECT whole { 0, 0, target.width, target.height };
+    auto bounds { rectWidth(destination) > 0 && rectHeight(destination) > 0 ? destination : whole };
+
+    bounds.left = std::max(bounds.left, whole.left);
+    bounds.top = std::max(bounds.top, whole.top);
+    bounds.right = std::min(bounds.right, whole.right);
+    bounds.bottom = std::min(bounds.bottom, whole.bottom);
+
+    if (rectWidth(bounds) <= 0 || rectHeight(bounds) <= 0)
+    {
+        return false;
+    }
+
+    auto layout { layoutVideo(aspectMode, bounds, frame.width, frame.height) };
+    const auto& picture { layout.picture };
+
+    // The bars around the picture only change with the layout, so they are
+    // left alone for as long as the same target is drawn the same way.
+    if (filledTarget != target.planes[0] || !sameRect(filledBounds, bounds) || !sameRect(filledPicture, picture))
+    {
+        fillRect(target, { bounds.left, bounds.top, bounds.right, picture.top });
+        fillRect(target, { bounds.left, picture.bottom, bounds.right, bounds.bottom });
+        fillRect(target, { bounds.left, picture.top, picture.left, picture.bottom });
+        fillRect(target, { picture.right, picture.top, bounds.right, picture.bottom });
+
+        filledTarget = target.planes[0];
+        filledBounds = bounds;
+        filledPicture = picture;
+        ++fills;
+    }
+
+    auto view { target };
+    view.planes[0] += static_cast<ptrdiff_t>(picture.top) * target.strides[0] + picture.left * 4;
+    view.width = rectWidth(picture);
+    view.height = rectHeight(picture);
+
+    return scaleImage(sourceView(frame, &layout.source), view, filter);
+}
+
+unsigned long long FrameCanvas::barFills() const
+{
+    return fills;
+}
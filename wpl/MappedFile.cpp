@@ -0,0 +1,96 @@
+#include <algorithm>
+#include "WPL.h"
+
+using namespace wpl;
+
+MappedFile::MappedFile()
+    : file(INVALID_HANDLE_VALUE), mapping(nullptr), view(nullptr), length(0), fileLength(0)
+{
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+    : MappedFile()
+{
+    *this = std::move(other);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+    std::swap(file, other.file);
+    std::swap(mapping, other.mapping);
+    std::swap(view, other.view);
+    std::swap(length, other.length);
+    std::swap(fileLength, other.fileLength);
+    return *this;
+}
+
+bool MappedFile::open(const std::string& filename, size_t window)
+{
+    close();
+
+    LARGE_INTEGER size;
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    fileLength = static_cast<unsigned long long>(size.QuadPart);
+    length = static_cast<size_t>(window == 0 ? fileLength : std::min<unsigned long long>(fileLength, window));
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    view = mapping ? static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, length)) : nullptr;
+
+    if (view == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (view != nullptr)
+    {
+        UnmapViewOfFile(view);
+        view = nullptr;
+    }
+
+    if (mapping != nullptr)
+    {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    }
+
+    length = 0;
+    fileLength = 0;
+}
+
+const BYTE * MappedFile::data() const
+{
+    return view;
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
+
+unsigned long long MappedFile::fileSize() const
+{
+    return fileLength;
+}
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <limits>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto Unlimited {std::numeric_limits<size_t>::max()};
+
+MemoryGovernor::MemoryGovernor()
+    : limit(0), total(), refusals(0), trims(0)
+{
+}
+
+// Caches hear about a lower limit the next time their owner touches them.
+void MemoryGovernor::setLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    limit = bytes;
+    ++trims;
+}
+
+size_t MemoryGovernor::limitBytes() const
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    return limit;
+}
+
+MemoryUsage MemoryGovernor::usage() const
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    return total;
+}
+
+unsigned long long MemoryGovernor::refusedOpens() const
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    return refusals;
+}
+
+// An open is only refused once prefetch buffers alone fill the limit.
+// Caches in the way are asked to trim, and queues shorten to fit.
+bool MemoryGovernor::admitOpen()
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+
+    if (limit == 0 || total.bufferBytes + total.cacheBytes < limit)
+    {
+        return true;
+    }
+
+    if (total.bufferBytes < limit)
+    {
+        ++trims;
+        return true;
+    }
+
+    ++refusals;
+    return false;
+}
+
+// Caches are the first thing to give way, so they only get what the
+// buffers leave over. A cache holding heldBytes may grow, or must shrink,
+// to the result.
+size_t MemoryGovernor::cacheAllowance(size_t heldBytes) const
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+
+    if (limit == 0)
+    {
+        return Unlimited;
+    }
+
+    const auto committed { total.bufferBytes + total.cacheBytes };
+
+    if (committed <= limit)
+    {
+        return heldBytes + (limit - committed);
+    }
+
+    const auto over { committed - limit };
+    return heldBytes > over ? heldBytes - over : 0;
+}
+
+void MemoryGovernor::adjustCache(size_t previousBytes, size_t currentBytes)
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    total.cacheBytes = total.cacheBytes - previousBytes + currentBytes;
+}
+
+// Buffers take priority over caches. A grant that pushes the total past
+// the limit asks the caches to trim, which they do on their owner's thread.
+// When even that is not enough the buffer is granted less than it asked
+// for, and it is refused outright below its minimum useful size.
+size_t MemoryGovernor::reserveBuffer(size_t wantedBytes, size_t minimumBytes)
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+
+    const auto headroom { limit == 0 ? Unlimited : limit > total.bufferBytes ? limit - total.bufferBytes : 0 };
+    const auto granted { std::min(wantedBytes, headroom) };
+
+    if (granted == 0 || granted < minimumBytes)
+    {
+        ++refusals;
+        return 0;
+    }
+
+    total.bufferBytes += granted;
+
+    if (limit != 0 && total.bufferBytes + total.cacheBytes > limit)
+    {
+        ++trims;
+    }
+
+    return granted;
+}
+
+void MemoryGovernor::releaseBuffer(size_t bytes)
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    total.bufferBytes -= bytes;
+}
+
+// Changes whenever caches should check their allowance again.
+unsigned long long MemoryGovernor::trimRequests() const
+{
+    std::lock_guard<std::mutex> guard(usageLock);
+    return trims;
+}
+
+MemoryGovernor& MemoryGovernor::shared()
+{
+    // Never destroyed so caches and readers in other static objects can
+    // still report back to it during shutdown.
+    static const auto governor { new MemoryGovernor() };
+    return *governor;
+}
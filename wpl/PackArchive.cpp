@@ -0,0 +1,356 @@
+#include <algorithm>
+#include <cstring>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto PackMagic {0x4B415057UL};
+const auto PackVersion {1UL};
+const auto PackAlignment {4096ULL};
+const auto PackScheme {"pack://"};
+const auto PackSchemeLength {size_t(7)};
+const auto PackCopyBlock {size_t(1024) * 1024};
+
+struct PackHeader
+{
+    DWORD magic;
+    DWORD version;
+    DWORD alignment;
+    DWORD count;
+    unsigned long long namesOffset;
+    unsigned long long namesSize;
+};
+
+struct PackIndexEntry
+{
+    unsigned long long nameHash;
+    unsigned long long offset;
+    unsigned long long length;
+    DWORD nameOffset;
+    DWORD nameLength;
+};
+
+struct PackInput
+{
+    std::string name;
+    unsigned long long nameHash;
+    MappedFile file;
+};
+
+std::mutex packLock;
+std::vector<std::shared_ptr<const PackArchive>> mountedPacks;
+
+unsigned long long hashName(const char * name, size_t length)
+{
+    auto hash { 14695981039346656037ULL };
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash = (hash ^ static_cast<BYTE>(name[i])) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+std::string packedName(const std::string& filename)
+{
+    const auto separator { filename.find_last_of("\\/") };
+    return separator == std::string::npos ? filename : filename.substr(separator + 1);
+}
+
+unsigned long long alignUp(unsigned long long offset)
+{
+    return (offset + PackAlignment - 1) / PackAlignment * PackAlignment;
+}
+
+bool writeAll(HANDLE file, const void * data, unsigned long long size)
+{
+    auto bytes { static_cast<const BYTE*>(data) };
+
+    while (size > 0)
+    {
+        const auto chunk { static_cast<DWORD>(std::min<unsigned long long>(size, PackCopyBlock)) };
+        DWORD written { 0 };
+
+        if (!WriteFile(file, bytes, chunk, &written, nullptr) || written != chunk)
+        {
+            return false;
+        }
+
+        bytes += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+bool writePadding(HANDLE file, unsigned long long * offset)
+{
+    const std::vector<BYTE> zeros(static_cast<size_t>(alignUp(*offset) - *offset));
+
+    if (!writeAll(file, zeros.data(), zeros.size()))
+    {
+        return false;
+    }
+
+    *offset += zeros.size();
+    return true;
+}
+
+PackArchive::PackArchive()
+    : index(nullptr), nameTable(nullptr), count(0), namesSize(0)
+{
+}
+
+bool PackArchive::open(const std::string& filename)
+{
+    PackHeader header;
+
+    close();
+
+    if (!mappedFile.open(filename) || mappedFile.size() < sizeof(header))
+    {
+        close();
+        return false;
+    }
+
+    std::memcpy(&header, mappedFile.data(), sizeof(header));
+
+    const auto fileSize { static_cast<unsigned long long>(mappedFile.size()) };
+    const auto indexEnd { sizeof(header) + static_cast<unsigned long long>(header.count) * sizeof(PackIndexEntry) };
+
+    if (header.magic != PackMagic || header.version != PackVersion || indexEnd > fileSize ||
+        header.namesOffset < indexEnd || header.namesOffset > fileSize || header.namesSize > fileSize - header.namesOffset)
+    {
+        close();
+        return false;
+    }
+
+    index = mappedFile.data() + sizeof(header);
+    nameTable = reinterpret_cast<const char*>(mappedFile.data() + header.namesOffset);
+    count = header.count;
+    namesSize = header.namesSize;
+
+    const auto entries { reinterpret_cast<const PackIndexEntry*>(index) };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto& entry { entries[i] };
+
+        if (entry.offset > fileSize || entry.length > fileSize - entry.offset ||
+            entry.nameOffset > namesSize || entry.nameLength > namesSize - entry.nameOffset ||
+            (i > 0 && entries[i - 1].nameHash > entry.nameHash))
+        {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void PackArchive::close()
+{
+    mappedFile.close();
+    index = nullptr;
+    nameTable = nullptr;
+    count = 0;
+    namesSize = 0;
+}
+
+bool PackArchive::find(const std::string& name, PackEntry * entry) const
+{
+    const auto entries { reinterpret_cast<const PackIndexEntry*>(index) };
+    const auto hash { hashName(name.data(), name.size()) };
+
+    const auto byHash = [](const PackIndexEntry& indexEntry, unsigned long long value) { return indexEntry.nameHash < value; };
+
+    for (auto found = std::lower_bound(entries, entries + count, hash, byHash); found != entries + count && found->nameHash == hash; ++found)
+    {
+        if (found->nameLength == name.size() && std::memcmp(nameTable + found->nameOffset, name.data(), name.size()) == 0)
+        {
+            entry->data = mappedFile.data() + found->offset;
+            entry->size = found->length;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<std::string> PackArchive::names() const
+{
+    const auto entries { reinterpret_cast<const PackIndexEntry*>(index) };
+    std::vector<std::string> packedNames;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        packedNames.emplace_back(nameTable + entries[i].nameOffset, entries[i].nameLength);
+    }
+
+    return packedNames;
+}
+
+size_t PackArchive::size() const
+{
+    return count;
+}
+
+bool PackArchive::build(const std::string& filename, const std::vector<std::string>& files)
+{
+    std::vector<PackInput> inputs(files.size());
+    std::vector<PackIndexEntry> entries(files.size());
+    std::string nameBlob;
+
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        inputs[i].name = packedName(files[i]);
+        inputs[i].nameHash = hashName(inputs[i].name.data(), inputs[i].name.size());
+
+        if (!inputs[i].file.open(files[i]))
+        {
+            return false;
+        }
+    }
+
+    std::sort(inputs.begin(), inputs.end(), [](const PackInput& first, const PackInput& second) {
+        return first.nameHash != second.nameHash ? first.nameHash < second.nameHash : first.name < second.name;
+    });
+
+    const auto duplicate { std::adjacent_find(inputs.begin(), inputs.end(), [](const PackInput& first, const PackInput& second) {
+        return first.name == second.name;
+    }) };
+
+    if (duplicate != inputs.end())
+    {
+        return false;
+    }
+
+    const auto namesOffset { sizeof(PackHeader) + entries.size() * sizeof(PackIndexEntry) };
+
+    for (const auto& input : inputs)
+    {
+        nameBlob += input.name;
+    }
+
+    auto offset { alignUp(namesOffset + nameBlob.size()) };
+    DWORD nameOffset { 0 };
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        entries[i] = { inputs[i].nameHash, offset, inputs[i].file.size(), nameOffset, static_cast<DWORD>(inputs[i].name.size()) };
+        nameOffset += entries[i].nameLength;
+        offset = alignUp(offset + entries[i].length);
+    }
+
+    const PackHeader header { PackMagic, PackVersion, static_cast<DWORD>(PackAlignment), static_cast<DWORD>(entries.size()), namesOffset, nameBlob.size() };
+    const auto temporaryName { filename + ".tmp" };
+    const auto file { CreateFileA(temporaryName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    auto written { static_cast<unsigned long long>(namesOffset + nameBlob.size()) };
+    auto saved { writeAll(file, &header, sizeof(header)) };
+    saved = saved && writeAll(file, entries.data(), entries.size() * sizeof(PackIndexEntry));
+    saved = saved && writeAll(file, nameBlob.data(), nameBlob.size());
+
+    for (size_t i = 0; saved && i < inputs.size(); ++i)
+    {
+        saved = writePadding(file, &written) && writeAll(file, inputs[i].file.data(), entries[i].length);
+        written += entries[i].length;
+    }
+
+    CloseHandle(file);
+
+    if (!saved || !MoveFileExA(temporaryName.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(temporaryName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+MemoryReader::MemoryReader(std::shared_ptr<const PackArchive> source, const PackEntry& span)
+    : archive(std::move(source)), entry(span), readStats()
+{
+}
+
+size_t MemoryReader::read(unsigned long long offset, size_t length, BYTE * buffer)
+{
+    if (offset >= entry.size)
+    {
+        return 0;
+    }
+
+    const auto bytes { static_cast<size_t>(std::min<unsigned long long>(length, entry.size - offset)) };
+    std::memcpy(buffer, entry.data + offset, bytes);
+
+    std::lock_guard<std::mutex> guard(statsLock);
+    readStats.bytesRead += bytes;
+    return bytes;
+}
+
+unsigned long long MemoryReader::size() const
+{
+    return entry.size;
+}
+
+unsigned long long MemoryReader::available() const
+{
+    return entry.size;
+}
+
+void MemoryReader::setFlushing(bool)
+{
+}
+
+ReadAheadStats MemoryReader::stats() const
+{
+    std::lock_guard<std::mutex> guard(statsLock);
+    return readStats;
+}
+
+bool wpl::mountPack(const std::string& filename)
+{
+    const auto archive { std::make_shared<PackArchive>() };
+
+    if (!archive->open(filename))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(packLock);
+    mountedPacks.push_back(archive);
+    return true;
+}
+
+void wpl::unmountPacks()
+{
+    std::lock_guard<std::mutex> guard(packLock);
+    mountedPacks.clear();
+}
+
+std::shared_ptr<const PackArchive> wpl::findPackEntry(const std::string& filename, PackEntry * entry)
+{
+    if (filename.compare(0, PackSchemeLength, PackScheme) != 0)
+    {
+        return nullptr;
+    }
+
+    const auto name { filename.substr(PackSchemeLength) };
+    std::lock_guard<std::mutex> guard(packLock);
+
+    for (auto archive = mountedPacks.rbegin(); archive != mountedPacks.rend(); ++archive)
+    {
+        if ((*archive)->find(name, entry))
+        {
+            return *archive;
+        }
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,482 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto ProbeWindow {size_t(16) * 1024 * 1024};
+const auto ChunkHeaderSize {size_t(8)};
+const auto ListHeaderSize {size_t(12)};
+const auto AsfObjectHeaderSize {size_t(24)};
+const auto AsfHeaderExtensionDataOffset {size_t(46)};
+const auto UnitsPerSecond {10000000.0};
+
+const GUID AsfHeaderObject { 0x75B22630, 0x668E, 0x11CF, { 0xA6, 0xD9, 0x00, 0xAA, 0x00, 0x62, 0xCE, 0x6C } };
+const GUID AsfFilePropertiesObject { 0x8CABDCA1, 0xA947, 0x11CF, { 0x8E, 0xE4, 0x00, 0xC0, 0x0C, 0x20, 0x53, 0x65 } };
+const GUID AsfStreamPropertiesObject { 0xB7DC0791, 0xA9B7, 0x11CF, { 0x8E, 0xE6, 0x00, 0xC0, 0x0C, 0x20, 0x53, 0x65 } };
+const GUID AsfHeaderExtensionObject { 0x5FBF03B5, 0xA92E, 0x11CF, { 0x8E, 0xE3, 0x00, 0xC0, 0x0C, 0x20, 0x53, 0x65 } };
+const GUID AsfExtendedStreamPropertiesObject { 0x14E6A5CB, 0xC672, 0x4332, { 0x83, 0x99, 0xA9, 0x69, 0x52, 0x06, 0x5B, 0x5A } };
+const GUID AsfAudioMedia { 0xF8699E40, 0x5B4D, 0x11CF, { 0xA8, 0xFD, 0x00, 0x80, 0x5F, 0x5C, 0x44, 0x2B } };
+const GUID AsfVideoMedia { 0xBC19EFC0, 0x5B4D, 0x11CF, { 0xA8, 0xFD, 0x00, 0x80, 0x5F, 0x5C, 0x44, 0x2B } };
+
+struct ByteRange
+{
+    const BYTE * data;
+    size_t size;
+};
+
+struct AsfStream
+{
+    WORD number;
+    StreamInfo info;
+};
+
+template<typename T>
+bool readValue(const ByteRange& range, size_t offset, T * value)
+{
+    if (offset > range.size || range.size - offset < sizeof(T))
+    {
+        return false;
+    }
+
+    std::memcpy(value, range.data + offset, sizeof(T));
+    return true;
+}
+
+bool hasTag(const ByteRange& range, size_t offset, const char * tag)
+{
+    return offset <= range.size && range.size - offset >= 4 && std::memcmp(range.data + offset, tag, 4) == 0;
+}
+
+bool hasGuid(const ByteRange& range, size_t offset, const GUID& guid)
+{
+    return offset <= range.size && range.size - offset >= sizeof(GUID) && std::memcmp(range.data + offset, &guid, sizeof(GUID)) == 0;
+}
+
+ByteRange subRange(const ByteRange& range, size_t offset, unsigned long long size)
+{
+    const auto start { std::min(offset, range.size) };
+    const auto available { range.size - start };
+    return { range.data + start, static_cast<size_t>(std::min<unsigned long long>(size, available)) };
+}
+
+REFERENCE_TIME unitsToTime(unsigned long long units, DWORD scale, DWORD rate)
+{
+    return rate == 0 ? 0 : static_cast<REFERENCE_TIME>(units * static_cast<double>(scale) * UnitsPerSecond / rate);
+}
+
+std::string fourccToString(DWORD fourcc)
+{
+    if (fourcc == BI_RGB || fourcc == BI_BITFIELDS)
+    {
+        return "RGB";
+    }
+
+    std::string codec;
+
+    for (auto shift = 0; shift < 32; shift += 8)
+    {
+        const auto character { static_cast<char>(fourcc >> shift & 0xFF) };
+
+        if (character > ' ' && character < 0x7F)
+        {
+            codec.push_back(character);
+        }
+    }
+
+    return codec;
+}
+
+std::string formatTagToString(WORD formatTag)
+{
+    switch (formatTag)
+    {
+    case 0x0001: return "PCM";
+    case 0x0003: return "IEEE Float";
+    case 0x000A: return "WMA Voice";
+    case 0x0050: return "MPEG";
+    case 0x0055: return "MP3";
+    case 0x00FF: return "AAC";
+    case 0x0161: return "WMA";
+    case 0x0162: return "WMA Pro";
+    case 0x0163: return "WMA Lossless";
+    case 0x1610: return "AAC";
+    case 0x2000: return "AC3";
+    }
+
+    char codec[8];
+    std::snprintf(codec, sizeof(codec), "0x%04X", formatTag);
+    return codec;
+}
+
+void readVideoFormat(const ByteRange& format, StreamInfo * stream)
+{
+    BITMAPINFOHEADER header;
+
+    if (readValue(format, 0, &header))
+    {
+        stream->codec = fourccToString(header.biCompression);
+        stream->width = header.biWidth;
+        stream->height = std::abs(header.biHeight);
+    }
+}
+
+void readAudioFormat(const ByteRange& format, StreamInfo * stream)
+{
+    WAVEFORMAT header;
+
+    if (readValue(format, 0, &header))
+    {
+        stream->codec = formatTagToString(header.wFormatTag);
+        stream->sampleRate = header.nSamplesPerSec;
+        stream->channels = header.nChannels;
+    }
+}
+
+void probeAviStream(const ByteRange& streamList, MediaInfo * info)
+{
+    StreamInfo stream {};
+    stream.type = StreamType::Other;
+
+    for (size_t offset = 0; offset + ChunkHeaderSize <= streamList.size;)
+    {
+        DWORD chunkSize { 0 };
+        readValue(streamList, offset + 4, &chunkSize);
+
+        const auto chunk { subRange(streamList, offset + ChunkHeaderSize, chunkSize) };
+        DWORD handler { 0 }, scale { 0 }, rate { 0 }, length { 0 };
+
+        if (hasTag(streamList, offset, "strh") &&
+            readValue(chunk, 4, &handler) && readValue(chunk, 20, &scale) &&
+            readValue(chunk, 24, &rate) && readValue(chunk, 32, &length))
+        {
+            stream.type = hasTag(chunk, 0, "vids") ? StreamType::Video : hasTag(chunk, 0, "auds") ? StreamType::Audio : StreamType::Other;
+            stream.codec = fourccToString(handler);
+            stream.duration = unitsToTime(length, scale, rate);
+            stream.frameRate = stream.type == StreamType::Video && scale != 0 ? static_cast<double>(rate) / scale : 0.0;
+        }
+        else if (hasTag(streamList, offset, "strf") && stream.type == StreamType::Video)
+        {
+            readVideoFormat(chunk, &stream);
+        }
+        else if (hasTag(streamList, offset, "strf") && stream.type == StreamType::Audio)
+        {
+            readAudioFormat(chunk, &stream);
+        }
+
+        offset += ChunkHeaderSize + chunkSize + (chunkSize & 1);
+    }
+
+    info->streams.push_back(stream);
+}
+
+bool probeAvi(const ByteRange& file, MediaInfo * info)
+{
+    DWORD riffSize { 0 };
+
+    if (!hasTag(file, 0, "RIFF") || !hasTag(file, 8, "AVI ") || !readValue(file, 4, &riffSize))
+    {
+        return false;
+    }
+
+    const auto riff { subRange(file, 0, riffSize + ChunkHeaderSize) };
+
+    for (size_t offset = ListHeaderSize; offset + ListHeaderSize <= riff.size;)
+    {
+        DWORD chunkSize { 0 };
+        readValue(riff, offset + 4, &chunkSize);
+
+        if (hasTag(riff, offset, "LIST") && hasTag(riff, offset + ChunkHeaderSize, "hdrl"))
+        {
+            const auto headerList { subRange(riff, offset + ListHeaderSize, chunkSize - 4) };
+            DWORD microSecondsPerFrame { 0 }, totalFrames { 0 }, width { 0 }, height { 0 };
+
+            for (size_t child = 0; child + ChunkHeaderSize <= headerList.size;)
+            {
+                DWORD childSize { 0 };
+                readValue(headerList, child + 4, &childSize);
+
+                const auto chunk { subRange(headerList, child + ChunkHeaderSize, childSize) };
+
+                if (hasTag(headerList, child, "avih"))
+                {
+                    readValue(chunk, 0, &microSecondsPerFrame);
+                    readValue(chunk, 16, &totalFrames);
+                    readValue(chunk, 32, &width);
+                    readValue(chunk, 36, &height);
+                }
+                else if (hasTag(headerList, child, "LIST") && hasTag(chunk, 0, "strl"))
+                {
+                    probeAviStream(subRange(chunk, 4, childSize - 4), info);
+                }
+
+                child += ChunkHeaderSize + childSize + (childSize & 1);
+            }
+
+            const auto mainDuration { static_cast<REFERENCE_TIME>(totalFrames) * microSecondsPerFrame * 10 };
+
+            for (auto& stream : info->streams)
+            {
+                if (stream.type == StreamType::Video && stream.width == 0)
+                {
+                    stream.width = static_cast<LONG>(width);
+                    stream.height = static_cast<LONG>(height);
+                }
+
+                info->duration = std::max(info->duration, stream.duration);
+            }
+
+            info->container = ContainerType::Avi;
+            info->duration = info->duration > 0 ? info->duration : mainDuration;
+            return true;
+        }
+
+        if (hasTag(riff, offset, "LIST") && hasTag(riff, offset + ChunkHeaderSize, "movi"))
+        {
+            break;
+        }
+
+        offset += ChunkHeaderSize + chunkSize + (chunkSize & 1);
+    }
+
+    return false;
+}
+
+void probeAsfStream(const ByteRange& object, std::vector<AsfStream>& streams)
+{
+    DWORD typeDataLength { 0 };
+    WORD flags { 0 };
+
+    if (!readValue(object, 64, &typeDataLength) || !readValue(object, 72, &flags))
+    {
+        return;
+    }
+
+    const auto typeData { subRange(object, 78, typeDataLength) };
+    AsfStream stream {};
+    stream.number = flags & 0x7F;
+    stream.info.type = StreamType::Other;
+
+    if (hasGuid(object, AsfObjectHeaderSize, AsfVideoMedia))
+    {
+        DWORD encodedWidth { 0 }, encodedHeight { 0 };
+        stream.info.type = StreamType::Video;
+
+        if (readValue(typeData, 0, &encodedWidth) && readValue(typeData, 4, &encodedHeight))
+        {
+            stream.info.width = static_cast<LONG>(encodedWidth);
+            stream.info.height = static_cast<LONG>(encodedHeight);
+        }
+
+        readVideoFormat(subRange(typeData, 11, typeData.size), &stream.info);
+    }
+    else if (hasGuid(object, AsfObjectHeaderSize, AsfAudioMedia))
+    {
+        stream.info.type = StreamType::Audio;
+        readAudioFormat(typeData, &stream.info);
+    }
+
+    streams.push_back(stream);
+}
+
+void probeAsfExtendedStream(const ByteRange& object, std::vector<AsfStream>& streams, std::vector<std::pair<WORD, REFERENCE_TIME>>& frameDurations)
+{
+    WORD streamNumber { 0 }, nameCount { 0 }, extensionCount { 0 };
+    REFERENCE_TIME averageTimePerFrame { 0 };
+
+    if (!readValue(object, 72, &streamNumber) || !readValue(object, 76, &averageTimePerFrame) ||
+        !readValue(object, 84, &nameCount) || !readValue(object, 86, &extensionCount))
+    {
+        return;
+    }
+
+    frameDurations.emplace_back(streamNumber, averageTimePerFrame);
+
+    auto offset { size_t(88) };
+
+    for (WORD name = 0; name < nameCount; ++name)
+    {
+        WORD nameLength { 0 };
+        readValue(object, offset + 2, &nameLength);
+        offset += 4 + nameLength;
+    }
+
+    for (WORD extension = 0; extension < extensionCount; ++extension)
+    {
+        DWORD infoLength { 0 };
+        readValue(object, offset + 18, &infoLength);
+        offset += 22 + static_cast<size_t>(infoLength);
+    }
+
+    unsigned long long childSize { 0 };
+
+    if (hasGuid(object, offset, AsfStreamPropertiesObject) && readValue(object, offset + 16, &childSize))
+    {
+        probeAsfStream(subRange(object, offset, childSize), streams);
+    }
+}
+
+bool probeAsf(const ByteRange& file, MediaInfo * info)
+{
+    unsigned long long headerSize { 0 };
+
+    if (!hasGuid(file, 0, AsfHeaderObject) || !readValue(file, 16, &headerSize))
+    {
+        return false;
+    }
+
+    const auto header { subRange(file, 0, headerSize) };
+    std::vector<AsfStream> streams;
+    std::vector<std::pair<WORD, REFERENCE_TIME>> frameDurations;
+
+    const auto walkObjects = [&](const ByteRange& objects, size_t offset) {
+        while (offset + AsfObjectHeaderSize <= objects.size)
+        {
+            unsigned long long objectSize { 0 };
+            readValue(objects, offset + 16, &objectSize);
+
+            if (objectSize < AsfObjectHeaderSize || objectSize > objects.size - offset)
+            {
+                break;
+            }
+
+            const auto object { subRange(objects, offset, objectSize) };
+            unsigned long long playDuration { 0 }, preroll { 0 };
+            DWORD extensionSize { 0 };
+
+            if (hasGuid(object, 0, AsfFilePropertiesObject) && readValue(object, 64, &playDuration) && readValue(object, 80, &preroll))
+            {
+                info->duration = static_cast<REFERENCE_TIME>(playDuration - std::min(playDuration, preroll * 10000));
+            }
+            else if (hasGuid(object, 0, AsfStreamPropertiesObject))
+            {
+                probeAsfStream(object, streams);
+            }
+            else if (hasGuid(object, 0, AsfExtendedStreamPropertiesObject))
+            {
+                probeAsfExtendedStream(object, streams, frameDurations);
+            }
+            else if (hasGuid(object, 0, AsfHeaderExtensionObject) && readValue(object, 42, &extensionSize))
+            {
+                const auto extension { subRange(object, AsfHeaderExtensionDataOffset, extensionSize) };
+
+                for (size_t child = 0; child + AsfObjectHeaderSize <= extension.size;)
+                {
+                    unsigned long long childSize { 0 };
+                    readValue(extension, child + 16, &childSize);
+
+                    if (childSize < AsfObjectHeaderSize || childSize > extension.size - child)
+                    {
+                        break;
+                    }
+
+                    if (hasGuid(extension, child, AsfExtendedStreamPropertiesObject))
+                    {
+                        probeAsfExtendedStream(subRange(extension, child, childSize), streams, frameDurations);
+                    }
+
+                    child += static_cast<size_t>(childSize);
+                }
+            }
+
+            offset += static_cast<size_t>(objectSize);
+        }
+    };
+
+    walkObjects(header, 30);
+
+    for (auto& stream : streams)
+    {
+        const auto frameDuration = std::find_if(frameDurations.begin(), frameDurations.end(), [&](const std::pair<WORD, REFERENCE_TIME>& entry) {
+            return entry.first == stream.number;
+        });
+
+        if (stream.info.type == StreamType::Video && frameDuration != frameDurations.end() && frameDuration->second > 0)
+        {
+            stream.info.frameRate = UnitsPerSecond / frameDuration->second;
+        }
+
+        stream.info.duration = info->duration;
+        info->streams.push_back(stream.info);
+    }
+
+    info->container = ContainerType::Asf;
+    return true;
+}
+
+bool wpl::probe(const std::string& filename, MediaInfo * info)
+{
+    MappedFile mappedFile;
+
+    if (info == nullptr || !mappedFile.open(filename, ProbeWindow))
+    {
+        return false;
+    }
+
+    const ByteRange file { mappedFile.data(), mappedFile.size() };
+    MediaInfo result {};
+    result.filename = filename;
+    result.container = ContainerType::Unknown;
+
+    if (!probeAvi(file, &result) && !probeAsf(file, &result))
+    {
+        return false;
+    }
+
+    *info = std::move(result);
+    return true;
+}
+
+std::vector<MediaInfo> wpl::probeDirectory(const std::string& directory, size_t maxConcurrent)
+{
+    std::vector<std::string> filenames;
+    WIN32_FIND_DATAA findData;
+
+    const auto root { directory.empty() || directory.back() == '\\' || directory.back() == '/' ? directory : directory + "\\" };
+    const auto search { FindFirstFileA((root + "*").c_str(), &findData) };
+
+    if (search == INVALID_HANDLE_VALUE)
+    {
+        return {};
+    }
+
+    do
+    {
+        if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        {
+            filenames.push_back(root + findData.cFileName);
+        }
+    } while (FindNextFileA(search, &findData));
+
+    FindClose(search);
+
+    std::vector<MediaInfo> results(filenames.size());
+    std::vector<char> probed(filenames.size(), 0);
+    std::atomic<size_t> nextFile { 0 };
+
+    // Each lane pulls files until none are left, so at most maxConcurrent
+    // probes run at once on the shared workers and this thread.
+    const auto lanes { std::min(std::max<size_t>(maxConcurrent, 1), filenames.size()) };
+
+    TaskScheduler::shared().parallelFor(lanes, [&](size_t) {
+        for (auto index = nextFile++; index < filenames.size(); index = nextFile++)
+        {
+            probed[index] = probe(filenames[index], &results[index]);
+        }
+    });
+
+    std::vector<MediaInfo> media;
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        if (probed[i])
+        {
+            media.push_back(std::move(results[i]));
+        }
+    }
+
+    return media;
+}
@@ -0,0 +1,1105 @@
+#include <algorithm>
+#include <cstring>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto ReadAheadBlockSize {size_t(256) * 1024};
+const auto ReadAheadBlocksBehind {1ULL};
+const auto ByteUnits {10000000LL};
+const auto OutputPinName {L"Output"};
+const auto SourceFilterName {L"WPL Read-Ahead Source"};
+const auto StreamSniffBytes {size_t(12)};
+
+const CLSID CLSID_ReadAheadSource { 0x6A2E3C71, 0x4F0B, 0x4C3E, { 0x9A, 0x57, 0x21, 0x8D, 0x3B, 0x64, 0xE2, 0x0F } };
+
+template<typename T> 
+void safeRelease(T ** comPtr) 
+{
+    if (comPtr != nullptr && *comPtr) 
+    {
+        (*comPtr)->Release();
+        (*comPtr) = nullptr;
+    }
+}
+
+REFERENCE_TIME elapsedSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 100;
+}
+
+HANDLE openForReading(const std::string& filename, DWORD flags)
+{
+    return CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+}
+
+void closeHandle(HANDLE * handle)
+{
+    if (*handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(*handle);
+        *handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+LPWSTR copyToTaskMemory(const std::wstring& text)
+{
+    const auto bytes { (text.size() + 1) * sizeof(WCHAR) };
+    const auto copy { static_cast<LPWSTR>(CoTaskMemAlloc(bytes)) };
+
+    if (copy != nullptr)
+    {
+        std::memcpy(copy, text.c_str(), bytes);
+    }
+
+    return copy;
+}
+
+GUID streamSubtype(const BYTE * header, size_t length)
+{
+    const BYTE mpegPackStart[] { 0x00, 0x00, 0x01, 0xBA };
+
+    if (length >= 12 && std::memcmp(header, "RIFF", 4) == 0 && std::memcmp(header + 8, "AVI ", 4) == 0)
+    {
+        return MEDIASUBTYPE_Avi;
+    }
+
+    if (length >= 12 && std::memcmp(header, "RIFF", 4) == 0 && std::memcmp(header + 8, "WAVE", 4) == 0)
+    {
+        return MEDIASUBTYPE_WAVE;
+    }
+
+    if (length >= sizeof(mpegPackStart) && std::memcmp(header, mpegPackStart, sizeof(mpegPackStart)) == 0)
+    {
+        return MEDIASUBTYPE_MPEG1System;
+    }
+
+    return GUID_NULL;
+}
+
+struct ReadRequest
+{
+    IMediaSample * sample;
+    DWORD_PTR user;
+    HRESULT result;
+};
+
+class wpl::ReadAheadPin : public IPin, public IAsyncReader
+{
+    ReadAheadSource * filter;
+    ByteReader * reader;
+    IPin * connectedPin;
+    AM_MEDIA_TYPE mediaType;
+    std::deque<ReadRequest> completed;
+    std::mutex requestLock;
+    std::condition_variable requestReady;
+    bool flushing;
+
+    HRESULT readSample(IMediaSample * sample);
+public:
+    ReadAheadPin(ReadAheadSource * owner, ByteReader * source, const GUID& subtype);
+    ~ReadAheadPin();
+
+    const AM_MEDIA_TYPE& type() const;
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    HRESULT STDMETHODCALLTYPE Connect(IPin * receivePin, const AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE ReceiveConnection(IPin * connector, const AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE Disconnect() override;
+    HRESULT STDMETHODCALLTYPE ConnectedTo(IPin ** pin) override;
+    HRESULT STDMETHODCALLTYPE ConnectionMediaType(AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE QueryPinInfo(PIN_INFO * info) override;
+    HRESULT STDMETHODCALLTYPE QueryDirection(PIN_DIRECTION * direction) override;
+    HRESULT STDMETHODCALLTYPE QueryId(LPWSTR * id) override;
+    HRESULT STDMETHODCALLTYPE QueryAccept(const AM_MEDIA_TYPE * type) override;
+    HRESULT STDMETHODCALLTYPE EnumMediaTypes(IEnumMediaTypes ** types) override;
+    HRESULT STDMETHODCALLTYPE QueryInternalConnections(IPin ** pins, ULONG * count) override;
+    HRESULT STDMETHODCALLTYPE EndOfStream() override;
+    HRESULT STDMETHODCALLTYPE NewSegment(REFERENCE_TIME start, REFERENCE_TIME stop, double rate) override;
+
+    HRESULT STDMETHODCALLTYPE RequestAllocator(IMemAllocator * preferred, ALLOCATOR_PROPERTIES * properties, IMemAllocator ** actual) override;
+    HRESULT STDMETHODCALLTYPE Request(IMediaSample * sample, DWORD_PTR user) override;
+    HRESULT STDMETHODCALLTYPE WaitForNext(DWORD timeout, IMediaSample ** sample, DWORD_PTR * user) override;
+    HRESULT STDMETHODCALLTYPE SyncReadAligned(IMediaSample * sample) override;
+    HRESULT STDMETHODCALLTYPE SyncRead(LONGLONG position, LONG length, BYTE * buffer) override;
+    HRESULT STDMETHODCALLTYPE Length(LONGLONG * total, LONGLONG * available) override;
+    HRESULT STDMETHODCALLTYPE BeginFlush() override;
+    HRESULT STDMETHODCALLTYPE EndFlush() override;
+};
+
+PinEnumerator::PinEnumerator(IPin * onlyPin, ULONG start)
+    : pin(onlyPin), position(start), referenceCount(1)
+{
+    pin->AddRef();
+}
+
+PinEnumerator::~PinEnumerator()
+{
+    pin->Release();
+}
+
+HRESULT PinEnumerator::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *object = riid == IID_IUnknown || riid == IID_IEnumPins ? this : nullptr;
+    return *object ? (AddRef(), S_OK) : E_NOINTERFACE;
+}
+
+ULONG PinEnumerator::AddRef()
+{
+    return InterlockedIncrement(&referenceCount);
+}
+
+ULONG PinEnumerator::Release()
+{
+    const auto count { InterlockedDecrement(&referenceCount) };
+    if (count == 0) delete this;
+    return count;
+}
+
+HRESULT PinEnumerator::Next(ULONG count, IPin ** pins, ULONG * fetched)
+{
+    ULONG copied { 0 };
+
+    if (count > 0 && position == 0)
+    {
+        pins[0] = pin;
+        pin->AddRef();
+        position = copied = 1;
+    }
+
+    if (fetched != nullptr) *fetched = copied;
+    return copied == count ? S_OK : S_FALSE;
+}
+
+HRESULT PinEnumerator::Skip(ULONG count)
+{
+    position += count;
+    return position <= 1 ? S_OK : S_FALSE;
+}
+
+HRESULT PinEnumerator::Reset()
+{
+    position = 0;
+    return S_OK;
+}
+
+HRESULT PinEnumerator::Clone(IEnumPins ** pins)
+{
+    *pins = new PinEnumerator(pin, position);
+    return S_OK;
+}
+
+MediaTypeEnumerator::MediaTypeEnumerator(const AM_MEDIA_TYPE& onlyType, ULONG start)
+    : mediaTypes(1, onlyType), position(start), referenceCount(1)
+{
+}
+
+MediaTypeEnumerator::MediaTypeEnumerator(std::vector<AM_MEDIA_TYPE> types, ULONG start)
+    : mediaTypes(std::move(types)), position(start), referenceCount(1)
+{
+}
+
+HRESULT MediaTypeEnumerator::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *object = riid == IID_IUnknown || riid == IID_IEnumMediaTypes ? this : nullptr;
+    return *object ? (AddRef(), S_OK) : E_NOINTERFACE;
+}
+
+ULONG MediaTypeEnumerator::AddRef()
+{
+    return InterlockedIncrement(&referenceCount);
+}
+
+ULONG MediaTypeEnumerator::Release()
+{
+    const auto count { InterlockedDecrement(&referenceCount) };
+    if (count == 0) delete this;
+    return count;
+}
+
+HRESULT MediaTypeEnumerator::Next(ULONG count, AM_MEDIA_TYPE ** types, ULONG * fetched)
+{
+    ULONG copied { 0 };
+
+    // The offered types are partial and carry no format block, so a
+    // shallow copy is all the caller needs to free with CoTaskMemFree.
+    while (copied < count && position < mediaTypes.size())
+    {
+        types[copied] = static_cast<AM_MEDIA_TYPE*>(CoTaskMemAlloc(sizeof(AM_MEDIA_TYPE)));
+
+        if (types[copied] == nullptr)
+        {
+            break;
+        }
+
+        *types[copied++] = mediaTypes[position++];
+    }
+
+    if (copied == 0 && count > 0 && position < mediaTypes.size())
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    if (fetched != nullptr) *fetched = copied;
+    return copied == count ? S_OK : S_FALSE;
+}
+
+HRESULT MediaTypeEnumerator::Skip(ULONG count)
+{
+    position += count;
+    return position <= mediaTypes.size() ? S_OK : S_FALSE;
+}
+
+HRESULT MediaTypeEnumerator::Reset()
+{
+    position = 0;
+    return S_OK;
+}
+
+HRESULT MediaTypeEnumerator::Clone(IEnumMediaTypes ** types)
+{
+    *types = new MediaTypeEnumerator(mediaTypes, position);
+    return S_OK;
+}
+
+ReadAheadReader::ReadAheadReader()
+    : prefetchFile(INVALID_HANDLE_VALUE),
+      demandFile(INVALID_HANDLE_VALUE),
+      fileLength(0),
+      cursor(0),
+      pendingBlock(~0ULL),
+      window(0),
+      stopping(false),
+      readStats()
+{
+}
+
+ReadAheadReader::~ReadAheadReader()
+{
+    close();
+}
+
+bool ReadAheadReader::open(const std::string& filename, size_t windowBytes)
+{
+    LARGE_INTEGER size;
+
+    close();
+
+    prefetchFile = openForReading(filename, FILE_FLAG_SEQUENTIAL_SCAN);
+    demandFile = openForReading(filename, FILE_ATTRIBUTE_NORMAL);
+
+    if (prefetchFile == INVALID_HANDLE_VALUE || demandFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(demandFile, &size))
+    {
+        close();
+        return false;
+    }
+
+    fileLength = static_cast<unsigned long long>(size.QuadPart);
+    window = MemoryGovernor::shared().reserveBuffer(std::max(windowBytes, ReadAheadBlockSize), ReadAheadBlockSize);
+
+    if (window == 0)
+    {
+        close();
+        return false;
+    }
+
+    readStats.bufferBytes = window;
+    stopping = false;
+    worker = std::thread([this]() { prefetch(); });
+    return true;
+}
+
+void ReadAheadReader::close()
+{
+    {
+        std::lock_guard<std::mutex> guard(blockLock);
+        stopping = true;
+    }
+
+    blockReady.notify_all();
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+    closeHandle(&prefetchFile);
+    closeHandle(&demandFile);
+
+    blocks.clear();
+    MemoryGovernor::shared().releaseBuffer(window);
+    window = 0;
+    fileLength = 0;
+    cursor = 0;
+    pendingBlock = ~0ULL;
+    readStats = {};
+}
+
+bool ReadAheadReader::readBlock(HANDLE file, unsigned long long block, std::vector<BYTE>& data) const
+{
+    const auto offset { block * ReadAheadBlockSize };
+    const auto length { static_cast<DWORD>(std::min<unsigned long long>(ReadAheadBlockSize, fileLength - offset)) };
+
+    OVERLAPPED overlapped {};
+    DWORD bytesRead { 0 };
+
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    data.resize(length);
+
+    return ReadFile(file, data.data(), length, &bytesRead, &overlapped) && bytesRead == length;
+}
+
+void ReadAheadReader::prefetch()
+{
+    std::unique_lock<std::mutex> lock(blockLock);
+
+    while (!stopping)
+    {
+        const auto blockCount { (fileLength + ReadAheadBlockSize - 1) / ReadAheadBlockSize };
+        const auto first { cursor / ReadAheadBlockSize };
+        const auto last { std::min(blockCount, (cursor + window) / ReadAheadBlockSize + 1) };
+
+        for (auto block = blocks.begin(); block != blocks.end();)
+        {
+            const auto stale { block->first + ReadAheadBlocksBehind < first || block->first >= last };
+            block = stale ? blocks.erase(block) : std::next(block);
+        }
+
+        auto next { first };
+
+        while (next < last && blocks.count(next) > 0)
+        {
+            ++next;
+        }
+
+        if (next >= last)
+        {
+            blockReady.wait(lock);
+            continue;
+        }
+
+        std::vector<BYTE> data;
+        pendingBlock = next;
+        lock.unlock();
+
+        const auto loaded { readBlock(prefetchFile, next, data) };
+
+        lock.lock();
+        pendingBlock = ~0ULL;
+
+        if (loaded)
+        {
+            readStats.bytesPrefetched += data.size();
+            blocks[next] = std::move(data);
+        }
+
+        blockReady.notify_all();
+
+        if (!loaded)
+        {
+            blockReady.wait(lock);
+        }
+    }
+}
+
+size_t ReadAheadReader::read(unsigned long long offset, size_t length, BYTE * buffer)
+{
+    size_t copied { 0 };
+
+    if (offset >= fileLength)
+    {
+        return 0;
+    }
+
+    length = static_cast<size_t>(std::min<unsigned long long>(length, fileLength - offset));
+
+    while (copied < length)
+    {
+        const auto position { offset + copied };
+        const auto block { position / ReadAheadBlockSize };
+        const auto start { std::chrono::steady_clock::now() };
+
+        std::unique_lock<std::mutex> lock(blockLock);
+        auto stalled { false };
+
+        cursor = position;
+        blockReady.notify_all();
+
+        while (pendingBlock == block && blocks.count(block) == 0 && !stopping)
+        {
+            stalled = true;
+            blockReady.wait(lock);
+        }
+
+        auto found { blocks.find(block) };
+
+        if (found == blocks.end())
+        {
+            std::vector<BYTE> data;
+            stalled = true;
+            lock.unlock();
+
+            const auto loaded { readBlock(demandFile, block, data) };
+
+            lock.lock();
+
+            if (!loaded)
+            {
+                ++readStats.stalls;
+                readStats.blockedTime += elapsedSince(start);
+                break;
+            }
+
+            found = blocks.emplace(block, std::move(data)).first;
+        }
+
+        const auto& data { found->second };
+        const auto blockOffset { static_cast<size_t>(position - block * ReadAheadBlockSize) };
+        const auto bytes { std::min(length - copied, data.size() - std::min(blockOffset, data.size())) };
+
+        if (bytes == 0)
+        {
+            break;
+        }
+
+        std::memcpy(buffer + copied, data.data() + blockOffset, bytes);
+        copied += bytes;
+        readStats.bytesRead += bytes;
+
+        if (stalled)
+        {
+            ++readStats.stalls;
+            readStats.blockedTime += elapsedSince(start);
+        }
+    }
+
+    return copied;
+}
+
+unsigned long long ReadAheadReader::size() const
+{
+    return fileLength;
+}
+
+unsigned long long ReadAheadReader::available() const
+{
+    return fileLength;
+}
+
+void ReadAheadReader::setFlushing(bool)
+{
+}
+
+ReadAheadStats ReadAheadReader::stats() const
+{
+    std::lock_guard<std::mutex> guard(blockLock);
+    return readStats;
+}
+
+ReadAheadPin::ReadAheadPin(ReadAheadSource * owner, ByteReader * source, const GUID& subtype)
+    : filter(owner), reader(source), connectedPin(nullptr), mediaType(), flushing(false)
+{
+    mediaType.majortype = MEDIATYPE_Stream;
+    mediaType.subtype = subtype;
+    mediaType.bFixedSizeSamples = TRUE;
+    mediaType.lSampleSize = 1;
+    mediaType.formattype = GUID_NULL;
+}
+
+ReadAheadPin::~ReadAheadPin()
+{
+    if (connectedPin != nullptr)
+    {
+        connectedPin->Release();
+    }
+}
+
+const AM_MEDIA_TYPE& ReadAheadPin::type() const
+{
+    return mediaType;
+}
+
+HRESULT ReadAheadPin::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown || riid == IID_IPin)
+    {
+        *object = static_cast<IPin*>(this);
+    }
+    else if (riid == IID_IAsyncReader)
+    {
+        *object = static_cast<IAsyncReader*>(this);
+    }
+    else
+    {
+        *object = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    AddRef();
+    return S_OK;
+}
+
+ULONG ReadAheadPin::AddRef()
+{
+    return filter->AddRef();
+}
+
+ULONG ReadAheadPin::Release()
+{
+    return filter->Release();
+}
+
+HRESULT ReadAheadPin::Connect(IPin * receivePin, const AM_MEDIA_TYPE * type)
+{
+    if (receivePin == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (connectedPin != nullptr)
+    {
+        return VFW_E_ALREADY_CONNECTED;
+    }
+
+    if (type != nullptr && QueryAccept(type) != S_OK)
+    {
+        return VFW_E_TYPE_NOT_ACCEPTED;
+    }
+
+    const auto hr { receivePin->ReceiveConnection(this, &mediaType) };
+
+    if (SUCCEEDED(hr))
+    {
+        connectedPin = receivePin;
+        connectedPin->AddRef();
+    }
+
+    return hr;
+}
+
+HRESULT ReadAheadPin::ReceiveConnection(IPin *, const AM_MEDIA_TYPE *)
+{
+    return E_UNEXPECTED;
+}
+
+HRESULT ReadAheadPin::Disconnect()
+{
+    if (connectedPin == nullptr)
+    {
+        return S_FALSE;
+    }
+
+    connectedPin->Release();
+    connectedPin = nullptr;
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::ConnectedTo(IPin ** pin)
+{
+    if (pin == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *pin = connectedPin;
+
+    if (connectedPin == nullptr)
+    {
+        return VFW_E_NOT_CONNECTED;
+    }
+
+    connectedPin->AddRef();
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::ConnectionMediaType(AM_MEDIA_TYPE * type)
+{
+    if (type == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (connectedPin == nullptr)
+    {
+        return VFW_E_NOT_CONNECTED;
+    }
+
+    *type = mediaType;
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::QueryPinInfo(PIN_INFO * info)
+{
+    if (info == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    info->pFilter = filter;
+    info->pFilter->AddRef();
+    info->dir = PINDIR_OUTPUT;
+    wcsncpy_s(info->achName, OutputPinName, _TRUNCATE);
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::QueryDirection(PIN_DIRECTION * direction)
+{
+    if (direction == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *direction = PINDIR_OUTPUT;
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::QueryId(LPWSTR * id)
+{
+    if (id == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *id = copyToTaskMemory(OutputPinName);
+    return *id ? S_OK : E_OUTOFMEMORY;
+}
+
+HRESULT ReadAheadPin::QueryAccept(const AM_MEDIA_TYPE * type)
+{
+    return type != nullptr && type->majortype == mediaType.majortype && type->subtype == mediaType.subtype ? S_OK : S_FALSE;
+}
+
+HRESULT ReadAheadPin::EnumMediaTypes(IEnumMediaTypes ** types)
+{
+    if (types == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *types = new MediaTypeEnumerator(mediaType, 0);
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::QueryInternalConnections(IPin **, ULONG *)
+{
+    return E_NOTIMPL;
+}
+
+HRESULT ReadAheadPin::EndOfStream()
+{
+    return E_UNEXPECTED;
+}
+
+HRESULT ReadAheadPin::NewSegment(REFERENCE_TIME, REFERENCE_TIME, double)
+{
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::RequestAllocator(IMemAllocator * preferred, ALLOCATOR_PROPERTIES * properties, IMemAllocator ** actual)
+{
+    if (properties == nullptr || actual == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    ALLOCATOR_PROPERTIES granted;
+    auto request { *properties };
+    request.cbAlign = std::max<LONG>(request.cbAlign, 1);
+
+    if (preferred != nullptr && SUCCEEDED(preferred->SetProperties(&request, &granted)))
+    {
+        preferred->AddRef();
+        *actual = preferred;
+        return S_OK;
+    }
+
+    IMemAllocator * allocator { nullptr };
+    auto hr { CoCreateInstance(CLSID_MemoryAllocator, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&allocator)) };
+    hr = SUCCEEDED(hr) ? allocator->SetProperties(&request, &granted) : hr;
+
+    if (FAILED(hr))
+    {
+        safeRelease(&allocator);
+        return hr;
+    }
+
+    *actual = allocator;
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::readSample(IMediaSample * sample)
+{
+    REFERENCE_TIME start, stop;
+    BYTE * buffer { nullptr };
+
+    auto hr { sample->GetTime(&start, &stop) };
+    hr = SUCCEEDED(hr) ? sample->GetPointer(&buffer) : hr;
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    const auto position { static_cast<unsigned long long>(start / ByteUnits) };
+    const auto length { static_cast<size_t>(std::min<LONGLONG>((stop - start) / ByteUnits, sample->GetSize())) };
+    const auto bytesRead { reader->read(position, length, buffer) };
+
+    sample->SetActualDataLength(static_cast<LONG>(bytesRead));
+    return bytesRead == length ? S_OK : S_FALSE;
+}
+
+HRESULT ReadAheadPin::Request(IMediaSample * sample, DWORD_PTR user)
+{
+    if (sample == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(requestLock);
+
+        if (flushing)
+        {
+            return VFW_E_WRONG_STATE;
+        }
+    }
+
+    const auto result { readSample(sample) };
+
+    std::lock_guard<std::mutex> guard(requestLock);
+    completed.push_back({ sample, user, flushing ? VFW_E_WRONG_STATE : result });
+    requestReady.notify_all();
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::WaitForNext(DWORD timeout, IMediaSample ** sample, DWORD_PTR * user)
+{
+    if (sample == nullptr || user == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::unique_lock<std::mutex> lock(requestLock);
+    *sample = nullptr;
+
+    const auto ready = [this]() { return !completed.empty() || flushing; };
+
+    if (timeout == INFINITE)
+    {
+        requestReady.wait(lock, ready);
+    }
+    else if (!requestReady.wait_for(lock, std::chrono::milliseconds(timeout), ready))
+    {
+        return VFW_E_TIMEOUT;
+    }
+
+    if (completed.empty())
+    {
+        return VFW_E_WRONG_STATE;
+    }
+
+    const auto request { completed.front() };
+    completed.pop_front();
+
+    *sample = request.sample;
+    *user = request.user;
+    return flushing ? VFW_E_WRONG_STATE : request.result;
+}
+
+HRESULT ReadAheadPin::SyncReadAligned(IMediaSample * sample)
+{
+    return sample != nullptr ? readSample(sample) : E_POINTER;
+}
+
+HRESULT ReadAheadPin::SyncRead(LONGLONG position, LONG length, BYTE * buffer)
+{
+    if (buffer == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (position < 0 || length < 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    const auto bytesRead { reader->read(static_cast<unsigned long long>(position), static_cast<size_t>(length), buffer) };
+    return bytesRead == static_cast<size_t>(length) ? S_OK : S_FALSE;
+}
+
+HRESULT ReadAheadPin::Length(LONGLONG * total, LONGLONG * available)
+{
+    if (total == nullptr || available == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *total = static_cast<LONGLONG>(reader->size());
+    *available = static_cast<LONGLONG>(reader->available());
+    return *available < *total ? VFW_S_ESTIMATED : S_OK;
+}
+
+HRESULT ReadAheadPin::BeginFlush()
+{
+    {
+        std::lock_guard<std::mutex> guard(requestLock);
+        flushing = true;
+        requestReady.notify_all();
+    }
+
+    reader->setFlushing(true);
+    return S_OK;
+}
+
+HRESULT ReadAheadPin::EndFlush()
+{
+    reader->setFlushing(false);
+
+    std::lock_guard<std::mutex> guard(requestLock);
+    flushing = false;
+    return S_OK;
+}
+
+ReadAheadSource::ReadAheadSource()
+    : outputPin(nullptr),
+      syncSource(nullptr),
+      filterGraph(nullptr),
+      filterName(SourceFilterName),
+      filterState(State_Stopped),
+      referenceCount(1)
+{
+}
+
+ReadAheadSource::~ReadAheadSource()
+{
+    delete outputPin;
+    safeRelease(&syncSource);
+}
+
+bool ReadAheadSource::open(const std::string& filename, const GUID& subtype, size_t windowBytes)
+{
+    auto fileReader { std::make_unique<ReadAheadReader>() };
+
+    if (outputPin != nullptr || !fileReader->open(filename, windowBytes))
+    {
+        return false;
+    }
+
+    reader = std::move(fileReader);
+    outputPin = new ReadAheadPin(this, reader.get(), subtype);
+    return true;
+}
+
+bool ReadAheadSource::open(std::unique_ptr<ByteReader> source)
+{
+    BYTE header[StreamSniffBytes] {};
+
+    if (outputPin != nullptr || source == nullptr)
+    {
+        return false;
+    }
+
+    const auto headerBytes { source->read(0, sizeof(header), header) };
+    const auto subtype { streamSubtype(header, headerBytes) };
+
+    if (subtype == GUID_NULL)
+    {
+        return false;
+    }
+
+    reader = std::move(source);
+    outputPin = new ReadAheadPin(this, reader.get(), subtype);
+    return true;
+}
+
+ReadAheadStats ReadAheadSource::stats() const
+{
+    return reader ? reader->stats() : ReadAheadStats {};
+}
+
+HRESULT ReadAheadSource::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown || riid == IID_IPersist || riid == IID_IMediaFilter || riid == IID_IBaseFilter)
+    {
+        *object = static_cast<IBaseFilter*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG ReadAheadSource::AddRef()
+{
+    return InterlockedIncrement(&referenceCount);
+}
+
+ULONG ReadAheadSource::Release()
+{
+    const auto count { InterlockedDecrement(&referenceCount) };
+
+    if (count == 0)
+    {
+        delete this;
+    }
+
+    return count;
+}
+
+HRESULT ReadAheadSource::GetClassID(CLSID * classId)
+{
+    if (classId == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *classId = CLSID_ReadAheadSource;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::Stop()
+{
+    filterState = State_Stopped;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::Pause()
+{
+    filterState = State_Paused;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::Run(REFERENCE_TIME)
+{
+    filterState = State_Running;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::GetState(DWORD, FILTER_STATE * state)
+{
+    if (state == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *state = filterState;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::SetSyncSource(IReferenceClock * clock)
+{
+    if (clock != nullptr)
+    {
+        clock->AddRef();
+    }
+
+    safeRelease(&syncSource);
+    syncSource = clock;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::GetSyncSource(IReferenceClock ** clock)
+{
+    if (clock == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *clock = syncSource;
+
+    if (syncSource != nullptr)
+    {
+        syncSource->AddRef();
+    }
+
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::EnumPins(IEnumPins ** pins)
+{
+    if (pins == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (outputPin == nullptr)
+    {
+        return VFW_E_NOT_CONNECTED;
+    }
+
+    *pins = new PinEnumerator(outputPin, 0);
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::FindPin(LPCWSTR id, IPin ** pin)
+{
+    if (id == nullptr || pin == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *pin = outputPin != nullptr && wcscmp(id, OutputPinName) == 0 ? outputPin : nullptr;
+
+    if (*pin == nullptr)
+    {
+        return VFW_E_NOT_FOUND;
+    }
+
+    (*pin)->AddRef();
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::QueryFilterInfo(FILTER_INFO * info)
+{
+    if (info == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    wcsncpy_s(info->achName, filterName.c_str(), _TRUNCATE);
+    info->pGraph = filterGraph;
+
+    if (filterGraph != nullptr)
+    {
+        filterGraph->AddRef();
+    }
+
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::JoinFilterGraph(IFilterGraph * graph, LPCWSTR name)
+{
+    filterGraph = graph;
+    filterName = name != nullptr ? name : SourceFilterName;
+    return S_OK;
+}
+
+HRESULT ReadAheadSource::QueryVendorInfo(LPWSTR *)
+{
+    return E_NOTIMPL;
+}
@@ -0,0 +1,708 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+#include <intrin.h>
+#include <immintrin.h>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto WeightBits {14};
+const auto WeightOne {1 << WeightBits};
+const auto WeightRound {1 << (WeightBits - 1)};
+const auto CachedTables {size_t(64)};
+const auto BandRows {LONG(64)};
+const auto ParallelPixels {LONG(256) * 256};
+const auto RowPadding {size_t(64)};
+const auto ColourBits {13};
+const auto ColourRound {short(1 << (ColourBits - 1))};
+const auto LumaScale {short(9535)};
+const auto RedFromV {short(13074)};
+const auto GreenFromU {short(3203)};
+const auto GreenFromV {short(6660)};
+const auto BlueFromU {short(16532)};
+
+struct FilterTable
+{
+    int taps;
+    std::vector<int> starts;
+    std::vector<short> weights;
+};
+
+using TableKey = std::tuple<LONG, LONG, ScaleFilter, int>;
+
+std::mutex tableLock;
+std::map<TableKey, std::shared_ptr<const FilterTable>> filterTables;
+
+double cubic(double x)
+{
+    const auto a { -0.5 };
+    x = std::abs(x);
+
+    if (x < 1.0)
+    {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    }
+
+    return x < 2.0 ? ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a : 0.0;
+}
+
+// Weights for one output sample as a map from source index to weight, with
+// taps that fall off either edge folded back onto the edge sample.
+std::map<int, double> sampleWeights(LONG sourceSize, LONG targetSize, ScaleFilter filter, LONG sample)
+{
+    const auto ratio { static_cast<double>(sourceSize) / targetSize };
+    std::map<int, double> weights;
+
+    const auto addWeight = [&](int index, double weight) {
+        weights[std::min(std::max(index, 0), static_cast<int>(sourceSize) - 1)] += weight;
+    };
+
+    if (filter == ScaleFilter::Box)
+    {
+        // Exact area coverage of each source sample by the output sample.
+        const auto left { sample * ratio };
+        const auto right { left + ratio };
+
+        for (auto index = static_cast<int>(std::floor(left)); index < right; ++index)
+        {
+            addWeight(index, std::min<double>(index + 1, right) - std::max<double>(index, left));
+        }
+
+        return weights;
+    }
+
+    const auto radius { filter == ScaleFilter::Bicubic ? 2.0 : 1.0 };
+    const auto stretch { std::max(ratio, 1.0) };
+    const auto centre { (sample + 0.5) * ratio - 0.5 };
+    const auto first { static_cast<int>(std::ceil(centre - radius * stretch)) };
+    const auto last { static_cast<int>(std::floor(centre + radius * stretch)) };
+
+    for (auto index = first; index <= last; ++index)
+    {
+        const auto distance { (index - centre) / stretch };
+        addWeight(index, filter == ScaleFilter::Bicubic ? cubic(distance) : std::max(0.0, 1.0 - std::abs(distance)));
+    }
+
+    return weights;
+}
+
+// Fixed point weights for every output sample. Each sample gets the same
+// number of taps, padded with zero weights up to a multiple of the kernel
+// width so the inner loops never need a remainder.
+std::shared_ptr<const FilterTable> buildTable(LONG sourceSize, LONG targetSize, ScaleFilter filter, int padTo)
+{
+    std::vector<std::map<int, double>> samples;
+    auto taps { 1 };
+
+    for (LONG sample = 0; sample < targetSize; ++sample)
+    {
+        samples.push_back(sampleWeights(sourceSize, targetSize, filter, sample));
+        taps = std::max(taps, samples.back().rbegin()->first - samples.back().begin()->first + 1);
+    }
+
+    taps = (taps + padTo - 1) / padTo * padTo;
+
+    const auto table { std::make_shared<FilterTable>() };
+    table->taps = taps;
+    table->starts.resize(targetSize);
+    table->weights.assign(static_cast<size_t>(targetSize) * taps, 0);
+
+    for (LONG sample = 0; sample < targetSize; ++sample)
+    {
+        const auto start { samples[sample].begin()->first };
+        auto total { 0.0 };
+
+        for (const auto& weight : samples[sample])
+        {
+            total += weight.second;
+        }
+
+        auto * weights { &table->weights[static_cast<size_t>(sample) * taps] };
+        auto fixedTotal { 0 };
+        auto largest { 0 };
+
+        for (const auto& weight : samples[sample])
+        {
+            const auto tap { weight.first - start };
+            weights[tap] = static_cast<short>(std::lround(weight.second / total * WeightOne));
+            fixedTotal += weights[tap];
+            largest = std::abs(weights[tap]) > std::abs(weights[largest]) ? tap : largest;
+        }
+
+        // Rounding must not shift the overall brightness.
+        weights[largest] = static_cast<short>(weights[largest] + WeightOne - fixedTotal);
+        table->starts[sample] = start;
+    }
+
+    return table;
+}
+
+std::shared_ptr<const FilterTable> filterTable(LONG sourceSize, LONG targetSize, ScaleFilter filter, int padTo)
+{
+    const auto key { TableKey(sourceSize, targetSize, filter, padTo) };
+    std::lock_guard<std::mutex> guard(tableLock);
+
+    const auto cached { filterTables.find(key) };
+
+    if (cached != filterTables.end())
+    {
+        return cached->second;
+    }
+
+    if (filterTables.size() >= CachedTables)
+    {
+        filterTables.clear();
+    }
+
+    return filterTables[key] = buildTable(sourceSize, targetSize, filter, padTo);
+}
+
+bool hasAvx2()
+{
+    const static auto supported = []() {
+        int info[4];
+        __cpuid(info, 0);
+
+        if (info[0] < 7)
+        {
+            return false;
+        }
+
+        __cpuid(info, 1);
+        const auto osSaves { (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 };
+
+        if (!osSaves || (_xgetbv(0) & 6) != 6)
+        {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+
+    return supported;
+}
+
+BYTE clampByte(int value)
+{
+    return static_cast<BYTE>(std::min(std::max(value, 0), 255));
+}
+
+int weightPair(const short * weights)
+{
+    return static_cast<int>(static_cast<unsigned short>(weights[0]) | static_cast<unsigned int>(static_cast<unsigned short>(weights[1])) << 16);
+}
+
+void verticalTail(const BYTE * const * rows, const short * weights, int taps, BYTE * output, size_t from, size_t bytes)
+{
+    for (auto x = from; x < bytes; ++x)
+    {
+        auto sum { WeightRound };
+
+        for (auto tap = 0; tap < taps; ++tap)
+        {
+            sum += rows[tap][x] * weights[tap];
+        }
+
+        output[x] = clampByte(sum >> WeightBits);
+    }
+}
+
+// Every byte in the row shares the same weights, so rows are blended two at
+// a time with the 16 bit multiply-add, eight bytes per step.
+void verticalSse2(const BYTE * const * rows, const short * weights, int taps, BYTE * output, size_t from, size_t bytes)
+{
+    const auto zero { _mm_setzero_si128() };
+    auto x { from };
+
+    for (; x + 8 <= bytes; x += 8)
+    {
+        auto low { _mm_set1_epi32(WeightRound) };
+        auto high { low };
+
+        for (auto tap = 0; tap < taps; tap += 2)
+        {
+            const auto first { _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[tap] + x)), zero) };
+            const auto second { _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rows[tap + 1] + x)), zero) };
+            const auto pair { _mm_set1_epi32(weightPair(weights + tap)) };
+
+            low = _mm_add_epi32(low, _mm_madd_epi16(_mm_unpacklo_epi16(first, second), pair));
+            high = _mm_add_epi32(high, _mm_madd_epi16(_mm_unpackhi_epi16(first, second), pair));
+        }
+
+        const auto words { _mm_packs_epi32(_mm_srai_epi32(low, WeightBits), _mm_srai_epi32(high, WeightBits)) };
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(output + x), _mm_packus_epi16(words, zero));
+    }
+
+    verticalTail(rows, weights, taps, output, x, bytes);
+}
+
+void verticalAvx2(const BYTE * const * rows, const short * weights, int taps, BYTE * output, size_t from, size_t bytes)
+{
+    auto x { from };
+
+    for (; x + 16 <= bytes; x += 16)
+    {
+        auto low { _mm256_set1_epi32(WeightRound) };
+        auto high { low };
+
+        for (auto tap = 0; tap < taps; tap += 2)
+        {
+            const auto first { _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[tap] + x))) };
+            const auto second { _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[tap + 1] + x))) };
+            const auto pair { _mm256_set1_epi32(weightPair(weights + tap)) };
+
+            low = _mm256_add_epi32(low, _mm256_madd_epi16(_mm256_unpacklo_epi16(first, second), pair));
+            high = _mm256_add_epi32(high, _mm256_madd_epi16(_mm256_unpackhi_epi16(first, second), pair));
+        }
+
+        // The unpacks and packs work within each 128 bit lane, which leaves
+        // the sixteen results in order in the low half of each lane.
+        const auto words { _mm256_packs_epi32(_mm256_srai_epi32(low, WeightBits), _mm256_srai_epi32(high, WeightBits)) };
+        const auto packed { _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8) };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x), _mm256_castsi256_si128(packed));
+    }
+
+    verticalSse2(rows, weights, taps, output, x, bytes);
+}
+
+// Packed BGRA: two neighbouring pixels are interleaved channel by channel
+// so one multiply-add applies a pair of taps to all four channels.
+void horizontalBgra(const BYTE * input, const FilterTable& table, BYTE * output, LONG width)
+{
+    const auto zero { _mm_setzero_si128() };
+
+    for (LONG x = 0; x < width; ++x)
+    {
+        const auto * source { input + static_cast<size_t>(table.starts[x]) * 4 };
+        const auto * weights { &table.weights[static_cast<size_t>(x) * table.taps] };
+        auto sum { _mm_set1_epi32(WeightRound) };
+
+        for (auto tap = 0; tap < table.taps; tap += 2)
+        {
+            const auto pixels { _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + tap * 4)), zero) };
+            const auto channels { _mm_unpacklo_epi16(pixels, _mm_srli_si128(pixels, 8)) };
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(channels, _mm_set1_epi32(weightPair(weights + tap))));
+        }
+
+        const auto words { _mm_packs_epi32(_mm_srai_epi32(sum, WeightBits), zero) };
+        const auto pixel { _mm_cvtsi128_si32(_mm_packus_epi16(words, zero)) };
+        std::memcpy(output + static_cast<size_t>(x) * 4, &pixel, 4);
+    }
+}
+
+// Planar: eight consecutive taps per multiply-add, summed across the lanes.
+void horizontalPlane(const BYTE * input, const FilterTable& table, BYTE * output, LONG width)
+{
+    const auto zero { _mm_setzero_si128() };
+
+    for (LONG x = 0; x < width; ++x)
+    {
+        const auto * source { input + table.starts[x] };
+        const auto * weights { &table.weights[static_cast<size_t>(x) * table.taps] };
+        auto sum { _mm_setzero_si128() };
+
+        for (auto tap = 0; tap < table.taps; tap += 8)
+        {
+            const auto samples { _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + tap)), zero) };
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(samples, _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights + tap))));
+        }
+
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        output[x] = clampByte((_mm_cvtsi128_si32(sum) + WeightRound) >> WeightBits);
+    }
+}
+
+struct PlaneJob
+{
+    const BYTE * source;
+    LONG sourceStride;
+    LONG sourceWidth;
+    LONG sourceHeight;
+    BYTE * target;
+    LONG targetStride;
+    LONG targetWidth;
+    LONG targetHeight;
+    int channels;
+};
+
+struct PlaneTables
+{
+    std::shared_ptr<const FilterTable> columns;
+    std::shared_ptr<const FilterTable> rows;
+};
+
+PlaneTables planeTables(const PlaneJob& job, ScaleFilter filter)
+{
+    return { filterTable(job.sourceWidth, job.targetWidth, filter, job.channels == 1 ? 8 : 2), filterTable(job.sourceHeight, job.targetHeight, filter, 2) };
+}
+
+std::vector<BYTE> scratchRow(const PlaneJob& job, const PlaneTables& tables)
+{
+    return std::vector<BYTE>(static_cast<size_t>(job.sourceWidth) * job.channels + (tables.columns->taps + RowPadding) * job.channels);
+}
+
+// Filters the source rows under output row y vertically into a scratch row
+// at source width, then horizontally into the output.
+void scaleRow(const PlaneJob& job, const PlaneTables& tables, LONG y, const BYTE ** taps, BYTE * scratch, BYTE * output)
+{
+    static const auto vertical { hasAvx2() ? verticalAvx2 : verticalSse2 };
+    const auto& rows { *tables.rows };
+
+    for (auto tap = 0; tap < rows.taps; ++tap)
+    {
+        const auto sourceRow { std::min(rows.starts[y] + tap, static_cast<int>(job.sourceHeight) - 1) };
+        taps[tap] = job.source + static_cast<ptrdiff_t>(sourceRow) * job.sourceStride;
+    }
+
+    vertical(taps, &rows.weights[static_cast<size_t>(y) * rows.taps], rows.taps, scratch, 0, static_cast<size_t>(job.sourceWidth) * job.channels);
+    (job.channels == 4 ? horizontalBgra : horizontalPlane)(scratch, *tables.columns, output, job.targetWidth);
+}
+
+// Output rows are split into bands so each worker keeps just its taps and
+// its scratch rows hot. Small outputs are not worth handing out.
+void runBands(LONG width, LONG height, const std::function<void(LONG, LONG)>& rows)
+{
+    const auto bands { static_cast<size_t>((height + BandRows - 1) / BandRows) };
+    const std::function<void(size_t)> band = [&](size_t index) {
+        const auto first { static_cast<LONG>(index) * BandRows };
+        rows(first, std::min(first + BandRows, height));
+    };
+
+    if (static_cast<long long>(width) * height < ParallelPixels)
+    {
+        rows(0, height);
+        return;
+    }
+
+    TaskScheduler::shared().parallelFor(bands, band);
+}
+
+void scalePlane(const PlaneJob& job, ScaleFilter filter)
+{
+    const auto tables { planeTables(job, filter) };
+
+    runBands(job.targetWidth, job.targetHeight, [&](LONG first, LONG last) {
+        auto scratch { scratchRow(job, tables) };
+        std::vector<const BYTE*> taps(tables.rows->taps);
+
+        for (auto y = first; y < last; ++y)
+        {
+            scaleRow(job, tables, y, taps.data(), scratch.data(), job.target + static_cast<ptrdiff_t>(y) * job.targetStride);
+        }
+    });
+}
+
+void convertPixel(int luma, int blue, int red, BYTE * output)
+{
+    const auto y { (luma - 16) * LumaScale + ColourRound };
+    output[0] = clampByte((y + (blue - 128) * BlueFromU) >> ColourBits);
+    output[1] = clampByte((y - (blue - 128) * GreenFromU - (red - 128) * GreenFromV) >> ColourBits);
+    output[2] = clampByte((y + (red - 128) * RedFromV) >> ColourBits);
+    output[3] = 255;
+}
+
+// BT.601 studio range to BGRA, eight pixels per step. Each channel is one
+// multiply-add of a luma pair and one of a chroma pair into 32 bits, then
+// packed down with saturation.
+void convertRow(const BYTE * luma, const BYTE * blue, const BYTE * red, BYTE * output, LONG width)
+{
+    const short lumaWeights[] { LumaScale, ColourRound };
+    const short blueWeights[] { BlueFromU, 0 };
+    const short greenWeights[] { static_cast<short>(-GreenFromU), static_cast<short>(-GreenFromV) };
+    const short redWeights[] { 0, RedFromV };
+
+    const auto zero { _mm_setzero_si128() };
+    const auto one { _mm_set1_epi16(1) };
+    const auto opaque { _mm_set1_epi8(static_cast<char>(255)) };
+    const auto lumaPair { _mm_set1_epi32(weightPair(lumaWeights)) };
+    const auto bluePair { _mm_set1_epi32(weightPair(blueWeights)) };
+    const auto greenPair { _mm_set1_epi32(weightPair(greenWeights)) };
+    const auto redPair { _mm_set1_epi32(weightPair(redWeights)) };
+    LONG x { 0 };
+
+    const auto widen = [&](const BYTE * samples, short offset) {
+        return _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples)), zero), _mm_set1_epi16(offset));
+    };
+
+    const auto channel = [&](__m128i lumaLow, __m128i lumaHigh, __m128i chromaLow, __m128i chromaHigh, __m128i pair) {
+        const auto low { _mm_srai_epi32(_mm_add_epi32(lumaLow, _mm_madd_epi16(chromaLow, pair)), ColourBits) };
+        const auto high { _mm_srai_epi32(_mm_add_epi32(lumaHigh, _mm_madd_epi16(chromaHigh, pair)), ColourBits) };
+        return _mm_packus_epi16(_mm_packs_epi32(low, high), zero);
+    };
+
+    for (; x + 8 <= width; x += 8)
+    {
+        const auto y { widen(luma + x, 16) };
+        const auto u { widen(blue + x, 128) };
+        const auto v { widen(red + x, 128) };
+
+        const auto lumaLow { _mm_madd_epi16(_mm_unpacklo_epi16(y, one), lumaPair) };
+        const auto lumaHigh { _mm_madd_epi16(_mm_unpackhi_epi16(y, one), lumaPair) };
+        const auto chromaLow { _mm_unpacklo_epi16(u, v) };
+        const auto chromaHigh { _mm_unpackhi_epi16(u, v) };
+
+        const auto blueGreen { _mm_unpacklo_epi8(channel(lumaLow, lumaHigh, chromaLow, chromaHigh, bluePair), channel(lumaLow, lumaHigh, chromaLow, chromaHigh, greenPair)) };
+        const auto redAlpha { _mm_unpacklo_epi8(channel(lumaLow, lumaHigh, chromaLow, chromaHigh, redPair), opaque) };
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x * 4), _mm_unpacklo_epi16(blueGreen, redAlpha));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x * 4 + 16), _mm_unpackhi_epi16(blueGreen, redAlpha));
+    }
+
+    for (; x < width; ++x)
+    {
+        convertPixel(luma[x], blue[x], red[x], output + x * 4);
+    }
+}
+
+// Scales all three planes straight to the output size and converts each
+// output row as soon as it is ready, so no full size intermediate frame is
+// ever written. Chroma is scaled from its own resolution to the full output
+// resolution, which folds the 4:2:0 upsampling into the same filter pass.
+void scaleConvert(const Image& source, const Image& destination, ScaleFilter filter)
+{
+    PlaneJob jobs[3];
+    PlaneTables tables[3];
+
+    for (auto plane = 0; plane < 3; ++plane)
+    {
+        const auto shift { plane == 0 ? 0 : 1 };
+        jobs[plane] = { source.planes[plane], source.strides[plane], (source.width + shift) >> shift, (source.height + shift) >> shift,
+            nullptr, 0, destination.width, destination.height, 1 };
+        tables[plane] = planeTables(jobs[plane], filter);
+    }
+
+    runBands(destination.width, destination.height, [&](LONG first, LONG last) {
+        std::vector<BYTE> scratch[3];
+        std::vector<BYTE> lines[3];
+        std::vector<const BYTE*> taps(std::max(tables[0].rows->taps, tables[1].rows->taps));
+
+        for (auto plane = 0; plane < 3; ++plane)
+        {
+            scratch[plane] = scratchRow(jobs[plane], tables[plane]);
+            lines[plane].resize(destination.width);
+        }
+
+        for (auto y = first; y < last; ++y)
+        {
+            for (auto plane = 0; plane < 3; ++plane)
+            {
+                scaleRow(jobs[plane], tables[plane], y, taps.data(), scratch[plane].data(), lines[plane].data());
+            }
+
+            convertRow(lines[0].data(), lines[1].data(), lines[2].data(), destination.planes[0] + static_cast<ptrdiff_t>(y) * destination.strides[0], destination.width);
+        }
+    });
+}
+
+const BYTE * imageRow(const Image& image, int plane, LONG y)
+{
+    return image.planes[plane] + static_cast<ptrdiff_t>(y) * image.strides[plane];
+}
+
+// Converting at the same size samples chroma at the nearest point instead of
+// running the scaling filter, as most fast YUV paths do. step is 2 for the
+// interleaved NV12 chroma plane.
+void expandChroma(const BYTE * chroma, int step, BYTE * output, LONG width)
+{
+    for (LONG x = 0; x < width; ++x)
+    {
+        output[x] = chroma[(x >> 1) * step];
+    }
+}
+
+void opaqueRow(const BYTE * input, BYTE * output, LONG width)
+{
+    const auto alpha { _mm_set1_epi32(static_cast<int>(0xFF000000U)) };
+    LONG x { 0 };
+
+    for (; x + 4 <= width; x += 4)
+    {
+        const auto pixels { _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + x * 4)) };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + x * 4), _mm_or_si128(pixels, alpha));
+    }
+
+    for (; x < width; ++x)
+    {
+        std::memcpy(output + x * 4, input + x * 4, 3);
+        output[x * 4 + 3] = 255;
+    }
+}
+
+void splitChroma(const BYTE * interleaved, BYTE * blue, BYTE * red, LONG pairs)
+{
+    const auto low { _mm_set1_epi16(0xFF) };
+    LONG x { 0 };
+
+    for (; x + 8 <= pairs; x += 8)
+    {
+        const auto samples { _mm_loadu_si128(reinterpret_cast<const __m128i*>(interleaved + x * 2)) };
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(blue + x), _mm_packus_epi16(_mm_and_si128(samples, low), low));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(red + x), _mm_packus_epi16(_mm_srli_epi16(samples, 8), low));
+    }
+
+    for (; x < pairs; ++x)
+    {
+        blue[x] = interleaved[x * 2];
+        red[x] = interleaved[x * 2 + 1];
+    }
+}
+
+void mergeChroma(const BYTE * blue, const BYTE * red, BYTE * interleaved, LONG pairs)
+{
+    LONG x { 0 };
+
+    for (; x + 8 <= pairs; x += 8)
+    {
+        const auto u { _mm_loadl_epi64(reinterpret_cast<const __m128i*>(blue + x)) };
+        const auto v { _mm_loadl_epi64(reinterpret_cast<const __m128i*>(red + x)) };
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(interleaved + x * 2), _mm_unpacklo_epi8(u, v));
+    }
+
+    for (; x < pairs; ++x)
+    {
+        interleaved[x * 2] = blue[x];
+        interleaved[x * 2 + 1] = red[x];
+    }
+}
+
+// Writes one output row, plus the chroma row it shares with the next one
+// when y is even. Bands start on even rows, so no two workers ever write
+// the same chroma row.
+void convertImageRow(const Image& source, const Image& destination, LONG y, BYTE * blue, BYTE * red)
+{
+    const auto width { source.width };
+    const auto pairs { (width + 1) / 2 };
+    const auto output { destination.planes[0] + static_cast<ptrdiff_t>(y) * destination.strides[0] };
+
+    if (destination.format == PixelFormat::Bgra)
+    {
+        if (source.format == PixelFormat::Bgra)
+        {
+            opaqueRow(imageRow(source, 0, y), output, width);
+            return;
+        }
+
+        const auto interleaved { source.format == PixelFormat::Nv12 };
+        expandChroma(imageRow(source, 1, y / 2), interleaved ? 2 : 1, blue, width);
+        expandChroma(interleaved ? imageRow(source, 1, y / 2) + 1 : imageRow(source, 2, y / 2), interleaved ? 2 : 1, red, width);
+        convertRow(imageRow(source, 0, y), blue, red, output, width);
+        return;
+    }
+
+    std::memcpy(output, imageRow(source, 0, y), width);
+
+    if (y % 2 != 0)
+    {
+        return;
+    }
+
+    const auto chromaRow { y / 2 };
+    const auto chroma { destination.planes[1] + static_cast<ptrdiff_t>(chromaRow) * destination.strides[1] };
+
+    if (source.format == destination.format)
+    {
+        std::memcpy(chroma, imageRow(source, 1, chromaRow), source.format == PixelFormat::Nv12 ? pairs * 2 : pairs);
+
+        if (source.format == PixelFormat::I420)
+        {
+            std::memcpy(destination.planes[2] + static_cast<ptrdiff_t>(chromaRow) * destination.strides[2], imageRow(source, 2, chromaRow), pairs);
+        }
+    }
+    else if (source.format == PixelFormat::Nv12)
+    {
+        splitChroma(imageRow(source, 1, chromaRow), chroma, destination.planes[2] + static_cast<ptrdiff_t>(chromaRow) * destination.strides[2], pairs);
+    }
+    else
+    {
+        mergeChroma(imageRow(source, 1, chromaRow), imageRow(source, 2, chromaRow), chroma, pairs);
+    }
+}
+
+// A single pass between formats at the same size: a copy, a chroma reshuffle
+// between I420 and NV12, or YUV to opaque BGRA. BGRA copies get their alpha
+// set since decoders leave that byte undefined. Nothing converts to YUV.
+bool wpl::convertImage(const Image& source, const Image& destination)
+{
+    if (source.width != destination.width || source.height != destination.height || source.width <= 0 || source.height <= 0 ||
+        (source.format == PixelFormat::Bgra && destination.format != PixelFormat::Bgra))
+    {
+        return false;
+    }
+
+    runBands(source.width, source.height, [&](LONG first, LONG last) {
+        std::vector<BYTE> blue(destination.format == PixelFormat::Bgra ? source.width : 0);
+        std::vector<BYTE> red(blue.size());
+
+        for (auto y = first; y < last; ++y)
+        {
+            convertImageRow(source, destination, y, blue.data(), red.data());
+        }
+    });
+
+    return true;
+}
+
+bool wpl::scaleImage(const Image& source, const Image& destination, ScaleFilter filter)
+{
+    const auto converting { source.format == PixelFormat::I420 && destination.format == PixelFormat::Bgra };
+
+    // NV12 frames only come from decoders and are converted with
+    // convertImage; the filters here work on separate planes.
+    if (source.format == PixelFormat::Nv12 || destination.format == PixelFormat::Nv12)
+    {
+        return false;
+    }
+
+    if ((source.format != destination.format && !converting) || source.width <= 0 || source.height <= 0 || destination.width <= 0 || destination.height <= 0)
+    {
+        return false;
+    }
+
+    if (converting)
+    {
+        scaleConvert(source, destination, filter);
+        return true;
+    }
+
+    if (source.format == PixelFormat::Bgra)
+    {
+        scalePlane({ source.planes[0], source.strides[0], source.width, source.height,
+            destination.planes[0], destination.strides[0], destination.width, destination.height, 4 }, filter);
+        return true;
+    }
+
+    for (auto plane = 0; plane < 3; ++plane)
+    {
+        const auto shift { plane == 0 ? 0 : 1 };
+
+        scalePlane({ source.planes[plane], source.strides[plane], (source.width + shift) >> shift, (source.height + shift) >> shift,
+            destination.planes[plane], destination.strides[plane], (destination.width + shift) >> shift, (destination.height + shift) >> shift, 1 }, filter);
+    }
+
+    return true;
+}
+
+bool wpl::scaleFrame(const VideoFrame& source, VideoFrame * destination, LONG width, LONG height, ScaleFilter filter)
+{
+    if (source.stride < source.width * 4 || source.pixels.size() < static_cast<size_t>(source.stride) * std::abs(source.height))
+    {
+        return false;
+    }
+
+    destination->stream = source.stream;
+    destination->pts = source.pts;
+    destination->duration = source.duration;
+    destination->width = width;
+    destination->height = height;
+    destination->stride = width * 4;
+    destination->keyFrame = source.keyFrame;
+    destination->pixels.resize(static_cast<size_t>(destination->stride) * std::max<LONG>(height, 0));
+
+    const Image input { PixelFormat::Bgra, source.width, std::abs(source.height), { const_cast<BYTE*>(source.pixels.data()) }, { source.stride } };
+    const Image output { PixelFormat::Bgra, width, height, { destination->pixels.data() }, { destination->stride } };
+    return scaleImage(input, output, filter);
+}
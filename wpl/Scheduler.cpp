@@ -0,0 +1,241 @@
+#include <algorithm>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto MinimumWorkers {size_t(2)};
+
+thread_local const TaskScheduler * currentScheduler { nullptr };
+thread_local size_t currentWorker { 0 };
+
+struct ParallelWork
+{
+    const std::function<void(size_t)> * work;
+    size_t count;
+    std::atomic<size_t> next;
+    std::mutex lock;
+    std::condition_variable finished;
+    size_t completed;
+};
+
+void runClaimed(ParallelWork& shared)
+{
+    for (auto item = shared.next++; item < shared.count; item = shared.next++)
+    {
+        (*shared.work)(item);
+
+        std::lock_guard<std::mutex> guard(shared.lock);
+
+        if (++shared.completed == shared.count)
+        {
+            shared.finished.notify_all();
+        }
+    }
+}
+
+TaskScheduler::TaskScheduler(size_t threads)
+    : sequence(0), pending(0), nextQueue(0), stopping(false), schedulerStats()
+{
+    const auto count { threads > 0 ? threads : std::max<size_t>(std::thread::hardware_concurrency(), MinimumWorkers) };
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        queues.emplace_back(new TaskQueue());
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        workers.emplace_back([this, i]() { run(i); });
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(wakeLock);
+        stopping = true;
+    }
+
+    wake.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// Foreground work always goes first, then the earliest deadline, then
+// submission order so equal deadlines stay first in first out.
+bool TaskScheduler::runsBefore(const Task& first, const Task& second)
+{
+    if (first.priority != second.priority)
+    {
+        return first.priority == TaskPriority::Foreground;
+    }
+
+    return first.deadline != second.deadline ? first.deadline < second.deadline : first.sequence < second.sequence;
+}
+
+void TaskScheduler::enqueue(std::function<void()> work, std::chrono::steady_clock::time_point deadline, TaskPriority priority)
+{
+    // Work submitted from inside a task stays on that worker's queue, where
+    // it is likely to find its data still in cache; everything else is
+    // spread round robin and picked up by whichever worker is idle. A task
+    // must therefore never block on the future of work it submitted, since
+    // only a steal by an idle worker could ever complete it.
+    const auto target { currentScheduler == this ? currentWorker : nextQueue++ % queues.size() };
+    auto& queue { *queues[target] };
+
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back({ std::move(work), deadline, priority, sequence++ });
+        std::push_heap(queue.tasks.begin(), queue.tasks.end(), [](const Task& first, const Task& second) { return runsBefore(second, first); });
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(wakeLock);
+        ++pending;
+    }
+
+    wake.notify_one();
+}
+
+bool TaskScheduler::take(size_t worker, Task * task)
+{
+    const auto laterTask = [](const Task& first, const Task& second) { return runsBefore(second, first); };
+
+    for (;;)
+    {
+        // Peek at every queue head, starting with our own, so an idle worker
+        // steals the most urgent task rather than the nearest one and a busy
+        // worker never runs its own background task ahead of foreground work.
+        auto best { queues.size() };
+        Task bestHead {};
+
+        for (size_t i = 0; i < queues.size(); ++i)
+        {
+            const auto index { (worker + i) % queues.size() };
+            std::lock_guard<std::mutex> guard(queues[index]->lock);
+            const auto& tasks { queues[index]->tasks };
+
+            if (!tasks.empty() && (best == queues.size() || runsBefore(tasks.front(), bestHead)))
+            {
+                best = index;
+                bestHead = { nullptr, tasks.front().deadline, tasks.front().priority, tasks.front().sequence };
+            }
+        }
+
+        if (best == queues.size())
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(queues[best]->lock);
+        auto& tasks { queues[best]->tasks };
+
+        if (tasks.empty() || tasks.front().sequence != bestHead.sequence)
+        {
+            continue;
+        }
+
+        std::pop_heap(tasks.begin(), tasks.end(), laterTask);
+        *task = std::move(tasks.back());
+        tasks.pop_back();
+
+        if (best != worker)
+        {
+            std::lock_guard<std::mutex> statsGuard(statsLock);
+            ++schedulerStats.stolen;
+        }
+
+        return true;
+    }
+}
+
+void TaskScheduler::run(size_t worker)
+{
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    currentScheduler = this;
+    currentWorker = worker;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(wakeLock);
+            wake.wait(lock, [&]() { return stopping || pending > 0; });
+
+            // Queued work is drained before stopping so no future is left
+            // without a result.
+            if (pending == 0)
+            {
+                break;
+            }
+
+            --pending;
+        }
+
+        Task task;
+
+        while (!take(worker, &task))
+        {
+            std::this_thread::yield();
+        }
+
+        const auto late { std::chrono::steady_clock::now() > task.deadline };
+        task.work();
+
+        std::lock_guard<std::mutex> guard(statsLock);
+        ++schedulerStats.completed;
+        schedulerStats.late += late ? 1 : 0;
+    }
+
+    CoUninitialize();
+}
+
+// The caller works through the items alongside the helpers and only waits
+// for items that have been claimed, never for the helpers themselves. A
+// helper that starts late finds nothing left, so calling this from inside a
+// task cannot deadlock even when every worker is busy.
+void TaskScheduler::parallelFor(size_t count, const std::function<void(size_t)>& work)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    const auto shared { std::make_shared<ParallelWork>() };
+    shared->work = &work;
+    shared->count = count;
+    shared->next = 0;
+    shared->completed = 0;
+
+    for (size_t i = 1; i < std::min(count, workers.size()); ++i)
+    {
+        enqueue([shared]() { runClaimed(*shared); }, std::chrono::steady_clock::now(), TaskPriority::Foreground);
+    }
+
+    runClaimed(*shared);
+
+    std::unique_lock<std::mutex> lock(shared->lock);
+    shared->finished.wait(lock, [&]() { return shared->completed == count; });
+}
+
+size_t TaskScheduler::threads() const
+{
+    return workers.size();
+}
+
+SchedulerStats TaskScheduler::stats() const
+{
+    std::lock_guard<std::mutex> guard(statsLock);
+    return schedulerStats;
+}
+
+TaskScheduler& TaskScheduler::shared()
+{
+    // Deliberately never destroyed: joining worker threads while the DLL is
+    // being unloaded deadlocks on the loader lock.
+    static const auto scheduler { new TaskScheduler() };
+    return *scheduler;
+}
@@ -0,0 +1,802 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto SeekIndexExtension {".wplidx"};
+const auto SeekIndexFolder {"WPL\\SeekIndex"};
+const auto SeekIndexMagic {0x58494C57UL};
+const auto SeekIndexVersion {1UL};
+const auto HeaderHashBytes {DWORD(64 * 1024)};
+const auto ScanBlockBytes {DWORD(1024 * 1024)};
+const auto SniffBytes {DWORD(64)};
+const auto MaxAsfHeaderBytes {DWORD(16 * 1024 * 1024)};
+const auto AviKeyFrameFlag {0x10UL};
+const auto AsfDataPacketOffset {50ULL};
+const auto UnitsPerMillisecond {10000LL};
+
+const GUID AsfHeaderObject { 0x75B22630, 0x668E, 0x11CF, { 0xA6, 0xD9, 0x00, 0xAA, 0x00, 0x62, 0xCE, 0x6C } };
+const GUID AsfDataObject { 0x75B22636, 0x668E, 0x11CF, { 0xA6, 0xD9, 0x00, 0xAA, 0x00, 0x62, 0xCE, 0x6C } };
+const GUID AsfSimpleIndexObject { 0x33000890, 0xE5B1, 0x11CF, { 0x89, 0xF4, 0x00, 0xA0, 0xC9, 0x03, 0x49, 0xCB } };
+const GUID AsfFilePropertiesObject { 0x8CABDCA1, 0xA947, 0x11CF, { 0x8E, 0xE4, 0x00, 0xC0, 0x0C, 0x20, 0x53, 0x65 } };
+const GUID AsfStreamPropertiesObject { 0xB7DC0791, 0xA9B7, 0x11CF, { 0x8E, 0xE6, 0x00, 0xC0, 0x0C, 0x20, 0x53, 0x65 } };
+const GUID AsfVideoMedia { 0xBC19EFC0, 0x5B4D, 0x11CF, { 0xA8, 0xFD, 0x00, 0x80, 0x5F, 0x5C, 0x44, 0x2B } };
+
+struct SeekIndexHeader
+{
+    DWORD magic;
+    DWORD version;
+    unsigned long long fileSize;
+    unsigned long long lastWriteTime;
+    unsigned long long headerHash;
+    unsigned long long count;
+};
+
+struct SourceIdentity
+{
+    unsigned long long fileSize;
+    unsigned long long lastWriteTime;
+    unsigned long long headerHash;
+};
+
+struct AsfLayout
+{
+    unsigned long long dataStart;
+    unsigned long long dataEnd;
+    unsigned long long packetCount;
+    unsigned long long preroll;
+    DWORD packetSize;
+    BYTE videoStream;
+};
+
+enum class KeyFrameSniff { AllFrames, Mpeg4, H264, Unknown };
+
+bool readAt(HANDLE file, unsigned long long offset, void * buffer, DWORD size)
+{
+    OVERLAPPED overlapped {};
+    DWORD bytesRead { 0 };
+
+    overlapped.Offset = static_cast<DWORD>(offset);
+    overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    return ReadFile(file, buffer, size, &bytesRead, &overlapped) && bytesRead == size;
+}
+
+template<typename T>
+T readField(const BYTE * data, size_t offset)
+{
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+bool isCancelled(const std::atomic<bool> * cancelled)
+{
+    return cancelled != nullptr && cancelled->load();
+}
+
+unsigned long long hashData(const BYTE * data, size_t size)
+{
+    auto hash { 14695981039346656037ULL };
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+bool readIdentity(HANDLE file, SourceIdentity * identity)
+{
+    LARGE_INTEGER size;
+    FILETIME lastWrite;
+
+    if (!GetFileSizeEx(file, &size) || !GetFileTime(file, nullptr, nullptr, &lastWrite))
+    {
+        return false;
+    }
+
+    const auto hashBytes { static_cast<DWORD>(std::min<LONGLONG>(size.QuadPart, HeaderHashBytes)) };
+    std::vector<BYTE> header(hashBytes);
+
+    if (!readAt(file, 0, header.data(), hashBytes))
+    {
+        return false;
+    }
+
+    identity->fileSize = static_cast<unsigned long long>(size.QuadPart);
+    identity->lastWriteTime = static_cast<unsigned long long>(lastWrite.dwHighDateTime) << 32 | lastWrite.dwLowDateTime;
+    identity->headerHash = hashData(header.data(), header.size());
+    return true;
+}
+
+bool matchesFourcc(const std::string& codec, std::initializer_list<const char*> fourccs)
+{
+    return std::any_of(fourccs.begin(), fourccs.end(), [&](const char * fourcc) {
+        return _stricmp(codec.c_str(), fourcc) == 0;
+    });
+}
+
+KeyFrameSniff sniffFor(const std::string& codec)
+{
+    if (matchesFourcc(codec, { "RGB", "MJPG", "DMB1", "AVRN", "HFYU", "FFV1", "CVID" }))
+    {
+        return KeyFrameSniff::AllFrames;
+    }
+
+    if (matchesFourcc(codec, { "XVID", "DIVX", "DX50", "FMP4", "MP4V", "M4S2" }))
+    {
+        return KeyFrameSniff::Mpeg4;
+    }
+
+    if (matchesFourcc(codec, { "H264", "X264", "AVC1", "DAVC" }))
+    {
+        return KeyFrameSniff::H264;
+    }
+
+    return KeyFrameSniff::Unknown;
+}
+
+bool isKeyFramePayload(const BYTE * data, size_t size, KeyFrameSniff sniff)
+{
+    for (size_t i = 0; i + 4 < size; ++i)
+    {
+        if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+        {
+            continue;
+        }
+
+        const auto code { data[i + 3] };
+
+        if (sniff == KeyFrameSniff::Mpeg4 && code == 0xB6)
+        {
+            return (data[i + 4] >> 6) == 0;
+        }
+
+        if (sniff == KeyFrameSniff::H264 && (code & 0x1F) >= 1 && (code & 0x1F) <= 5)
+        {
+            return (code & 0x1F) == 5;
+        }
+    }
+
+    return false;
+}
+
+REFERENCE_TIME frameTime(unsigned long long frame, double frameRate)
+{
+    return static_cast<REFERENCE_TIME>(std::llround(frame * 10000000.0 / frameRate));
+}
+
+bool buildAviIndex(HANDLE file, const SourceIdentity& identity, const std::string& filename, const std::atomic<bool> * cancelled, std::vector<SeekPoint>& points)
+{
+    MediaInfo mediaInfo;
+
+    if (!probe(filename, &mediaInfo) || mediaInfo.container != ContainerType::Avi)
+    {
+        return false;
+    }
+
+    const auto video = std::find_if(mediaInfo.streams.begin(), mediaInfo.streams.end(), [](const StreamInfo& stream) {
+        return stream.type == StreamType::Video;
+    });
+
+    if (video == mediaInfo.streams.end() || video->frameRate <= 0.0)
+    {
+        return false;
+    }
+
+    const auto streamNumber { static_cast<int>(video - mediaInfo.streams.begin()) };
+    const char streamId[2] { static_cast<char>('0' + streamNumber / 10), static_cast<char>('0' + streamNumber % 10) };
+    const auto sniff { sniffFor(video->codec) };
+
+    const auto isVideoChunk = [&](const BYTE * id) {
+        return id[0] == streamId[0] && id[1] == streamId[1] && (id[2] == 'd' || id[2] == 'D');
+    };
+
+    std::vector<std::pair<unsigned long long, unsigned long long>> movieLists;
+    unsigned long long indexStart { 0 }, indexSize { 0 };
+
+    for (unsigned long long riff = 0; riff + 12 <= identity.fileSize;)
+    {
+        BYTE riffHeader[12];
+
+        if (!readAt(file, riff, riffHeader, sizeof(riffHeader)) || std::memcmp(riffHeader, "RIFF", 4) != 0)
+        {
+            break;
+        }
+
+        const auto riffEnd { std::min(identity.fileSize, riff + 8 + readField<DWORD>(riffHeader, 4)) };
+
+        for (auto chunk = riff + 12; chunk + 12 <= riffEnd;)
+        {
+            BYTE chunkHeader[12];
+
+            if (!readAt(file, chunk, chunkHeader, sizeof(chunkHeader)))
+            {
+                break;
+            }
+
+            const auto chunkSize { readField<DWORD>(chunkHeader, 4) };
+
+            if (std::memcmp(chunkHeader, "LIST", 4) == 0 && std::memcmp(chunkHeader + 8, "movi", 4) == 0)
+            {
+                movieLists.emplace_back(chunk + 8, std::min(riffEnd, chunk + 8 + chunkSize));
+            }
+            else if (std::memcmp(chunkHeader, "idx1", 4) == 0 && riff == 0)
+            {
+                indexStart = chunk + 8;
+                indexSize = chunkSize;
+            }
+
+            chunk += 8 + chunkSize + (chunkSize & 1);
+        }
+
+        riff = riffEnd + (riffEnd & 1);
+    }
+
+    if (movieLists.empty())
+    {
+        return false;
+    }
+
+    if (movieLists.size() == 1 && indexSize >= 16)
+    {
+        std::vector<BYTE> entries(static_cast<size_t>(std::min<unsigned long long>(indexSize, identity.fileSize - indexStart)) / 16 * 16);
+        unsigned long long frame { 0 };
+
+        if (!entries.empty() && readAt(file, indexStart, entries.data(), static_cast<DWORD>(entries.size())))
+        {
+            const auto moviStart { movieLists.front().first };
+            const auto relative { readField<DWORD>(entries.data(), 8) < moviStart };
+
+            for (size_t entry = 0; entry < entries.size(); entry += 16)
+            {
+                if (!isVideoChunk(&entries[entry]))
+                    continue;
+
+                const auto offset { readField<DWORD>(entries.data(), entry + 8) + (relative ? moviStart : 0) };
+
+                if (readField<DWORD>(entries.data(), entry + 4) & AviKeyFrameFlag)
+                {
+                    points.push_back({ frameTime(frame, video->frameRate), offset });
+                }
+
+                ++frame;
+            }
+        }
+
+        if (!points.empty())
+        {
+            return true;
+        }
+    }
+
+    if (sniff == KeyFrameSniff::Unknown)
+    {
+        return false;
+    }
+
+    unsigned long long frame { 0 };
+
+    for (const auto& movieList : movieLists)
+    {
+        for (auto chunk = movieList.first + 4; chunk + 8 <= movieList.second;)
+        {
+            BYTE chunkHeader[8 + SniffBytes];
+            const auto headerBytes { static_cast<DWORD>(std::min<unsigned long long>(sizeof(chunkHeader), identity.fileSize - chunk)) };
+
+            if (isCancelled(cancelled) || !readAt(file, chunk, chunkHeader, headerBytes))
+            {
+                return false;
+            }
+
+            const auto chunkSize { readField<DWORD>(chunkHeader, 4) };
+
+            if (std::memcmp(chunkHeader, "LIST", 4) == 0)
+            {
+                chunk += 12;
+                continue;
+            }
+
+            if (isVideoChunk(chunkHeader))
+            {
+                const auto payload { std::min<size_t>(chunkSize, headerBytes - 8) };
+                const auto keyFrame { sniff == KeyFrameSniff::AllFrames || chunkHeader[3] == 'b' || isKeyFramePayload(chunkHeader + 8, payload, sniff) };
+
+                if (keyFrame && chunkSize > 0)
+                {
+                    points.push_back({ frameTime(frame, video->frameRate), chunk });
+                }
+
+                ++frame;
+            }
+
+            chunk += 8 + chunkSize + (chunkSize & 1);
+        }
+    }
+
+    return !points.empty();
+}
+
+bool readAsfLength(const BYTE *& data, const BYTE * end, int lengthType, DWORD * value)
+{
+    const auto bytes { lengthType == 3 ? 4 : lengthType };
+
+    if (end - data < bytes)
+    {
+        return false;
+    }
+
+    *value = bytes == 1 ? *data : bytes == 2 ? readField<WORD>(data, 0) : bytes == 4 ? readField<DWORD>(data, 0) : 0;
+    data += bytes;
+    return true;
+}
+
+bool findAsfKeyFrame(const BYTE * packet, size_t size, const AsfLayout& layout, REFERENCE_TIME * time)
+{
+    const auto end { packet + size };
+    auto data { packet };
+
+    if (size < 2)
+    {
+        return false;
+    }
+
+    if (*data & 0x80)
+    {
+        data += 1 + (*data & 0x0F);
+    }
+
+    if (end - data < 2)
+    {
+        return false;
+    }
+
+    const auto lengthFlags { *data++ };
+    const auto propertyFlags { *data++ };
+    DWORD packetLength { 0 }, sequence { 0 }, padding { 0 };
+
+    if (!readAsfLength(data, end, lengthFlags >> 5 & 3, &packetLength) ||
+        !readAsfLength(data, end, lengthFlags >> 1 & 3, &sequence) ||
+        !readAsfLength(data, end, lengthFlags >> 3 & 3, &padding) || end - data < 6)
+    {
+        return false;
+    }
+
+    data += 6;
+
+    const auto multiple { (lengthFlags & 1) != 0 };
+    auto payloads { 1 }, payloadLengthType { 0 };
+
+    if (multiple)
+    {
+        if (data == end)
+            return false;
+
+        payloads = *data & 0x3F;
+        payloadLengthType = *data++ >> 6;
+    }
+
+    for (auto payload = 0; payload < payloads; ++payload)
+    {
+        if (data == end)
+            return false;
+
+        const auto streamNumber { *data++ };
+        DWORD objectNumber { 0 }, objectOffset { 0 }, replicatedLength { 0 }, payloadLength { 0 };
+
+        if (!readAsfLength(data, end, propertyFlags >> 4 & 3, &objectNumber) ||
+            !readAsfLength(data, end, propertyFlags >> 2 & 3, &objectOffset) ||
+            !readAsfLength(data, end, propertyFlags & 3, &replicatedLength) ||
+            static_cast<size_t>(end - data) < replicatedLength)
+        {
+            return false;
+        }
+
+        const auto replicated { data };
+        data += replicatedLength;
+
+        if (multiple && !readAsfLength(data, end, payloadLengthType, &payloadLength))
+        {
+            return false;
+        }
+
+        const auto isVideo { (streamNumber & 0x7F) == layout.videoStream };
+        const auto isKeyFrame { (streamNumber & 0x80) != 0 && (replicatedLength == 1 || objectOffset == 0) };
+
+        if (isVideo && isKeyFrame && (replicatedLength == 1 || replicatedLength >= 8))
+        {
+            const auto presentation { replicatedLength == 1 ? objectOffset : readField<DWORD>(replicated, 4) };
+            *time = (static_cast<REFERENCE_TIME>(presentation) - static_cast<REFERENCE_TIME>(layout.preroll)) * UnitsPerMillisecond;
+            return true;
+        }
+
+        if (!multiple || static_cast<size_t>(end - data) < payloadLength)
+        {
+            return false;
+        }
+
+        data += payloadLength;
+    }
+
+    return false;
+}
+
+bool readAsfLayout(HANDLE file, const SourceIdentity& identity, AsfLayout * layout, unsigned long long * indexObject)
+{
+    BYTE prefix[30];
+
+    if (!readAt(file, 0, prefix, sizeof(prefix)) || std::memcmp(prefix, &AsfHeaderObject, sizeof(GUID)) != 0)
+    {
+        return false;
+    }
+
+    const auto headerSize { readField<unsigned long long>(prefix, 16) };
+
+    if (headerSize < sizeof(prefix) || headerSize > MaxAsfHeaderBytes || headerSize + AsfDataPacketOffset > identity.fileSize)
+    {
+        return false;
+    }
+
+    std::vector<BYTE> header(static_cast<size_t>(headerSize));
+    *layout = {};
+
+    if (!readAt(file, 0, header.data(), static_cast<DWORD>(headerSize)))
+    {
+        return false;
+    }
+
+    for (size_t object = sizeof(prefix); object + 24 <= header.size();)
+    {
+        const auto objectSize { readField<unsigned long long>(header.data(), object + 16) };
+
+        if (objectSize < 24 || objectSize > header.size() - object)
+        {
+            break;
+        }
+
+        const auto guid { header.data() + object };
+
+        if (std::memcmp(guid, &AsfFilePropertiesObject, sizeof(GUID)) == 0 && objectSize >= 104)
+        {
+            layout->preroll = readField<unsigned long long>(guid, 80);
+            layout->packetSize = readField<DWORD>(guid, 92);
+        }
+        else if (std::memcmp(guid, &AsfStreamPropertiesObject, sizeof(GUID)) == 0 && objectSize >= 78 &&
+            std::memcmp(guid + 24, &AsfVideoMedia, sizeof(GUID)) == 0 && layout->videoStream == 0)
+        {
+            layout->videoStream = readField<WORD>(guid, 72) & 0x7F;
+        }
+
+        object += static_cast<size_t>(objectSize);
+    }
+
+    BYTE dataHeader[AsfDataPacketOffset];
+
+    if (layout->packetSize == 0 || layout->videoStream == 0 ||
+        !readAt(file, headerSize, dataHeader, sizeof(dataHeader)) || std::memcmp(dataHeader, &AsfDataObject, sizeof(GUID)) != 0)
+    {
+        return false;
+    }
+
+    const auto dataSize { readField<unsigned long long>(dataHeader, 16) };
+
+    layout->dataStart = headerSize + AsfDataPacketOffset;
+    layout->dataEnd = std::min(identity.fileSize, headerSize + dataSize);
+    layout->packetCount = (layout->dataEnd - std::min(layout->dataEnd, layout->dataStart)) / layout->packetSize;
+    *indexObject = 0;
+
+    for (auto object = headerSize + dataSize; dataSize >= AsfDataPacketOffset && object + 24 <= identity.fileSize;)
+    {
+        BYTE objectHeader[24];
+
+        if (!readAt(file, object, objectHeader, sizeof(objectHeader)))
+        {
+            break;
+        }
+
+        if (std::memcmp(objectHeader, &AsfSimpleIndexObject, sizeof(GUID)) == 0)
+        {
+            *indexObject = object;
+            break;
+        }
+
+        const auto objectSize { readField<unsigned long long>(objectHeader, 16) };
+        object = objectSize < 24 ? identity.fileSize : object + objectSize;
+    }
+
+    return true;
+}
+
+bool buildAsfIndex(HANDLE file, const SourceIdentity& identity, const std::atomic<bool> * cancelled, std::vector<SeekPoint>& points)
+{
+    AsfLayout layout;
+    unsigned long long indexObject { 0 };
+
+    if (!readAsfLayout(file, identity, &layout, &indexObject))
+    {
+        return false;
+    }
+
+    std::vector<BYTE> packet(layout.packetSize);
+    REFERENCE_TIME time { 0 };
+
+    const auto addPacket = [&](unsigned long long packetNumber, const BYTE * data) {
+        if (findAsfKeyFrame(data, layout.packetSize, layout, &time) && (points.empty() || time > points.back().time))
+        {
+            points.push_back({ time, layout.dataStart + packetNumber * layout.packetSize });
+        }
+    };
+
+    BYTE indexHeader[56];
+
+    if (indexObject != 0 && readAt(file, indexObject, indexHeader, sizeof(indexHeader)))
+    {
+        const auto entryCount { std::min<unsigned long long>(readField<DWORD>(indexHeader, 52), (identity.fileSize - indexObject - sizeof(indexHeader)) / 6) };
+        std::vector<BYTE> entries(static_cast<size_t>(entryCount * 6));
+        auto lastPacket { ~0ULL };
+
+        if (!entries.empty() && readAt(file, indexObject + sizeof(indexHeader), entries.data(), static_cast<DWORD>(entries.size())))
+        {
+            for (size_t entry = 0; entry < entries.size(); entry += 6)
+            {
+                const auto packetNumber { static_cast<unsigned long long>(readField<DWORD>(entries.data(), entry)) };
+
+                if (packetNumber == lastPacket || packetNumber >= layout.packetCount)
+                    continue;
+
+                if (isCancelled(cancelled) || !readAt(file, layout.dataStart + packetNumber * layout.packetSize, packet.data(), layout.packetSize))
+                    return false;
+
+                addPacket(packetNumber, packet.data());
+                lastPacket = packetNumber;
+            }
+        }
+
+        if (!points.empty())
+        {
+            return true;
+        }
+    }
+
+    const auto packetsPerBlock { std::max<DWORD>(ScanBlockBytes / layout.packetSize, 1) };
+    std::vector<BYTE> block(static_cast<size_t>(packetsPerBlock) * layout.packetSize);
+
+    for (unsigned long long first = 0; first < layout.packetCount; first += packetsPerBlock)
+    {
+        const auto packets { static_cast<DWORD>(std::min<unsigned long long>(packetsPerBlock, layout.packetCount - first)) };
+
+        if (isCancelled(cancelled) || !readAt(file, layout.dataStart + first * layout.packetSize, block.data(), packets * layout.packetSize))
+        {
+            return false;
+        }
+
+        for (DWORD packetNumber = 0; packetNumber < packets; ++packetNumber)
+        {
+            addPacket(first + packetNumber, &block[static_cast<size_t>(packetNumber) * layout.packetSize]);
+        }
+    }
+
+    return !points.empty();
+}
+
+bool mapCache(const std::string& cacheName, const SourceIdentity& identity, MappedFile& cacheFile)
+{
+    SeekIndexHeader header;
+
+    if (!cacheFile.open(cacheName) || cacheFile.size() < sizeof(header))
+    {
+        cacheFile.close();
+        return false;
+    }
+
+    std::memcpy(&header, cacheFile.data(), sizeof(header));
+
+    const auto valid { header.magic == SeekIndexMagic && header.version == SeekIndexVersion &&
+        header.fileSize == identity.fileSize && header.lastWriteTime == identity.lastWriteTime &&
+        header.headerHash == identity.headerHash && header.count > 0 &&
+        cacheFile.size() == sizeof(header) + header.count * sizeof(SeekPoint) };
+
+    if (!valid)
+    {
+        cacheFile.close();
+    }
+
+    return valid;
+}
+
+// Creates WPL and WPL\SeekIndex under the app data folder on first use.
+// Another process may be creating them at the same time.
+bool createCacheFolder(const std::string& cacheName)
+{
+    const auto folder { cacheName.substr(0, cacheName.find_last_of('\\')) };
+    const auto parent { folder.substr(0, folder.find_last_of('\\')) };
+
+    for (const auto& path : { parent, folder })
+    {
+        if (!CreateDirectoryA(path.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool writeCache(const std::string& cacheName, const SourceIdentity& identity, const SeekPoint * points, size_t count)
+{
+    const SeekIndexHeader header { SeekIndexMagic, SeekIndexVersion, identity.fileSize, identity.lastWriteTime, identity.headerHash, count };
+    const auto temporaryName { cacheName + ".tmp" };
+
+    if (!createCacheFolder(cacheName))
+    {
+        return false;
+    }
+    const auto file { CreateFileA(temporaryName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    DWORD written { 0 };
+    const auto bytes { static_cast<DWORD>(count * sizeof(SeekPoint)) };
+
+    auto saved { WriteFile(file, &header, sizeof(header), &written, nullptr) && written == sizeof(header) };
+    saved = saved && WriteFile(file, points, bytes, &written, nullptr) && written == bytes;
+
+    CloseHandle(file);
+
+    if (!saved || !MoveFileExA(temporaryName.c_str(), cacheName.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(temporaryName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+SeekIndex::SeekIndex()
+    : points(nullptr), count(0), cached(false)
+{
+}
+
+SeekIndex::SeekIndex(SeekIndex&& other)
+    : SeekIndex()
+{
+    *this = std::move(other);
+}
+
+SeekIndex& SeekIndex::operator=(SeekIndex&& other)
+{
+    std::swap(cacheFile, other.cacheFile);
+    std::swap(builtPoints, other.builtPoints);
+    std::swap(points, other.points);
+    std::swap(count, other.count);
+    std::swap(cached, other.cached);
+    return *this;
+}
+
+// Sidecars live in the user's local app data rather than next to the media,
+// which may be read only or on a share. They are named after a hash of the
+// full path, case folded the way Windows compares paths.
+std::string SeekIndex::cachePath(const std::string& filename)
+{
+    char fullPath[MAX_PATH];
+    char folder[MAX_PATH];
+
+    const auto pathLength { GetFullPathNameA(filename.c_str(), MAX_PATH, fullPath, nullptr) };
+    auto folderLength { GetEnvironmentVariableA("LOCALAPPDATA", folder, MAX_PATH) };
+
+    if (pathLength == 0 || pathLength >= MAX_PATH)
+    {
+        return {};
+    }
+
+    if (folderLength == 0 || folderLength >= MAX_PATH)
+    {
+        folderLength = GetTempPathA(MAX_PATH, folder);
+    }
+
+    if (folderLength == 0 || folderLength >= MAX_PATH)
+    {
+        return {};
+    }
+
+    CharUpperBuffA(fullPath, pathLength);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", hashData(reinterpret_cast<const BYTE*>(fullPath), pathLength));
+
+    const std::string root(folder, folderLength);
+    return root + (root.back() == '\\' ? "" : "\\") + SeekIndexFolder + "\\" + name + SeekIndexExtension;
+}
+
+bool SeekIndex::open(const std::string& filename, const std::atomic<bool> * cancelled)
+{
+    const auto cacheName { cachePath(filename) };
+    const auto file { CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+    SourceIdentity identity;
+
+    clear();
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    if (!readIdentity(file, &identity))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    if (!cacheName.empty() && mapCache(cacheName, identity, cacheFile))
+    {
+        CloseHandle(file);
+        points = reinterpret_cast<const SeekPoint*>(cacheFile.data() + sizeof(SeekIndexHeader));
+        count = (cacheFile.size() - sizeof(SeekIndexHeader)) / sizeof(SeekPoint);
+        cached = true;
+        return true;
+    }
+
+    const auto built { buildAviIndex(file, identity, filename, cancelled, builtPoints) || buildAsfIndex(file, identity, cancelled, builtPoints) };
+
+    CloseHandle(file);
+
+    if (!built)
+    {
+        builtPoints.clear();
+        return false;
+    }
+
+    points = builtPoints.data();
+    count = builtPoints.size();
+
+    if (!cacheName.empty())
+    {
+        writeCache(cacheName, identity, points, count);
+    }
+
+    return true;
+}
+
+void SeekIndex::clear()
+{
+    cacheFile.close();
+    builtPoints.clear();
+    points = nullptr;
+    count = 0;
+    cached = false;
+}
+
+const SeekPoint * SeekIndex::keyFrameBefore(REFERENCE_TIME time) const
+{
+    const auto end { points + count };
+    const auto next = std::upper_bound(points, end, time, [](REFERENCE_TIME value, const SeekPoint& point) {
+        return value < point.time;
+    });
+
+    return next == points ? nullptr : next - 1;
+}
+
+bool SeekIndex::isKeyFrame(REFERENCE_TIME time, REFERENCE_TIME tolerance) const
+{
+    const auto keyFrame { keyFrameBefore(time + tolerance) };
+    return keyFrame != nullptr && time - keyFrame->time <= tolerance;
+}
+
+bool SeekIndex::fromCache() const
+{
+    return cached;
+}
+
+size_t SeekIndex::size() const
+{
+    return count;
+}
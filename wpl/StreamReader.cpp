@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include "WPL.h"
+
+using namespace wpl;
+
+const auto StreamChunkSize {size_t(64) * 1024};
+const auto MinimumStreamBuffer {size_t(1024) * 1024};
+const auto CancelRetry {std::chrono::milliseconds(10)};
+
+StreamReader::StreamReader()
+    : stream(INVALID_HANDLE_VALUE),
+      ringStart(0),
+      ringEnd(0),
+      cursor(0),
+      ended(false),
+      flushing(false),
+      stopping(false),
+      finished(true),
+      readStats()
+{
+}
+
+StreamReader::~StreamReader()
+{
+    close();
+}
+
+// A handle that cannot be read from reports NotFound and a refused ring
+// buffer reports OutOfMemory.
+bool StreamReader::open(HANDLE input, size_t bufferBytes, PlayerError * reason)
+{
+    close();
+
+    if (input == nullptr || input == INVALID_HANDLE_VALUE || (GetFileType(input) == FILE_TYPE_UNKNOWN && GetLastError() != NO_ERROR))
+    {
+        if (reason != nullptr)
+        {
+            *reason = PlayerError::NotFound;
+        }
+
+        return false;
+    }
+
+    const auto granted { MemoryGovernor::shared().reserveBuffer(std::max(bufferBytes, MinimumStreamBuffer), MinimumStreamBuffer) };
+
+    if (granted == 0)
+    {
+        if (reason != nullptr)
+        {
+            *reason = PlayerError::OutOfMemory;
+        }
+
+        return false;
+    }
+
+    ring.resize(granted);
+    readStats.bufferBytes = granted;
+    stream = input;
+    stopping = false;
+    finished = false;
+    worker = std::thread([this]() { fill(); });
+    return true;
+}
+
+void StreamReader::close()
+{
+    std::unique_lock<std::mutex> lock(ringLock);
+    stopping = true;
+    ringChanged.notify_all();
+
+    // A pipe read blocks until the writer sends more data, so keep cancelling
+    // until the worker notices it has been asked to stop.
+    while (!finished)
+    {
+        CancelSynchronousIo(worker.native_handle());
+        ringChanged.wait_for(lock, CancelRetry);
+    }
+
+    lock.unlock();
+
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+
+    MemoryGovernor::shared().releaseBuffer(ring.size());
+    ring.clear();
+    ring.shrink_to_fit();
+    stream = INVALID_HANDLE_VALUE;
+    ringStart = ringEnd = cursor = 0;
+    arrivals.clear();
+    ended = flushing = false;
+    readStats = {};
+}
+
+size_t StreamReader::discardable() const
+{
+    const auto history { ring.size() / 4 };
+    const auto keepFrom { cursor > history ? cursor - history : 0 };
+    return static_cast<size_t>(keepFrom > ringStart ? std::min(keepFrom, ringEnd) - ringStart : 0);
+}
+
+void StreamReader::fill()
+{
+    std::vector<BYTE> chunk(StreamChunkSize);
+    std::unique_lock<std::mutex> lock(ringLock);
+
+    while (!stopping && !ended)
+    {
+        const auto buffered { static_cast<size_t>(ringEnd - ringStart) };
+        const auto space { ring.size() - buffered + discardable() };
+
+        if (space == 0)
+        {
+            ringChanged.wait(lock);
+            continue;
+        }
+
+        const auto wanted { static_cast<DWORD>(std::min(space, chunk.size())) };
+        DWORD bytesRead { 0 };
+
+        lock.unlock();
+        const auto received { ReadFile(stream, chunk.data(), wanted, &bytesRead, nullptr) && bytesRead > 0 };
+        lock.lock();
+
+        if (!received)
+        {
+            ended = true;
+            break;
+        }
+
+        const auto overflow { ringEnd - ringStart + bytesRead };
+        ringStart += overflow > ring.size() ? overflow - ring.size() : 0;
+
+        const auto position { static_cast<size_t>(ringEnd % ring.size()) };
+        const auto firstPart { std::min<size_t>(bytesRead, ring.size() - position) };
+
+        std::memcpy(ring.data() + position, chunk.data(), firstPart);
+        std::memcpy(ring.data(), chunk.data() + firstPart, bytesRead - firstPart);
+
+        ringEnd += bytesRead;
+        readStats.bytesPrefetched += bytesRead;
+        arrivals.emplace_back(ringEnd, std::chrono::steady_clock::now());
+
+        while (!arrivals.empty() && arrivals.front().first <= ringStart)
+        {
+            arrivals.pop_front();
+        }
+
+        ringChanged.notify_all();
+    }
+
+    finished = true;
+    ringChanged.notify_all();
+}
+
+size_t StreamReader::read(unsigned long long offset, size_t length, BYTE * buffer)
+{
+    std::unique_lock<std::mutex> lock(ringLock);
+
+    // Data behind the ring has been discarded and jumps far past the write
+    // position (trailing indexes, seeks) would drain the whole stream, so
+    // both fail instead of blocking.
+    if (ring.empty() || offset < ringStart || offset > ringEnd + ring.size())
+    {
+        return 0;
+    }
+
+    const auto start { std::chrono::steady_clock::now() };
+    const auto wanted { offset + std::min(length, ring.size() / 2) };
+    auto stalled { false };
+
+    cursor = offset;
+    ringChanged.notify_all();
+
+    while (ringEnd < wanted && !ended && !flushing && !stopping)
+    {
+        stalled = true;
+        ringChanged.wait(lock);
+    }
+
+    if (offset < ringStart || offset >= ringEnd)
+    {
+        return 0;
+    }
+
+    const auto bytes { static_cast<size_t>(std::min(wanted, ringEnd) - offset) };
+    const auto position { static_cast<size_t>(offset % ring.size()) };
+    const auto firstPart { std::min(bytes, ring.size() - position) };
+
+    std::memcpy(buffer, ring.data() + position, firstPart);
+    std::memcpy(buffer + firstPart, ring.data(), bytes - firstPart);
+    readStats.bytesRead += bytes;
+
+    // How long the newest byte handed out sat in the ring. Demuxers read a
+    // frame at a time, so this is the source side of each frame's latency.
+    const auto arrival { std::lower_bound(arrivals.begin(), arrivals.end(), offset + bytes, [](const Arrival& received, unsigned long long end) {
+        return received.first < end;
+    }) };
+
+    if (arrival != arrivals.end())
+    {
+        const auto latency { std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - arrival->second).count() / 100 };
+        ++readStats.latencySamples;
+        readStats.lastLatency = latency;
+        readStats.totalLatency += latency;
+        readStats.maxLatency = std::max<REFERENCE_TIME>(readStats.maxLatency, latency);
+    }
+
+    if (stalled)
+    {
+        ++readStats.stalls;
+        readStats.blockedTime += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 100;
+    }
+
+    return bytes;
+}
+
+unsigned long long StreamReader::size() const
+{
+    std::lock_guard<std::mutex> guard(ringLock);
+    return ended ? ringEnd : ringEnd + ring.size();
+}
+
+unsigned long long StreamReader::available() const
+{
+    std::lock_guard<std::mutex> guard(ringLock);
+    return ringEnd;
+}
+
+void StreamReader::setFlushing(bool flush)
+{
+    std::lock_guard<std::mutex> guard(ringLock);
+    flushing = flush;
+    ringChanged.notify_all();
+}
+
+ReadAheadStats StreamReader::stats() const
+{
+    std::lock_guard<std::mutex> guard(ringLock);
+    return readStats;
+}
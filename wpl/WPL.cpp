@@ -1,14 +1,35 @@
 
 #include <functional>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
 #include <fstream>
 #include "WPL.h"
 
+#include <dvdmedia.h>
+#include <evr9.h>
+
+#pragma comment(lib, "mfuuid.lib")
+
 using bool_lambda = std::function<bool()>;
 using void_lambda = std::function<void()>;
 
 const auto EmptyFunction {void_lambda([](){})};
 const auto MajorVersion {2};
 const auto MinorVersion {2};
+const auto HandoffWindow {5000000LL};
+const auto PrerollTimeout {5000L};
+const auto LowLatencyBuffers {2L};
+const auto VideoStream {0};
+const auto DefaultFrameDuration {333333LL};
+const auto MaxGroupOfPictures {600};
+const auto StreamSourceName {L"WPL Stream Source"};
+const auto AudioRendererName {L"Audio Renderer"};
+const auto DispatchWindowClass {L"WPL Dispatch"};
+const auto RevealMessage {UINT(WM_APP + 1)};
+const auto ReverseTimer {UINT_PTR(1)};
+const auto ReverseBufferBytes {size_t(256) * 1024 * 1024};
+const auto UnservedTargetCost {1000};
 
 template<typename T> 
 void safeRelease(T ** comPtr) 
@@ -30,6 +51,16 @@ void safeDelete(T ** savePointer)
     }
 }
 
+struct StreamFormat
+{
+    GUID majorType;
+    GUID subtype;
+    LONG width;
+    LONG height;
+    DWORD samplesPerSecond;
+    WORD channels;
+};
+
 template<typename T>
 bool fileExists(T filename) 
 {
@@ -136,6 +167,43 @@ bool findConnectedPin(IBaseFilter * filter, PIN_DIRECTION PinDir, IPin **ppPin)
     return SUCCEEDED(hr);
 }
 
+bool findUnconnectedPin(IBaseFilter * filter, PIN_DIRECTION direction, IPin ** pin)
+{
+    IEnumPins * enumPins { nullptr };
+    IPin * candidate { nullptr };
+
+    *pin = nullptr;
+
+    if (filter == nullptr || FAILED(filter->EnumPins(&enumPins)))
+    {
+        return false;
+    }
+
+    while (*pin == nullptr && S_OK == enumPins->Next(1, &candidate, nullptr))
+    {
+        IPin * connected { nullptr };
+        BOOL matches { FALSE };
+
+        if (isPinDirection(candidate, direction, &matches) && matches && candidate->ConnectedTo(&connected) == VFW_E_NOT_CONNECTED)
+        {
+            *pin = candidate;
+            (*pin)->AddRef();
+        }
+
+        safeRelease(&connected);
+        candidate->Release();
+    }
+
+    enumPins->Release();
+    return *pin != nullptr;
+}
+
+bool isFilterClass(IBaseFilter * filter, REFCLSID clsid)
+{
+    CLSID filterClass;
+    return filter != nullptr && SUCCEEDED(filter->GetClassID(&filterClass)) && filterClass == clsid;
+}
+
 bool removeUnconnectedRenderer(IGraphBuilder * graphBuilder, IBaseFilter * baseFilter, bool * removed)
 {
     IPin * pinPointer{ nullptr };
@@ -178,6 +246,169 @@ bool addFilterByCLSID(IGraphBuilder *pGraph, REFGUID clsid, IBaseFilter ** baseF
     return async(task, EmptyFunction, [&]() { safeRelease(&filter); });
 }
 
+void freeMediaType(AM_MEDIA_TYPE& mediaType)
+{
+    if (mediaType.cbFormat != 0)
+    {
+        CoTaskMemFree(mediaType.pbFormat);
+        mediaType.cbFormat = 0;
+        mediaType.pbFormat = nullptr;
+    }
+
+    safeRelease(&mediaType.pUnk);
+}
+
+// Decoders list every output type they can produce, often NV12, I420 and
+// RGB32 for the same picture. They are tried cheapest first for the
+// renderers that will share them, falling back to the graph's own choice.
+bool connectCheapestType(IGraphBuilder * graph, IPin * output, IPin * input, const std::function<int(const AM_MEDIA_TYPE&)>& cost)
+{
+    IEnumMediaTypes * enumTypes { nullptr };
+    AM_MEDIA_TYPE * type { nullptr };
+    std::vector<std::pair<int, AM_MEDIA_TYPE*>> candidates;
+    auto hr { E_FAIL };
+
+    if (SUCCEEDED(output->EnumMediaTypes(&enumTypes)))
+    {
+        while (S_OK == enumTypes->Next(1, &type, nullptr))
+        {
+            candidates.emplace_back(type->pbFormat != nullptr ? cost(*type) : -1, type);
+        }
+
+        enumTypes->Release();
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const auto& left, const auto& right) {
+        return left.first >= 0 && (right.first < 0 || left.first < right.first);
+    });
+
+    for (auto& candidate : candidates)
+    {
+        if (FAILED(hr) && candidate.first >= 0)
+        {
+            hr = graph->ConnectDirect(output, input, candidate.second);
+        }
+
+        freeMediaType(*candidate.second);
+        CoTaskMemFree(candidate.second);
+    }
+
+    return SUCCEEDED(hr) || SUCCEEDED(graph->ConnectDirect(output, input, nullptr));
+}
+
+// Splits the decoded stream feeding the primary renderer with an Infinite
+// Pin Tee. Every tee output delivers the same ref-counted sample, so extra
+// renderers cost their own scaling and conversion but never another decode.
+// The decoder's output type is picked again for everything behind the tee
+// when it goes in; targets added once it is there take the type it has.
+bool insertTee(IGraphBuilder * graph, IBaseFilter * renderer, const std::function<int(const AM_MEDIA_TYPE&)>& cost, IBaseFilter ** tee)
+{
+    IPin * rendererPin { nullptr };
+    IPin * upstreamPin { nullptr };
+    IPin * teeInput { nullptr };
+    IPin * teeOutput { nullptr };
+    PIN_INFO upstreamInfo {};
+
+    *tee = nullptr;
+
+    auto hr { findConnectedPin(renderer, PINDIR_INPUT, &rendererPin) ? rendererPin->ConnectedTo(&upstreamPin) : VFW_E_NOT_FOUND };
+    hr = SUCCEEDED(hr) ? upstreamPin->QueryPinInfo(&upstreamInfo) : hr;
+
+    if (SUCCEEDED(hr) && isFilterClass(upstreamInfo.pFilter, CLSID_InfTee))
+    {
+        *tee = upstreamInfo.pFilter;
+        (*tee)->AddRef();
+    }
+    else if (SUCCEEDED(hr))
+    {
+        hr = graph->Disconnect(upstreamPin);
+        hr = SUCCEEDED(hr) ? graph->Disconnect(rendererPin) : hr;
+        hr = SUCCEEDED(hr) && addFilterByCLSID(graph, CLSID_InfTee, tee, L"Render Target Tee") ? S_OK : E_FAIL;
+        hr = SUCCEEDED(hr) && findUnconnectedPin(*tee, PINDIR_INPUT, &teeInput) && connectCheapestType(graph, upstreamPin, teeInput, cost) ? S_OK : E_FAIL;
+        hr = SUCCEEDED(hr) && findUnconnectedPin(*tee, PINDIR_OUTPUT, &teeOutput) ? graph->Connect(teeOutput, rendererPin) : E_FAIL;
+
+        if (FAILED(hr))
+        {
+            if (*tee != nullptr)
+            {
+                graph->RemoveFilter(*tee);
+                safeRelease(tee);
+            }
+
+            graph->ConnectDirect(upstreamPin, rendererPin, nullptr);
+        }
+    }
+
+    safeRelease(&upstreamInfo.pFilter);
+    safeRelease(&teeOutput);
+    safeRelease(&teeInput);
+    safeRelease(&upstreamPin);
+    safeRelease(&rendererPin);
+    return SUCCEEDED(hr);
+}
+
+// Allocators are only sized when pins connect, so every connected output
+// pin that accepts a buffer count is asked for it and reconnected. A count
+// of -1 hands the choice back to the filters.
+bool capSampleQueues(IGraphBuilder * graph, long buffers)
+{
+    IFilterGraph2 * filterGraph2 { nullptr };
+    IEnumFilters * enumFilters { nullptr };
+    IBaseFilter * filter { nullptr };
+    std::vector<IPin*> outputPins;
+
+    auto hr { graph->QueryInterface(IID_PPV_ARGS(&filterGraph2)) };
+    hr = SUCCEEDED(hr) ? graph->EnumFilters(&enumFilters) : hr;
+
+    while (SUCCEEDED(hr) && S_OK == enumFilters->Next(1, &filter, nullptr))
+    {
+        IEnumPins * enumPins { nullptr };
+        IPin * pin { nullptr };
+
+        if (FAILED(filter->EnumPins(&enumPins)))
+        {
+            filter->Release();
+            continue;
+        }
+
+        while (S_OK == enumPins->Next(1, &pin, nullptr))
+        {
+            IPin * connected { nullptr };
+            BOOL output { FALSE };
+
+            if (isPinDirection(pin, PINDIR_OUTPUT, &output) && output && SUCCEEDED(pin->ConnectedTo(&connected)))
+            {
+                outputPins.push_back(pin);
+                pin->AddRef();
+            }
+
+            safeRelease(&connected);
+            pin->Release();
+        }
+
+        enumPins->Release();
+        filter->Release();
+    }
+
+    for (auto pin : outputPins)
+    {
+        IAMBufferNegotiation * negotiation { nullptr };
+        ALLOCATOR_PROPERTIES properties { buffers, -1, -1, -1 };
+
+        if (SUCCEEDED(hr) && SUCCEEDED(pin->QueryInterface(IID_PPV_ARGS(&negotiation))) && SUCCEEDED(negotiation->SuggestAllocatorProperties(&properties)))
+        {
+            hr = filterGraph2->ReconnectEx(pin, nullptr);
+        }
+
+        safeRelease(&negotiation);
+        pin->Release();
+    }
+
+    safeRelease(&enumFilters);
+    safeRelease(&filterGraph2);
+    return SUCCEEDED(hr);
+}
+
 bool removeUnconnectedRenderer(IGraphBuilder * graph, IBaseFilter * renderer)
 {
     IPin * pinPointer {nullptr};
@@ -186,6 +417,147 @@ bool removeUnconnectedRenderer(IGraphBuilder * graph, IBaseFilter * renderer)
     return SUCCEEDED(!hr ? graph->RemoveFilter(renderer): hr);
 }
 
+bool readStreamFormat(IPin * pin, StreamFormat * format)
+{
+    AM_MEDIA_TYPE mediaType;
+
+    if (FAILED(pin->ConnectionMediaType(&mediaType)))
+    {
+        return false;
+    }
+
+    *format = { mediaType.majortype, mediaType.subtype, 0, 0, 0, 0 };
+
+    if (mediaType.formattype == FORMAT_VideoInfo && mediaType.cbFormat >= sizeof(VIDEOINFOHEADER))
+    {
+        const auto header { reinterpret_cast<VIDEOINFOHEADER*>(mediaType.pbFormat) };
+        format->width = header->bmiHeader.biWidth;
+        format->height = header->bmiHeader.biHeight;
+    }
+    else if (mediaType.formattype == FORMAT_VideoInfo2 && mediaType.cbFormat >= sizeof(VIDEOINFOHEADER2))
+    {
+        const auto header { reinterpret_cast<VIDEOINFOHEADER2*>(mediaType.pbFormat) };
+        format->width = header->bmiHeader.biWidth;
+        format->height = header->bmiHeader.biHeight;
+    }
+    else if (mediaType.formattype == FORMAT_WaveFormatEx && mediaType.cbFormat >= sizeof(WAVEFORMATEX))
+    {
+        const auto header { reinterpret_cast<WAVEFORMATEX*>(mediaType.pbFormat) };
+        format->samplesPerSecond = header->nSamplesPerSec;
+        format->channels = header->nChannels;
+    }
+
+    freeMediaType(mediaType);
+    return true;
+}
+
+bool sameStreamFormat(const StreamFormat& first, const StreamFormat& second)
+{
+    return first.majorType == second.majorType && first.subtype == second.subtype &&
+        first.width == second.width && first.height == second.height &&
+        first.samplesPerSecond == second.samplesPerSecond && first.channels == second.channels;
+}
+
+bool mediaExists(const std::string& filename)
+{
+    PackEntry entry;
+    return findPackEntry(filename, &entry) != nullptr || fileExists(filename);
+}
+
+size_t readAheadWindow(const std::string& filename, size_t windowBytes, REFERENCE_TIME windowTime)
+{
+    MediaInfo mediaInfo;
+
+    if ((windowBytes == 0 && windowTime == 0) || !probe(filename, &mediaInfo) || mediaInfo.container != ContainerType::Avi)
+    {
+        return 0;
+    }
+
+    if (windowTime == 0 || mediaInfo.duration <= 0)
+    {
+        return windowBytes;
+    }
+
+    const auto fileSize { static_cast<double>(std::ifstream(filename, std::ios::binary | std::ios::ate).tellg()) };
+    const auto timeWindow { static_cast<size_t>(fileSize * windowTime / mediaInfo.duration) };
+    return windowBytes == 0 ? timeWindow : std::min(windowBytes, timeWindow);
+}
+
+void collectDemuxers(IBaseFilter * filter, std::vector<IBaseFilter*>& demuxers, std::vector<IPin*>& streamPins)
+{
+    IEnumPins * enumPins { nullptr };
+    IPin * pin { nullptr };
+
+    filter->AddRef();
+    demuxers.push_back(filter);
+
+    if (FAILED(filter->EnumPins(&enumPins)))
+    {
+        return;
+    }
+
+    while (S_OK == enumPins->Next(1, &pin, nullptr))
+    {
+        IPin * connectedPin { nullptr };
+        AM_MEDIA_TYPE mediaType;
+        BOOL isOutput { FALSE };
+
+        if (isPinDirection(pin, PINDIR_OUTPUT, &isOutput) && isOutput && 
+            SUCCEEDED(pin->ConnectedTo(&connectedPin)) && 
+            SUCCEEDED(pin->ConnectionMediaType(&mediaType)))
+        {
+            PIN_INFO pinInfo;
+
+            if (mediaType.majortype != MEDIATYPE_Stream)
+            {
+                connectedPin->AddRef();
+                streamPins.push_back(connectedPin);
+            }
+            else if (SUCCEEDED(connectedPin->QueryPinInfo(&pinInfo)))
+            {
+                collectDemuxers(pinInfo.pFilter, demuxers, streamPins);
+                safeRelease(&pinInfo.pFilter);
+            }
+
+            freeMediaType(mediaType);
+        }
+
+        safeRelease(&connectedPin);
+        pin->Release();
+    }
+
+    enumPins->Release();
+}
+
+REFERENCE_TIME averageFrameDuration(IBaseFilter * renderer)
+{
+    IPin * pin { nullptr };
+    AM_MEDIA_TYPE mediaType;
+    auto duration { 0LL };
+
+    if (!findConnectedPin(renderer, PINDIR_INPUT, &pin))
+    {
+        return duration;
+    }
+
+    if (SUCCEEDED(pin->ConnectionMediaType(&mediaType)))
+    {
+        if (mediaType.formattype == FORMAT_VideoInfo && mediaType.cbFormat >= sizeof(VIDEOINFOHEADER))
+        {
+            duration = reinterpret_cast<VIDEOINFOHEADER*>(mediaType.pbFormat)->AvgTimePerFrame;
+        }
+        else if (mediaType.formattype == FORMAT_VideoInfo2 && mediaType.cbFormat >= sizeof(VIDEOINFOHEADER2))
+        {
+            duration = reinterpret_cast<VIDEOINFOHEADER2*>(mediaType.pbFormat)->AvgTimePerFrame;
+        }
+
+        freeMediaType(mediaType);
+    }
+
+    safeRelease(&pin);
+    return duration;
+}
+
 bool initialiseEvr(IBaseFilter * baseFilter, HWND hwnd, IMFVideoDisplayControl** displayControl)
 {
     IMFVideoDisplayControl *display{ nullptr };
@@ -209,11 +581,6 @@ bool initialiseEvr(IBaseFilter * baseFilter, HWND hwnd, IMFVideoDisplayControl**
 
         hr = display->SetVideoWindow(hwnd);
 
-        if (FAILED(hr))
-            return false;
-
-        hr = display->SetAspectRatioMode(MFVideoARMode_None);
-
         if (FAILED(hr))
             return false;
 
@@ -226,7 +593,7 @@ bool initialiseEvr(IBaseFilter * baseFilter, HWND hwnd, IMFVideoDisplayControl**
 using namespace wpl;
 
 EVR::EVR() 
-    : videoDisplay(nullptr), evr(nullptr)
+    : videoDisplay(nullptr), evr(nullptr), aspectMode(AspectMode::Stretch), position(), visible(true)
 {
 }
 
@@ -243,6 +610,9 @@ bool EVR::hasVideo() const
 
 bool EVR::addToGraph(IGraphBuilder * graph, HWND hwnd)
 {
+    safeRelease(&evr);
+    safeRelease(&videoDisplay);
+
     IBaseFilter *evrFilter { nullptr };
     auto hr { addFilterByCLSID(graph, CLSID_EnhancedVideoRenderer, &evrFilter, L"EVR") };
   
@@ -258,6 +628,12 @@ bool EVR::addToGraph(IGraphBuilder * graph, HWND hwnd)
         this->evr = evrFilter;
         this->evr->AddRef();
 
+        if (videoDisplay != nullptr)
+        {
+            GetClientRect(hwnd, &position);
+            applyLayout();
+        }
+
         return true;
     };
 
@@ -292,163 +668,2316 @@ bool EVR::updateVideoWindow(HWND hwnd, const LPRECT prc)
 
     if (prc) 
     {
-        return SUCCEEDED(videoDisplay->SetVideoPosition(nullptr, prc));
+        position = *prc;
+    }
+    else
+    {
+        GetClientRect(hwnd, &position);
     }
 
-    RECT rc;
-    GetClientRect(hwnd, &rc);
-    return SUCCEEDED(videoDisplay->SetVideoPosition(nullptr, &rc));
+    return applyLayout();
 }
 
-bool EVR::repaint()
+bool EVR::setAspectMode(AspectMode mode)
 {
-    return SUCCEEDED(videoDisplay ? videoDisplay->RepaintVideo() : S_OK);
+    aspectMode = mode;
+    return videoDisplay == nullptr || applyLayout();
 }
 
-VideoPlayer::VideoPlayer(HWND hwnd)
-  : graphBuilder(nullptr),
-    mediaControl(nullptr),
-    mediaEvents(nullptr),
-    mediaSeeking(nullptr),
-    videoRenderer(new EVR()),
-    state(PlaybackState::NoVideo),
-    windowHandle(hwnd)
+// A hidden EVR keeps consuming samples against the clock but is given an
+// empty destination, so the presenter has nothing to draw.
+bool EVR::setVisible(bool show)
 {
+    visible = show;
+    return videoDisplay == nullptr || applyLayout();
 }
 
-VideoPlayer::~VideoPlayer()
+// Letterboxing is left to the EVR, which paints the bars in the border
+// colour itself. Cropping has no EVR mode, so the source rectangle is cut
+// down to the aspect ratio of the window instead.
+bool EVR::applyLayout()
 {
-    safeDelete(&videoRenderer);
-    releaseGraph();
-}
+    SIZE nativeSize {};
+    SIZE aspectSize {};
+    MFVideoNormalizedRect source { 0.0f, 0.0f, 1.0f, 1.0f };
 
-bool VideoPlayer::openVideo(const std::string& filename)
-{
-    if(!fileExists(filename)) 
+    auto hr { videoDisplay->SetAspectRatioMode(aspectMode == AspectMode::Letterbox ? MFVideoARMode_PreservePicture : MFVideoARMode_None) };
+
+    if (SUCCEEDED(hr) && aspectMode == AspectMode::Letterbox)
     {
-        return false;
+        hr = videoDisplay->SetBorderColor(RGB(0, 0, 0));
     }
 
-    IBaseFilter* source {nullptr};
-    auto hr { setupGraph() };
+    if (SUCCEEDED(hr) && aspectMode == AspectMode::Crop && SUCCEEDED(videoDisplay->GetNativeVideoSize(&nativeSize, &aspectSize)) && aspectSize.cx > 0 && aspectSize.cy > 0)
+    {
+        const auto layout { layoutVideo(aspectMode, position, aspectSize.cx, aspectSize.cy) };
+        source.left = static_cast<float>(layout.source.left) / aspectSize.cx;
+        source.top = static_cast<float>(layout.source.top) / aspectSize.cy;
+        source.right = static_cast<float>(layout.source.right) / aspectSize.cx;
+        source.bottom = static_cast<float>(layout.source.bottom) / aspectSize.cy;
+    }
 
-    const auto tasks = [&]() {
-        const auto wstr { std::wstring(filename.begin(), filename.end()) };
-        hr = SUCCEEDED(graphBuilder->AddSourceFilter(wstr.c_str(), nullptr, &source));
-        return !hr ? false : renderStreams(source);
-    };
+    const RECT hidden { 0, 0, 0, 0 };
+    return SUCCEEDED(hr) && SUCCEEDED(videoDisplay->SetVideoPosition(&source, visible ? &position : &hidden));
+}
 
-    return async(tasks, [&]() { releaseGraph(); }, [&]() { safeRelease(&source); });
+bool EVR::repaint()
+{
+    return SUCCEEDED(videoDisplay && visible ? videoDisplay->RepaintVideo() : S_OK);
 }
 
-bool VideoPlayer::play()
+// The EVR mixer converts whatever it accepts on the GPU, so any type its
+// input pin takes is free as far as the CPU is concerned.
+int EVR::conversionCost(const AM_MEDIA_TYPE& type) const
 {
-    if (state != PlaybackState::Paused && state != PlaybackState::Stopped)
+    IPin * inputPin { nullptr };
+
+    if (!findUnconnectedPin(evr, PINDIR_INPUT, &inputPin))
     {
-        return false;
+        return 0;
     }
 
-    updateVideoWindow();
+    const auto accepted { inputPin->QueryAccept(&type) == S_OK };
+    inputPin->Release();
+    return accepted ? 0 : -1;
+}
 
-    auto hr { mediaControl->Run() };
+IBaseFilter * EVR::filter() const
+{
+    return evr;
+}
 
-    if (SUCCEEDED(hr))
-    {
-        state = PlaybackState::Playing;
-    }
+// A filter can only be in one graph, so a prerolled clip draws into the
+// same window through a second EVR until it takes over.
+std::shared_ptr<VideoRenderer> EVR::clone() const
+{
+    const auto copy { std::make_shared<EVR>() };
+    copy->aspectMode = aspectMode;
+    copy->visible = visible;
+    return copy;
+}
 
-    return state == PlaybackState::Playing;
+REFERENCE_TIME EVR::frameDuration() const
+{
+    return evr ? averageFrameDuration(evr) : 0;
 }
 
-bool VideoPlayer::pause()
+bool EVR::captureFrame(VideoFrame * frame)
 {
-    if (state != PlaybackState::Playing) 
+    if (videoDisplay == nullptr) 
     {
         return false;
     }
 
-    auto hr { mediaControl->Pause() };
-    
-    if (SUCCEEDED(hr)) 
-    {
-        state = PlaybackState::Paused;
-    }
+    BITMAPINFOHEADER header {};
+    BYTE * dib { nullptr };
+    DWORD dibSize { 0 };
+    LONGLONG timeStamp { 0 };
 
-    return state == PlaybackState::Paused;
-}
+    header.biSize = sizeof(BITMAPINFOHEADER);
 
-bool VideoPlayer::stop()
-{
-    if (state != PlaybackState::Playing && state != PlaybackState::Paused) 
+    auto hr { videoDisplay->GetCurrentImage(&header, &dib, &dibSize, &timeStamp) };
+
+    if (FAILED(hr))
     {
         return false;
     }
 
-    auto hr { mediaControl->Stop() };
+    const auto height { std::abs(header.biHeight) };
+    const auto stride { header.biWidth * 4 };
 
-    if (SUCCEEDED(hr))
+    frame->stream = 0;
+    frame->pts = timeStamp;
+    frame->duration = frameDuration();
+    frame->width = header.biWidth;
+    frame->height = height;
+    frame->stride = stride;
+    frame->keyFrame = false;
+    frame->pixels.resize(static_cast<size_t>(stride) * height);
+
+    // Bottom-up images are read from the last row, so every source row is
+    // checked against the buffer rather than the rows written so far.
+    auto copied { header.biWidth > 0 };
+
+    for (auto row = 0L; copied && row < height; ++row)
     {
-        state = PlaybackState::Stopped;
-        
-        auto stopTimes = 1LL;
-        auto start = 1LL;
+        const auto sourceRow { header.biHeight > 0 ? height - row - 1 : row };
+        copied = static_cast<ULONGLONG>(sourceRow + 1) * stride <= dibSize;
 
-        mediaSeeking->GetPositions(nullptr, &stopTimes);
-        mediaSeeking->SetPositions(&start, 0x01 | 0x04, &stopTimes, 0x01 | 0x04);
+        if (copied)
+        {
+            std::copy_n(dib + static_cast<size_t>(sourceRow) * stride, stride, frame->pixels.data() + static_cast<size_t>(row) * stride);
+        }
     }
-    
-    return state == PlaybackState::Stopped;
+
+    CoTaskMemFree(dib);
+    return copied;
 }
 
-bool VideoPlayer::hasVideo() const
+bool EVR::presentFrame(const VideoFrame * frame)
+{
+    if (evr == nullptr) 
+    {
+        return false;
+    }
+
+    if (!visible && frame != nullptr)
+    {
+        return true;
+    }
+
+    IMFGetService * getService { nullptr };
+    IMFVideoMixerBitmap * mixerBitmap { nullptr };
+
+    auto hr { evr->QueryInterface(IID_PPV_ARGS(&getService)) };
+    hr = SUCCEEDED(hr) ? getService->GetService(MR_VIDEO_MIXER_SERVICE, IID_PPV_ARGS(&mixerBitmap)) : hr;
+
+    const auto task = [&]() {
+        if (FAILED(hr))
+            return false;
+
+        if (frame == nullptr)
+        {
+            hr = mixerBitmap->ClearAlphaBitmap();
+            return SUCCEEDED(hr);
+        }
+
+        BITMAPINFO info {};
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = frame->width;
+        info.bmiHeader.biHeight = -frame->height;
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+
+        void * bits { nullptr };
+        const auto screen { GetDC(nullptr) };
+        const auto memory { CreateCompatibleDC(screen) };
+        const auto bitmap { CreateDIBSection(memory, &info, DIB_RGB_COLORS, &bits, nullptr, 0) };
+
+        if (bitmap != nullptr)
+        {
+            std::copy(frame->pixels.begin(), frame->pixels.end(), static_cast<BYTE*>(bits));
+
+            const auto previous { SelectObject(memory, bitmap) };
+
+            MFVideoAlphaBitmap alphaBitmap {};
+            alphaBitmap.GetBitmapFromDC = TRUE;
+            alphaBitmap.bitmap.hdc = memory;
+            alphaBitmap.params.dwFlags = MFVideoAlphaBitmap_SrcRect | MFVideoAlphaBitmap_DestRect | MFVideoAlphaBitmap_Alpha;
+            alphaBitmap.params.rcSrc = { 0, 0, frame->width, frame->height };
+            alphaBitmap.params.nrcDest = { 0.0f, 0.0f, 1.0f, 1.0f };
+            alphaBitmap.params.fAlpha = 1.0f;
+
+            hr = mixerBitmap->SetAlphaBitmap(&alphaBitmap);
+
+            SelectObject(memory, previous);
+            DeleteObject(bitmap);
+        }
+        else
+        {
+            hr = E_OUTOFMEMORY;
+        }
+
+        DeleteDC(memory);
+        ReleaseDC(nullptr, screen);
+        return SUCCEEDED(hr) && repaint();
+    };
+
+    const auto cleanup = [&]() {
+        safeRelease(&mixerBitmap);
+        safeRelease(&getService);
+    };
+
+    return async(task, EmptyFunction, cleanup);
+}
+
+ManualClock::ManualClock()
+    : currentTime(0), nextCookie(1), referenceCount(1)
+{
+}
+
+void ManualClock::advance(REFERENCE_TIME elapsed)
+{
+    std::lock_guard<std::mutex> guard(requestLock);
+    currentTime += elapsed;
+    signalDueRequests();
+}
+
+void ManualClock::signalDueRequests()
+{
+    for (auto& request : requests)
+    {
+        if (request.dueTime > currentTime)
+        {
+            continue;
+        }
+
+        if (request.period == 0)
+        {
+            SetEvent(request.handle);
+            request.handle = nullptr;
+            continue;
+        }
+
+        const auto periods { (currentTime - request.dueTime) / request.period + 1 };
+        ReleaseSemaphore(request.handle, static_cast<LONG>(periods), nullptr);
+        request.dueTime += periods * request.period;
+    }
+
+    const auto fired = [](const AdviseRequest& request) { return request.handle == nullptr; };
+    requests.erase(std::remove_if(requests.begin(), requests.end(), fired), requests.end());
+}
+
+HRESULT ManualClock::QueryInterface(REFIID riid, void ** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (riid == IID_IUnknown || riid == IID_IReferenceClock)
+    {
+        *object = static_cast<IReferenceClock*>(this);
+        AddRef();
+        return S_OK;
+    }
+
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG ManualClock::AddRef()
+{
+    return InterlockedIncrement(&referenceCount);
+}
+
+ULONG ManualClock::Release()
+{
+    const auto count { InterlockedDecrement(&referenceCount) };
+
+    if (count == 0)
+    {
+        delete this;
+    }
+
+    return count;
+}
+
+HRESULT ManualClock::GetTime(REFERENCE_TIME * time)
+{
+    if (time == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> guard(requestLock);
+    *time = currentTime;
+    return S_OK;
+}
+
+HRESULT ManualClock::AdviseTime(REFERENCE_TIME baseTime, REFERENCE_TIME streamTime, HEVENT event, DWORD_PTR * cookie)
+{
+    if (cookie == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> guard(requestLock);
+    *cookie = nextCookie++;
+    requests.push_back({ *cookie, baseTime + streamTime, 0, reinterpret_cast<HANDLE>(event) });
+    signalDueRequests();
+    return S_OK;
+}
+
+HRESULT ManualClock::AdvisePeriodic(REFERENCE_TIME startTime, REFERENCE_TIME periodTime, HSEMAPHORE semaphore, DWORD_PTR * cookie)
+{
+    if (cookie == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    if (periodTime <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::lock_guard<std::mutex> guard(requestLock);
+    *cookie = nextCookie++;
+    requests.push_back({ *cookie, startTime, periodTime, reinterpret_cast<HANDLE>(semaphore) });
+    signalDueRequests();
+    return S_OK;
+}
+
+HRESULT ManualClock::Unadvise(DWORD_PTR cookie)
+{
+    std::lock_guard<std::mutex> guard(requestLock);
+
+    const auto matches = [&](const AdviseRequest& request) { return request.cookie == cookie; };
+    const auto found { std::find_if(requests.begin(), requests.end(), matches) };
+
+    if (found == requests.end())
+    {
+        return S_FALSE;
+    }
+
+    requests.erase(found);
+    return S_OK;
+}
+
+VideoPlayer::VideoPlayer(HWND hwnd)
+  : graphBuilder(nullptr),
+    mediaControl(nullptr),
+    mediaEvents(nullptr),
+    mediaSeeking(nullptr),
+    sourceFilter(nullptr),
+    readAheadSource(nullptr),
+    videoRenderer(new EVR()),
+    renderTargets(),
+    manualClock(new ManualClock()),
+    nextVideo(nullptr),
+    nextVideoReady(),
+    nextVideoFile(),
+    handoffClock(nullptr),
+    handoffAdvise(0),
+    handoffEvent(nullptr),
+    handoffWait(nullptr),
+    dispatchWindow(nullptr),
+    revealPosition(-1),
+    frameCache(),
+    seekIndex(),
+    pendingSeekIndex(),
+    seekIndexCancelled(),
+    seekIndexFile(),
+    playbackStats(),
+    state(PlaybackState::NoVideo),
+    clock(ClockMode::RealTime),
+    framePosition(-1),
+    graphPosition(-1),
+    nextReverseStep(),
+    reverseFrames(),
+    reverseBufferBytes(0),
+    openedAt(),
+    posterTime(-1),
+    playbackRate(1.0),
+    pendingEvent(0),
+    windowHandle(hwnd),
+    destination(),
+    windowRect(),
+    aspectMode(AspectMode::Stretch),
+    visibilityMode(Visibility::Visible),
+    priority(TaskPriority::Foreground),
+    readAheadBytes(0),
+    readAheadTime(0),
+    error(PlayerError::None),
+    looping(false),
+    handoffScheduled(false),
+    streaming(false),
+    windowDirty(true),
+    repaintDue(true),
+    firstFrameShown(false),
+    lowLatency(false),
+    renderersReady(false),
+    reverseFinished(false)
+{
+}
+
+VideoPlayer::VideoPlayer(VideoPlayer&& other)
+    : VideoPlayer(other.windowHandle)
+{
+    swapPlayer(other);
+}
+
+VideoPlayer& VideoPlayer::operator=(VideoPlayer&& other)
+{
+    swapPlayer(other);
+    return *this;
+}
+
+VideoPlayer::~VideoPlayer()
+{
+    clearQueue();
+    disarmHandoffReveal();
+    cancelSeekIndex();
+    safeDelete(&videoRenderer);
+    releaseGraph();
+    safeRelease(&manualClock);
+
+    if (dispatchWindow != nullptr)
+    {
+        DestroyWindow(dispatchWindow);
+    }
+}
+
+// The graph and both renderers are created ahead of time, so an open only
+// adds the source and connects it. The decode chain, and the worker threads
+// and frame pools that come with it, are still set up by the first open.
+bool VideoPlayer::warmUp()
+{
+    if (graphBuilder != nullptr)
+    {
+        return true;
+    }
+
+    IBaseFilter * audioRenderer { nullptr };
+
+    renderersReady = setupGraph() && createVideoRenderer() &&
+        SUCCEEDED(addFilterByCLSID(graphBuilder, CLSID_DSoundRender, &audioRenderer, AudioRendererName));
+
+    safeRelease(&audioRenderer);
+    state = PlaybackState::NoVideo;
+    return renderersReady;
+}
+
+// A warmed up renderer is already bound to the old window, so it is built
+// again for the new one.
+bool VideoPlayer::setVideoWindow(HWND hwnd)
+{
+    if (sourceFilter != nullptr)
+    {
+        return false;
+    }
+
+    if (renderersReady && hwnd != windowHandle)
+    {
+        releaseGraph();
+        windowHandle = hwnd;
+        return warmUp();
+    }
+
+    windowHandle = hwnd;
+    return true;
+}
+
+bool VideoPlayer::addRenderTarget(std::shared_ptr<VideoRenderer> renderer, HWND hwnd)
+{
+    const auto sameRenderer = [&](const RenderTarget& target) { return target.registered == renderer; };
+
+    if (renderer == nullptr || std::any_of(renderTargets.begin(), renderTargets.end(), sameRenderer))
+    {
+        return false;
+    }
+
+    renderer->setAspectMode(aspectMode);
+    renderer->setVisible(visibilityMode == Visibility::Visible);
+    renderTargets.push_back({ renderer, renderer, hwnd, RECT {}, false });
+
+    if (sourceFilter == nullptr)
+    {
+        return true;
+    }
+
+    if (reconnectGraph([&]() { return attachRenderTargets(); }))
+    {
+        return true;
+    }
+
+    renderTargets.pop_back();
+    return false;
+}
+
+bool VideoPlayer::removeRenderTarget(const std::shared_ptr<VideoRenderer>& renderer)
+{
+    const auto target { std::find_if(renderTargets.begin(), renderTargets.end(), [&](const RenderTarget& candidate) {
+        return candidate.registered == renderer;
+    }) };
+
+    if (target == renderTargets.end())
+    {
+        return false;
+    }
+
+    // The prerolled clip has its own copy, which would come back with it.
+    if (nextVideo != nullptr)
+    {
+        nextVideo->removeRenderTarget(renderer);
+    }
+
+    if (target->attached && sourceFilter != nullptr)
+    {
+        const auto removed { reconnectGraph([&]() { return SUCCEEDED(graphBuilder->RemoveFilter(target->renderer->filter())); }) };
+
+        if (!removed)
+        {
+            return false;
+        }
+    }
+
+    renderTargets.erase(target);
+    return true;
+}
+
+size_t VideoPlayer::renderTargetCount() const
+{
+    return renderTargets.size();
+}
+
+bool VideoPlayer::setAspectMode(AspectMode mode)
+{
+    auto applied { true };
+    aspectMode = mode;
+
+    for (const auto& target : renderTargets)
+    {
+        applied = target.renderer->setAspectMode(mode) && applied;
+    }
+
+    return (videoRenderer == nullptr || videoRenderer->setAspectMode(mode)) && applied;
+}
+
+// The main renderer draws into this part of the window, or all of it when
+// rect is null. Extra render targets always fill their own windows.
+bool VideoPlayer::setDestination(const RECT * rect)
+{
+    if (rect != nullptr && (rect->right <= rect->left || rect->bottom <= rect->top))
+    {
+        return false;
+    }
+
+    destination = rect ? *rect : RECT {};
+    return updateVideoWindow();
+}
+
+void VideoPlayer::closeVideo()
+{
+    clearQueue();
+    cancelSeekIndex();
+    releaseGraph();
+}
+
+// Everything but the window goes back to how a new player starts, so a
+// pooled player hands nothing from its last user to its next one.
+void VideoPlayer::reset()
+{
+    closeVideo();
+    renderTargets.clear();
+    frameCache = FrameCache();
+    playbackStats = {};
+
+    safeRelease(&manualClock);
+    manualClock = new ManualClock();
+
+    clock = ClockMode::RealTime;
+    posterTime = -1;
+    revealPosition = -1;
+    playbackRate = 1.0;
+    pendingEvent = 0;
+    destination = {};
+    windowRect = {};
+    aspectMode = AspectMode::Stretch;
+    visibilityMode = Visibility::Visible;
+    priority = TaskPriority::Foreground;
+    readAheadBytes = 0;
+    readAheadTime = 0;
+    error = PlayerError::None;
+    looping = false;
+    windowDirty = true;
+    repaintDue = true;
+    firstFrameShown = false;
+    lowLatency = false;
+    reverseFinished = false;
+}
+
+bool VideoPlayer::openVideo(const std::string& filename)
+{
+    if(!mediaExists(filename)) 
+    {
+        error = PlayerError::NotFound;
+        return false;
+    }
+
+    if (!MemoryGovernor::shared().admitOpen())
+    {
+        error = PlayerError::OutOfMemory;
+        return false;
+    }
+
+    error = PlayerError::None;
+
+    beginOpen();
+    frameCache.clear();
+    cancelSeekIndex();
+    seekIndexFile = filename;
+
+    if (softReopen(filename))
+    {
+        presentPoster();
+        return true;
+    }
+
+    IBaseFilter* source {nullptr};
+    ReadAheadSource* readAhead {nullptr};
+    auto hr { setupGraph() };
+
+    const auto tasks = [&]() {
+        hr = SUCCEEDED(addSourceFilter(filename, &source, &readAhead));
+
+        if (!hr || !renderStreams(source) || !applyClockMode())
+            return false;
+
+        sourceFilter = source;
+        sourceFilter->AddRef();
+        std::swap(readAheadSource, readAhead);
+        return true;
+    };
+
+    const auto cleanup = [&]() {
+        safeRelease(&source);
+        safeRelease(&readAhead);
+    };
+
+    if (!async(tasks, [&]() { error = PlayerError::Unsupported; cancelSeekIndex(); releaseGraph(); }, cleanup))
+    {
+        return false;
+    }
+
+    presentPoster();
+    return true;
+}
+
+bool VideoPlayer::openStream(HANDLE stream, size_t bufferBytes)
+{
+    if (stream == nullptr || stream == INVALID_HANDLE_VALUE)
+    {
+        error = PlayerError::NotFound;
+        return false;
+    }
+
+    if (!MemoryGovernor::shared().admitOpen())
+    {
+        error = PlayerError::OutOfMemory;
+        return false;
+    }
+
+    error = PlayerError::None;
+    beginOpen();
+    frameCache.clear();
+    cancelSeekIndex();
+
+    const auto streamSource { new ReadAheadSource() };
+    auto streamReader { std::make_unique<StreamReader>() };
+    auto hr { setupGraph() };
+
+    const auto tasks = [&]() {
+        if (hr && !streamReader->open(stream, bufferBytes, &error))
+        {
+            return false;
+        }
+
+        hr = hr && streamSource->open(std::move(streamReader));
+        hr = hr && SUCCEEDED(graphBuilder->AddFilter(streamSource, StreamSourceName));
+
+        if (!hr || !renderStreams(streamSource) || !applyClockMode())
+            return false;
+
+        sourceFilter = streamSource;
+        sourceFilter->AddRef();
+        readAheadSource = streamSource;
+        readAheadSource->AddRef();
+        streaming = true;
+        return true;
+    };
+
+    return async(tasks, [&]() { error = error == PlayerError::None ? PlayerError::Unsupported : error; releaseGraph(); }, [&]() { streamSource->Release(); });
+}
+
+// A frame served from the cache, its overlay and the rate all belong to the
+// previous clip, whether or not the next one reuses its graph.
+void VideoPlayer::beginOpen()
+{
+    openedAt = std::chrono::steady_clock::now();
+    firstFrameShown = false;
+    playbackStats.firstPaintTime = 0;
+
+    if (mediaSeeking != nullptr && playbackRate != 1.0)
+    {
+        mediaSeeking->SetRate(1.0);
+    }
+
+    framePosition = -1;
+    graphPosition = -1;
+    playbackRate = 1.0;
+
+    if (videoRenderer != nullptr)
+    {
+        videoRenderer->presentFrame(nullptr);
+    }
+}
+
+void VideoPlayer::markFirstFrame()
+{
+    if (firstFrameShown)
+    {
+        return;
+    }
+
+    firstFrameShown = true;
+    playbackStats.firstPaintTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - openedAt).count() / 100;
+}
+
+// Pausing cues the poster frame in the renderer, which completes the state
+// change once it has been drawn. The graph is then stopped at the start so
+// play() behaves as after any other open, and the EVR keeps showing the
+// poster while stopped. Pipes cant be rewound, so they get no poster.
+bool VideoPlayer::presentPoster()
+{
+    if (posterTime < 0 || streaming || state != PlaybackState::Stopped)
+    {
+        return false;
+    }
+
+    auto start { 0LL };
+    auto poster { std::min(posterTime, std::max(duration() - currentFrameDuration(), 0LL)) };
+    auto hr { mediaSeeking->SetPositions(&poster, AM_SEEKING_AbsolutePositioning, nullptr, AM_SEEKING_NoPositioning) };
+    hr = SUCCEEDED(hr) ? mediaControl->Pause() : hr;
+
+    if (SUCCEEDED(hr))
+    {
+        OAFilterState filterState;
+        hr = mediaControl->GetState(PrerollTimeout, &filterState);
+    }
+
+    if (hr == S_OK)
+    {
+        markFirstFrame();
+    }
+
+    mediaControl->Stop();
+    mediaSeeking->SetPositions(&start, AM_SEEKING_AbsolutePositioning, nullptr, AM_SEEKING_NoPositioning);
+    return hr == S_OK;
+}
+
+bool VideoPlayer::setPosterFrame(bool enabled, REFERENCE_TIME time)
+{
+    if (time < 0)
+    {
+        return false;
+    }
+
+    posterTime = enabled ? time : -1;
+    return true;
+}
+
+// Caps every sample queue in the graph, drops the clock so frames are
+// shown as soon as they are decoded and skips read-ahead on later opens.
+// Pipes cant be rewound to rebuild their allocators, so a playing stream
+// only switches clocks and gets the queue caps on its next open.
+bool VideoPlayer::setLowLatency(bool enabled)
+{
+    if (enabled == lowLatency)
+    {
+        return true;
+    }
+
+    lowLatency = enabled;
+
+    if (sourceFilter == nullptr)
+    {
+        return true;
+    }
+
+    const auto rebuilt { reconnectGraph([&]() { return capSampleQueues(graphBuilder, enabled ? LowLatencyBuffers : -1); }) };
+    return applyClockMode() && (rebuilt || streaming);
+}
+
+bool VideoPlayer::isLowLatency() const
+{
+    return lowLatency;
+}
+
+bool VideoPlayer::hasFirstFrame() const
+{
+    return firstFrameShown;
+}
+
+bool VideoPlayer::isSeekable() const
+{
+    return sourceFilter != nullptr && !streaming;
+}
+
+HRESULT VideoPlayer::addSourceFilter(const std::string& filename, IBaseFilter ** source, ReadAheadSource ** readAhead) const
+{
+    const auto wstr { std::wstring(filename.begin(), filename.end()) };
+    const auto window { lowLatency ? 0 : readAheadWindow(filename, readAheadBytes, readAheadTime) };
+
+    PackEntry entry;
+    const auto archive { findPackEntry(filename, &entry) };
+
+    if (archive == nullptr && window == 0)
+    {
+        return graphBuilder->AddSourceFilter(wstr.c_str(), nullptr, source);
+    }
+
+    const auto readAheadFilter { new ReadAheadSource() };
+    const auto opened { archive != nullptr ?
+        readAheadFilter->open(std::make_unique<MemoryReader>(archive, entry)) :
+        readAheadFilter->open(filename, MEDIASUBTYPE_Avi, window) };
+
+    auto hr { opened ? S_OK : VFW_E_UNSUPPORTED_STREAM };
+    hr = SUCCEEDED(hr) ? graphBuilder->AddFilter(readAheadFilter, wstr.c_str()) : hr;
+
+    if (FAILED(hr))
+    {
+        readAheadFilter->Release();
+        return archive != nullptr ? hr : graphBuilder->AddSourceFilter(wstr.c_str(), nullptr, source);
+    }
+
+    readAheadFilter->AddRef();
+    *source = readAheadFilter;
+    *readAhead = readAheadFilter;
+    return hr;
+}
+
+bool VideoPlayer::softReopen(const std::string& filename)
+{
+    if (sourceFilter == nullptr || state == PlaybackState::NoVideo)
+    {
+        return false;
+    }
+
+    std::vector<IBaseFilter*> demuxers;
+    std::vector<IPin*> streamPins;
+    std::vector<StreamFormat> streamFormats;
+    IFilterGraph2 * filterGraph2 { nullptr };
+    IBaseFilter * source { nullptr };
+    ReadAheadSource * readAhead { nullptr };
+    IEnumPins * enumPins { nullptr };
+
+    cancelHandoff();
+
+    auto hr { mediaControl->Stop() };
+    collectDemuxers(sourceFilter, demuxers, streamPins);
+
+    const auto task = [&]() {
+        if (FAILED(hr) || streamPins.empty())
+            return false;
+
+        for (auto pin : streamPins)
+        {
+            StreamFormat format;
+
+            if (!readStreamFormat(pin, &format))
+                return false;
+
+            streamFormats.push_back(format);
+        }
+
+        for (auto demuxer : demuxers)
+        {
+            hr = graphBuilder->RemoveFilter(demuxer);
+
+            if (FAILED(hr))
+                return false;
+        }
+
+        hr = addSourceFilter(filename, &source, &readAhead);
+        hr = queryInterface(hr, IID_PPV_ARGS(&filterGraph2));
+        hr = SUCCEEDED(hr) ? source->EnumPins(&enumPins) : hr;
+
+        if (FAILED(hr))
+            return false;
+
+        IPin * pin { nullptr };
+
+        while (S_OK == enumPins->Next(1, &pin, nullptr))
+        {
+            filterGraph2->RenderEx(pin, AM_RENDEREX_RENDERTOEXISTINGRENDERERS, nullptr);
+            pin->Release();
+        }
+
+        for (size_t i = 0; i < streamPins.size(); ++i)
+        {
+            StreamFormat format;
+
+            if (!readStreamFormat(streamPins[i], &format) || !sameStreamFormat(format, streamFormats[i]))
+                return false;
+        }
+
+        std::swap(sourceFilter, source);
+        std::swap(readAheadSource, readAhead);
+        streaming = false;
+        state = PlaybackState::Stopped;
+        ++playbackStats.softReopens;
+        return true;
+    };
+
+    const auto cleanup = [&]() {
+        for (auto pin : streamPins) pin->Release();
+        for (auto demuxer : demuxers) demuxer->Release();
+
+        safeRelease(&enumPins);
+        safeRelease(&filterGraph2);
+        safeRelease(&source);
+        safeRelease(&readAhead);
+    };
+
+    return async(task, EmptyFunction, cleanup);
+}
+
+bool VideoPlayer::play()
+{
+    if (state == PlaybackState::NoVideo && nextVideo != nullptr)
+    {
+        return startNextVideo();
+    }
+
+    if (state != PlaybackState::Paused && state != PlaybackState::Stopped)
+    {
+        return false;
+    }
+
+    updateVideoWindow();
+
+    if (playbackRate < 0.0)
+    {
+        state = SUCCEEDED(mediaControl->Pause()) ? PlaybackState::Playing : state;
+
+        if (state == PlaybackState::Playing)
+        {
+            startReverse();
+        }
+
+        return state == PlaybackState::Playing;
+    }
+
+    if (looping && state == PlaybackState::Stopped)
+    {
+        armLoopSegment();
+    }
+
+    syncGraphPosition();
+    videoRenderer->presentFrame(nullptr);
+
+    auto hr { mediaControl->Run() };
+
+    if (SUCCEEDED(hr))
+    {
+        state = PlaybackState::Playing;
+    }
+
+    return state == PlaybackState::Playing;
+}
+
+bool VideoPlayer::pause()
+{
+    if (state != PlaybackState::Playing) 
+    {
+        return false;
+    }
+
+    cancelHandoff();
+    stopReverse();
+
+    auto hr { playbackRate < 0.0 ? S_OK : mediaControl->Pause() };
+    
+    if (SUCCEEDED(hr)) 
+    {
+        state = PlaybackState::Paused;
+    }
+
+    return state == PlaybackState::Paused;
+}
+
+bool VideoPlayer::stop()
+{
+    if (state != PlaybackState::Playing && state != PlaybackState::Paused) 
+    {
+        return false;
+    }
+
+    cancelHandoff();
+
+    auto hr { mediaControl->Stop() };
+
+    if (SUCCEEDED(hr))
+    {
+        state = PlaybackState::Stopped;
+        framePosition = -1;
+        graphPosition = -1;
+        videoRenderer->presentFrame(nullptr);
+        
+        auto stopTimes = 1LL;
+        auto start = 1LL;
+
+        mediaSeeking->GetPositions(nullptr, &stopTimes);
+        mediaSeeking->SetPositions(&start, 0x01 | 0x04 | (looping ? AM_SEEKING_Segment : 0), &stopTimes, 0x01 | 0x04);
+    }
+    
+    return state == PlaybackState::Stopped;
+}
+
+bool VideoPlayer::seek(REFERENCE_TIME position)
+{
+    if (state == PlaybackState::NoVideo) 
+    {
+        return false;
+    }
+
+    const auto cachedFrame { state == PlaybackState::Paused ? frameCache.find(VideoStream, position) : nullptr };
+
+    if (cachedFrame != nullptr)
+    {
+        framePosition = cachedFrame->pts;
+        return videoRenderer->presentFrame(cachedFrame);
+    }
+
+    if (streaming)
+    {
+        return false;
+    }
+
+    auto hr { mediaSeeking->SetPositions(&position, AM_SEEKING_AbsolutePositioning, nullptr, AM_SEEKING_NoPositioning) };
+
+    if (FAILED(hr) || state != PlaybackState::Paused)
+    {
+        framePosition = -1;
+        graphPosition = -1;
+        return SUCCEEDED(hr);
+    }
+
+    OAFilterState filterState;
+
+    videoRenderer->presentFrame(nullptr);
+    hr = mediaControl->GetState(PrerollTimeout, &filterState);
+
+    if (hr != S_OK || !captureDisplayedFrame(false))
+    {
+        framePosition = position;
+        graphPosition = position;
+    }
+
+    return SUCCEEDED(hr);
+}
+
+bool VideoPlayer::stepForward()
+{
+    if (state == PlaybackState::Playing)
+    {
+        pause();
+    }
+
+    return state == PlaybackState::Paused && stepFrame(1);
+}
+
+bool VideoPlayer::stepBackward()
+{
+    if (state == PlaybackState::Playing)
+    {
+        pause();
+    }
+
+    return state == PlaybackState::Paused && stepFrame(-1);
+}
+
+bool VideoPlayer::setRate(double rate)
+{
+    if (rate == 0.0 || mediaSeeking == nullptr)
+    {
+        return false;
+    }
+
+    const auto reversing { playbackRate < 0.0 };
+
+    if (rate < 0.0)
+    {
+        if (streaming)
+        {
+            return false;
+        }
+
+        if (!reversing && state == PlaybackState::Playing && FAILED(mediaControl->Pause()))
+        {
+            return false;
+        }
+
+        playbackRate = rate;
+
+        if (state == PlaybackState::Playing)
+        {
+            startReverse();
+        }
+
+        return true;
+    }
+
+    if (FAILED(mediaSeeking->SetRate(rate)))
+    {
+        return false;
+    }
+
+    playbackRate = rate;
+    stopReverse();
+
+    if (reversing && state == PlaybackState::Playing)
+    {
+        syncGraphPosition();
+        videoRenderer->presentFrame(nullptr);
+        return SUCCEEDED(mediaControl->Run());
+    }
+
+    return true;
+}
+
+double VideoPlayer::rate() const
+{
+    return playbackRate;
+}
+
+bool VideoPlayer::stepFrame(int direction)
+{
+    const auto frameDuration { currentFrameDuration() };
+    const auto current { framePosition >= 0 ? framePosition : position() };
+    const auto target { current + direction * frameDuration };
+
+    if (target < 0 || (direction > 0 && target >= duration()))
+    {
+        return false;
+    }
+
+    const auto cachedFrame { frameCache.find(VideoStream, target) };
+
+    if (cachedFrame != nullptr)
+    {
+        framePosition = cachedFrame->pts;
+        return videoRenderer->presentFrame(cachedFrame);
+    }
+
+    if (direction < 0 && streaming)
+    {
+        return false;
+    }
+
+    videoRenderer->presentFrame(nullptr);
+    return direction > 0 ? stepGraphForward(target) : decodeGroupOfPictures(target);
+}
+
+bool VideoPlayer::stepGraphForward(REFERENCE_TIME target)
+{
+    OAFilterState filterState;
+    IVideoFrameStep * frameStep { nullptr };
+
+    const auto stepping { framePosition >= 0 && framePosition == graphPosition };
+    auto hr { stepping ? queryInterface(S_OK, IID_PPV_ARGS(&frameStep)) : E_FAIL };
+
+    const auto task = [&]() {
+        if (SUCCEEDED(hr))
+        {
+            hr = frameStep->Step(1, nullptr);
+            return SUCCEEDED(hr) && waitForEvent(EC_STEP_COMPLETE) && captureDisplayedFrame(false);
+        }
+
+        hr = mediaSeeking->SetPositions(&target, AM_SEEKING_AbsolutePositioning, nullptr, AM_SEEKING_NoPositioning);
+        hr = SUCCEEDED(hr) ? mediaControl->GetState(PrerollTimeout, &filterState) : hr;
+        return hr == S_OK && captureDisplayedFrame(false);
+    };
+
+    return async(task, EmptyFunction, [&]() { safeRelease(&frameStep); });
+}
+
+// With frames given, every frame up to the target is read back into them,
+// cache budget or not, for reverse playback to show without decoding again.
+bool VideoPlayer::decodeGroupOfPictures(REFERENCE_TIME target, std::deque<VideoFrame> * frames)
+{
+    OAFilterState filterState;
+    IVideoFrameStep * frameStep { nullptr };
+
+    loadSeekIndex();
+
+    const auto indexedKeyFrame { collectSeekIndex() ? seekIndex.keyFrameBefore(target) : nullptr };
+    const auto seekFlags { indexedKeyFrame ? AM_SEEKING_AbsolutePositioning : AM_SEEKING_AbsolutePositioning | AM_SEEKING_SeekToKeyFrame | AM_SEEKING_ReturnTime };
+
+    auto keyFrame { indexedKeyFrame ? indexedKeyFrame->time : target };
+    auto hr { mediaSeeking->SetPositions(&keyFrame, seekFlags, nullptr, AM_SEEKING_NoPositioning) };
+
+    hr = SUCCEEDED(hr) ? mediaControl->GetState(PrerollTimeout, &filterState) : hr;
+    hr = hr == S_OK ? queryInterface(hr, IID_PPV_ARGS(&frameStep)) : E_FAIL;
+
+    const auto task = [&]() {
+        if (FAILED(hr) || !captureDisplayedFrame(true, frames))
+            return false;
+
+        const auto frameDuration { currentFrameDuration() };
+
+        for (auto frames = 0; frames < MaxGroupOfPictures; ++frames)
+        {
+            if (graphPosition + frameDuration > target)
+                return true;
+
+            hr = frameStep->Step(1, nullptr);
+
+            if (FAILED(hr) || !waitForEvent(EC_STEP_COMPLETE) || !captureDisplayedFrame(false, frames))
+                return false;
+        }
+
+        return true;
+    };
+
+    return async(task, EmptyFunction, [&]() { safeRelease(&frameStep); });
+}
+
+// Reading a frame back from the renderer is only worth it when the frame
+// can be cached, so without a budget the graph position stands in for it.
+bool VideoPlayer::captureDisplayedFrame(bool keyFrame, std::deque<VideoFrame> * frames)
+{
+    VideoFrame frame;
+
+    if (frames == nullptr && frameCache.budgetBytes() == 0)
+    {
+        framePosition = position();
+        graphPosition = framePosition;
+        return true;
+    }
+
+    if (!videoRenderer->captureFrame(&frame))
+    {
+        return false;
+    }
+
+    frame.keyFrame = keyFrame || (collectSeekIndex() && seekIndex.isKeyFrame(frame.pts, frame.duration / 2));
+    framePosition = frame.pts;
+    graphPosition = frame.pts;
+
+    if (frames == nullptr)
+    {
+        frameCache.insert(std::move(frame));
+        return true;
+    }
+
+    // A group too big for the buffer keeps its frames nearest the target;
+    // the earlier ones are decoded again once these have been shown.
+    frames->push_back(std::move(frame));
+
+    while (frames->size() > 1 && frames->size() * frames->back().pixels.size() > reverseBufferBytes)
+    {
+        frames->pop_front();
+    }
+
+    return true;
+}
+
+// Reverse playback is driven by a timer on the dispatch window, so it
+// keeps time without the app polling hasFinished, as long as it pumps
+// messages on the thread that created the player.
+void VideoPlayer::startReverse()
+{
+    const auto interval { currentFrameDuration() / 10000 / -playbackRate };
+
+    nextReverseStep = std::chrono::steady_clock::now();
+    reverseFinished = false;
+
+    if (createDispatchWindow())
+    {
+        SetTimer(dispatchWindow, ReverseTimer, std::max(static_cast<UINT>(interval), UINT(USER_TIMER_MINIMUM)), nullptr);
+    }
+}
+
+void VideoPlayer::stopReverse()
+{
+    if (dispatchWindow != nullptr)
+    {
+        KillTimer(dispatchWindow, ReverseTimer);
+    }
+
+    reverseFrames.clear();
+    MemoryGovernor::shared().releaseBuffer(reverseBufferBytes);
+    reverseBufferBytes = 0;
+}
+
+bool VideoPlayer::advanceReverse()
+{
+    const auto now { std::chrono::steady_clock::now() };
+
+    if (state != PlaybackState::Playing || playbackRate >= 0.0)
+    {
+        stopReverse();
+        return false;
+    }
+
+    if (now < nextReverseStep)
+    {
+        return true;
+    }
+
+    if (!stepReverse())
+    {
+        state = PlaybackState::Paused;
+        reverseFinished = true;
+        stopReverse();
+        return false;
+    }
+
+    const auto frameDuration { currentFrameDuration() };
+    const auto interval { std::chrono::nanoseconds(static_cast<long long>(frameDuration * 100 / -playbackRate)) };
+
+    nextReverseStep = std::max(nextReverseStep + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval), now);
+    return true;
+}
+
+// Frames come out of the buffer newest first. It only carries on from
+// the frame on show, so anything that moved the position refills it.
+bool VideoPlayer::stepReverse()
+{
+    const auto frameDuration { currentFrameDuration() };
+    const auto current { framePosition >= 0 ? framePosition : position() };
+    const auto adjacent = [&]() { return reverseFrames.back().pts < current && reverseFrames.back().pts >= current - frameDuration * 3 / 2; };
+
+    if (!reverseFrames.empty() && !adjacent())
+    {
+        reverseFrames.clear();
+    }
+
+    if (reverseFrames.empty() && !fillReverseBuffer())
+    {
+        // Renderers that cannot hand frames back are stepped as before.
+        return stepFrame(-1);
+    }
+
+    framePosition = reverseFrames.back().pts;
+    const auto presented { videoRenderer->presentFrame(&reverseFrames.back()) };
+    reverseFrames.pop_back();
+    return presented;
+}
+
+// Each group of pictures is decoded once for the frames before the one on
+// show, instead of once per frame stepped back through it.
+bool VideoPlayer::fillReverseBuffer()
+{
+    const auto current { framePosition >= 0 ? framePosition : position() };
+    const auto target { current - currentFrameDuration() };
+    VideoFrame probe;
+
+    if (target < 0 || streaming || !videoRenderer->captureFrame(&probe))
+    {
+        return false;
+    }
+
+    if (reverseBufferBytes == 0)
+    {
+        reverseBufferBytes = MemoryGovernor::shared().reserveBuffer(ReverseBufferBytes, probe.pixels.size());
+    }
+
+    if (reverseBufferBytes == 0)
+    {
+        return false;
+    }
+
+    videoRenderer->presentFrame(nullptr);
+
+    if (!decodeGroupOfPictures(target, &reverseFrames))
+    {
+        reverseFrames.clear();
+        return false;
+    }
+
+    ++playbackStats.reverseDecodes;
+    return !reverseFrames.empty();
+}
+
+REFERENCE_TIME VideoPlayer::currentFrameDuration() const
+{
+    const auto rendererDuration { videoRenderer->frameDuration() };
+    return rendererDuration > 0 ? rendererDuration : DefaultFrameDuration;
+}
+
+// Frame positions only ever describe the graph that is loaded; opening or
+// releasing a graph clears them, so a position here is always its own.
+void VideoPlayer::syncGraphPosition()
+{
+    if (mediaSeeking != nullptr && framePosition >= 0 && framePosition != graphPosition)
+    {
+        mediaSeeking->SetPositions(&framePosition, AM_SEEKING_AbsolutePositioning, nullptr, AM_SEEKING_NoPositioning);
+    }
+
+    framePosition = -1;
+    graphPosition = -1;
+}
+
+// The splitter has already scanned the file to open it, so the index is
+// only built once something needs it, on the first step backwards. Later
+// steps use it once it is ready, and a failed build is not retried.
+void VideoPlayer::loadSeekIndex()
+{
+    if (seekIndexCancelled || seekIndexFile.empty())
+    {
+        return;
+    }
+
+    const auto cancelled { std::make_shared<std::atomic<bool>>(false) };
+    const auto filename { seekIndexFile };
+    seekIndexCancelled = cancelled;
+
+    pendingSeekIndex = TaskScheduler::shared().submit([filename, cancelled]() {
+        SeekIndex index;
+        index.open(filename, cancelled.get());
+        return index;
+    }, std::chrono::steady_clock::now(), taskPriority());
+}
+
+// The task owns everything it touches, so a cancelled build is abandoned
+// rather than waited for. Waiting here would deadlock when this runs inside
+// a preroll task whose own worker queue holds the index build.
+void VideoPlayer::cancelSeekIndex()
+{
+    if (seekIndexCancelled)
+    {
+        seekIndexCancelled->store(true);
+    }
+
+    pendingSeekIndex = std::future<SeekIndex>();
+
+    seekIndex.clear();
+    seekIndexCancelled.reset();
+    seekIndexFile.clear();
+}
+
+bool VideoPlayer::collectSeekIndex()
+{
+    if (pendingSeekIndex.valid() && pendingSeekIndex.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        seekIndex = pendingSeekIndex.get();
+    }
+
+    return seekIndex.size() > 0;
+}
+
+REFERENCE_TIME VideoPlayer::position() const
+{
+    auto current { 0LL };
+    return mediaSeeking && SUCCEEDED(mediaSeeking->GetCurrentPosition(&current)) ? current : 0LL;
+}
+
+REFERENCE_TIME VideoPlayer::duration() const
+{
+    auto length { 0LL };
+    return mediaSeeking && SUCCEEDED(mediaSeeking->GetDuration(&length)) ? length : 0LL;
+}
+
+bool VideoPlayer::setFrameCacheBudget(size_t bytes, size_t compressedBytes)
+{
+    frameCache.setBudget(bytes);
+    frameCache.setCompressedBudget(compressedBytes);
+    return true;
+}
+
+bool VideoPlayer::setReadAhead(size_t windowBytes, REFERENCE_TIME windowTime)
+{
+    if (windowTime < 0)
+    {
+        return false;
+    }
+
+    readAheadBytes = windowBytes;
+    readAheadTime = windowTime;
+    return true;
+}
+
+bool VideoPlayer::hasVideo() const
 {
     return videoRenderer && videoRenderer->hasVideo();
 }
 
-bool VideoPlayer::hasFinished() const
+bool VideoPlayer::hasFinished()
+{
+    if(mediaEvents == nullptr) 
+    {
+        return false;
+    }
+
+    auto param1 {0L};
+    auto param2 {0L};
+    auto evCode {0L};
+
+    scheduleHandoff();
+    frameCache.trim();
+
+    // The run transition only completes once the renderer has its first
+    // sample, so this is when a clip opened without a poster first paints.
+    OAFilterState filterState;
+
+    if (!firstFrameShown && state == PlaybackState::Playing && mediaControl->GetState(0, &filterState) == S_OK)
+    {
+        markFirstFrame();
+    }
+
+    if (playbackRate < 0.0 && state == PlaybackState::Playing)
+    {
+        advanceReverse();
+    }
+
+    if (reverseFinished)
+    {
+        reverseFinished = false;
+        return true;
+    }
+
+    if (pendingEvent != 0)
+    {
+        evCode = pendingEvent;
+        pendingEvent = 0;
+
+        if (handleEvent(evCode))
+        {
+            return true;
+        }
+    }
+
+    while (SUCCEEDED(mediaEvents->GetEvent(&evCode, &param1, &param2, 0)))
+    {
+        auto hr = mediaEvents->FreeEventParams(evCode, param1, param2);
+        
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        if (handleEvent(evCode))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool VideoPlayer::handleEvent(long evCode)
+{
+    if (evCode != EC_COMPLETE && evCode != EC_END_OF_SEGMENT)
+    {
+        return false;
+    }
+
+    if (startNextVideo())
+    {
+        return false;
+    }
+
+    if (evCode == EC_END_OF_SEGMENT && looping && restartLoop(AM_SEEKING_Segment | AM_SEEKING_NoFlush)) 
+    {
+        return false;
+    }
+
+    return !(looping && restartLoop(AM_SEEKING_Segment));
+}
+
+bool VideoPlayer::waitForEvent(long evCode)
+{
+    auto param1 {0L};
+    auto param2 {0L};
+    auto received {0L};
+
+    while (SUCCEEDED(mediaEvents->GetEvent(&received, &param1, &param2, PrerollTimeout)))
+    {
+        mediaEvents->FreeEventParams(received, param1, param2);
+
+        if (received == evCode)
+        {
+            return true;
+        }
+
+        if (received == EC_COMPLETE || received == EC_END_OF_SEGMENT)
+        {
+            pendingEvent = received;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool VideoPlayer::isLooping() const
+{
+    return looping;
+}
+
+bool VideoPlayer::setLooping(bool loop)
+{
+    looping = loop;
+    return state != PlaybackState::Stopped || armLoopSegment();
+}
+
+bool VideoPlayer::armLoopSegment()
+{
+    if (mediaSeeking == nullptr || streaming)
+    {
+        return false;
+    }
+
+    auto current { 0LL };
+    auto hr { mediaSeeking->GetCurrentPosition(&current) };
+
+    if (SUCCEEDED(hr))
+    {
+        const auto flags { AM_SEEKING_AbsolutePositioning | (looping ? AM_SEEKING_Segment : 0) };
+        hr = mediaSeeking->SetPositions(&current, flags, nullptr, AM_SEEKING_NoPositioning);
+    }
+
+    return SUCCEEDED(hr);
+}
+
+bool VideoPlayer::restartLoop(DWORD flags)
+{
+    if (streaming)
+    {
+        return false;
+    }
+
+    auto start { 0LL };
+    auto hr { mediaSeeking->SetPositions(&start, AM_SEEKING_AbsolutePositioning | flags, nullptr, AM_SEEKING_NoPositioning) };
+
+    if (SUCCEEDED(hr))
+    {
+        ++playbackStats.loops;
+    }
+
+    return SUCCEEDED(hr);
+}
+
+bool VideoPlayer::queueVideo(const std::string& filename)
+{
+    if (!mediaExists(filename))
+    {
+        return false;
+    }
+
+    playlist.push_back(filename);
+    prerollNextVideo();
+    return true;
+}
+
+void VideoPlayer::clearQueue()
+{
+    playlist.clear();
+
+    // The preroll wait holds its own reference to the graph, so the player
+    // can go without waiting for it.
+    if (nextVideo != nullptr)
+    {
+        nextVideo->disarmHandoffReveal();
+    }
+
+    safeDelete(&nextVideo);
+    nextVideoReady = std::future<bool>();
+    nextVideoFile.clear();
+    handoffScheduled = false;
+}
+
+size_t VideoPlayer::queuedVideos() const
+{
+    return playlist.size() + (nextVideo != nullptr ? 1 : 0);
+}
+
+// The next graph is built here, on the thread that drives it, like any
+// other. Only the wait for the paused graph to fill runs on the shared
+// workers, with its own reference to the graph.
+void VideoPlayer::prerollNextVideo()
+{
+    while (!playlist.empty() && nextVideo == nullptr)
+    {
+        const auto filename { playlist.front() };
+        auto next { new VideoPlayer(windowHandle) };
+
+        safeRelease(&next->manualClock);
+        next->manualClock = manualClock;
+        next->manualClock->AddRef();
+        next->clock = clock;
+        next->readAheadBytes = readAheadBytes;
+        next->readAheadTime = readAheadTime;
+        next->priority = priority;
+        next->destination = destination;
+        next->aspectMode = aspectMode;
+        next->visibilityMode = visibilityMode;
+        next->lowLatency = lowLatency;
+
+        // Each target is copied so the next graph is wired up before it
+        // takes over; one that cannot be copied is rewired after the swap.
+        for (const auto& target : renderTargets)
+        {
+            const auto copy { target.renderer->clone() };
+
+            if (copy != nullptr)
+            {
+                next->renderTargets.push_back({ target.registered, copy, target.window, RECT {}, false });
+            }
+        }
+
+        playlist.pop_front();
+
+        if (!next->openVideo(filename))
+        {
+            safeDelete(&next);
+            continue;
+        }
+
+        shareClock(*next);
+
+        if (!next->preroll())
+        {
+            safeDelete(&next);
+            continue;
+        }
+
+        // The handoff is due when the current clip runs out, which makes that
+        // the deadline for the shared scheduler to order prerolls by.
+        const auto remaining { state == PlaybackState::Playing ? (duration() - position()) / std::abs(playbackRate) : 0.0 };
+        const auto deadline { std::chrono::steady_clock::now() + std::chrono::microseconds(static_cast<long long>(std::max(remaining, 0.0) / 10)) };
+        const auto graph { next->mediaControl };
+
+        graph->AddRef();
+        nextVideo = next;
+        nextVideoFile = filename;
+        nextVideoReady = TaskScheduler::shared().submit([graph]() {
+            OAFilterState filterState;
+            const auto hr { graph->GetState(PrerollTimeout, &filterState) };
+            graph->Release();
+            return SUCCEEDED(hr);
+        }, deadline, taskPriority());
+    }
+}
+
+// Starts filling the graph while it stays hidden. The pause completes in
+// the background; prerollNextVideo waits for it off this thread.
+bool VideoPlayer::preroll()
+{
+    RECT hidden { 0, 0, 0, 0 };
+    videoRenderer->updateVideoWindow(windowHandle, &hidden);
+
+    for (const auto& target : renderTargets)
+    {
+        target.renderer->setVisible(false);
+    }
+
+    const auto hr { mediaControl->Pause() };
+
+    if (SUCCEEDED(hr))
+    {
+        state = PlaybackState::Paused;
+    }
+
+    return SUCCEEDED(hr);
+}
+
+// A graph can only be started at a time on its own clock, so the next clip
+// runs off this one's to start exactly where this one ends. The clock can
+// only be changed while the next graph is still stopped.
+bool VideoPlayer::shareClock(VideoPlayer& next) const
+{
+    if (graphBuilder == nullptr)
+    {
+        return false;
+    }
+
+    IMediaFilter * mediaFilter { nullptr };
+    IMediaFilter * nextFilter { nullptr };
+    IReferenceClock * referenceClock { nullptr };
+
+    auto hr { queryInterface(S_OK, IID_PPV_ARGS(&mediaFilter)) };
+    hr = next.queryInterface(hr, IID_PPV_ARGS(&nextFilter));
+    hr = SUCCEEDED(hr) ? mediaFilter->GetSyncSource(&referenceClock) : hr;
+    hr = SUCCEEDED(hr) && referenceClock != nullptr ? nextFilter->SetSyncSource(referenceClock) : E_FAIL;
+
+    safeRelease(&referenceClock);
+    safeRelease(&nextFilter);
+    safeRelease(&mediaFilter);
+    return SUCCEEDED(hr);
+}
+
+// Both graphs share this one's clock, so the next is started on it at the
+// moment this clip runs out. The media time left is scaled by the rate to
+// get the clock time left. A next graph that kept its own clock, because
+// it was queued before this one opened, is started by startNextVideo.
+bool VideoPlayer::scheduleHandoff()
+{
+    if (nextVideo == nullptr || handoffScheduled || state != PlaybackState::Playing || playbackRate <= 0.0)
+    {
+        return false;
+    }
+
+    if (nextVideoReady.valid())
+    {
+        if (nextVideoReady.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return false;
+        }
+
+        if (!nextVideoReady.get())
+        {
+            safeDelete(&nextVideo);
+            prerollNextVideo();
+            return false;
+        }
+    }
+
+    auto current { 0LL };
+    auto stopTime { 0LL };
+    auto hr { mediaSeeking->GetCurrentPosition(&current) };
+
+    if (SUCCEEDED(hr))
+    {
+        hr = mediaSeeking->GetStopPosition(&stopTime);
+    }
+
+    const auto delay { static_cast<REFERENCE_TIME>((stopTime - current) / playbackRate) };
+
+    if (FAILED(hr) || delay > HandoffWindow)
+    {
+        return false;
+    }
+
+    IMediaFilter * mediaFilter { nullptr };
+    IMediaFilter * nextFilter { nullptr };
+    IReferenceClock * referenceClock { nullptr };
+    IReferenceClock * nextClock { nullptr };
+
+    hr = queryInterface(hr, IID_PPV_ARGS(&mediaFilter));
+    hr = nextVideo->queryInterface(hr, IID_PPV_ARGS(&nextFilter));
+
+    const auto task = [&]() {
+        if (FAILED(hr))
+            return false;
+
+        hr = mediaFilter->GetSyncSource(&referenceClock);
+        hr = SUCCEEDED(hr) ? nextFilter->GetSyncSource(&nextClock) : hr;
+
+        if (FAILED(hr) || referenceClock == nullptr || nextClock != referenceClock)
+            return false;
+
+        auto now { 0LL };
+        hr = referenceClock->GetTime(&now);
+
+        if (FAILED(hr))
+            return false;
+
+        hr = nextFilter->Run(now + delay);
+
+        if (SUCCEEDED(hr))
+        {
+            nextVideo->armHandoffReveal(referenceClock, now, delay);
+        }
+
+        return SUCCEEDED(hr);
+    };
+
+    const auto cleanup = [&]() {
+        safeRelease(&nextClock);
+        safeRelease(&referenceClock);
+        safeRelease(&nextFilter);
+        safeRelease(&mediaFilter);
+    };
+
+    handoffScheduled = async(task, EmptyFunction, cleanup);
+    return handoffScheduled;
+}
+
+void VideoPlayer::cancelHandoff()
+{
+    if (!handoffScheduled)
+    {
+        return;
+    }
+
+    // The reveal may already have shown the next clip, so hide it again
+    // until it is rescheduled or started by hand.
+    RECT hidden { 0, 0, 0, 0 };
+    auto start { 0LL };
+    nextVideo->disarmHandoffReveal();
+    nextVideo->mediaControl->Pause();
+    nextVideo->mediaSeeking->SetPositions(&start, AM_SEEKING_AbsolutePositioning, nullptr, AM_SEEKING_NoPositioning);
+    nextVideo->videoRenderer->updateVideoWindow(windowHandle, &hidden);
+    nextVideo->windowRect = hidden;
+    nextVideo->revealPosition = -1;
+
+    for (const auto& target : nextVideo->renderTargets)
+    {
+        target.renderer->setVisible(false);
+    }
+    handoffScheduled = false;
+}
+
+// The prerolled clip stays hidden until its graph starts at the handoff
+// deadline, rather than until the app next polls hasFinished, so it is
+// revealed on its first frame. Arming is best effort; without it the clip
+// is revealed by startNextVideo.
+bool VideoPlayer::armHandoffReveal(IReferenceClock * referenceClock, REFERENCE_TIME baseTime, REFERENCE_TIME delay)
+{
+    if (!createDispatchWindow())
+    {
+        return false;
+    }
+
+    handoffEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+
+    if (handoffEvent == nullptr)
+    {
+        return false;
+    }
+
+    auto hr { referenceClock->AdviseTime(baseTime, delay, reinterpret_cast<HEVENT>(handoffEvent), &handoffAdvise) };
+
+    if (SUCCEEDED(hr))
+    {
+        handoffClock = referenceClock;
+        handoffClock->AddRef();
+    }
+
+    if (SUCCEEDED(hr) && !RegisterWaitForSingleObject(&handoffWait, handoffEvent, revealHandoff, dispatchWindow, INFINITE, WT_EXECUTEONLYONCE))
+    {
+        handoffWait = nullptr;
+        hr = E_FAIL;
+    }
+
+    if (FAILED(hr))
+    {
+        disarmHandoffReveal();
+    }
+
+    return SUCCEEDED(hr);
+}
+
+// Waits for a reveal that is already running, so the player can be
+// swapped or deleted afterwards.
+void VideoPlayer::disarmHandoffReveal()
+{
+    if (handoffWait != nullptr)
+    {
+        UnregisterWaitEx(handoffWait, INVALID_HANDLE_VALUE);
+        handoffWait = nullptr;
+    }
+
+    if (handoffClock != nullptr)
+    {
+        handoffClock->Unadvise(handoffAdvise);
+        safeRelease(&handoffClock);
+    }
+
+    if (handoffEvent != nullptr)
+    {
+        CloseHandle(handoffEvent);
+        handoffEvent = nullptr;
+    }
+
+    handoffAdvise = 0;
+}
+
+// Runs on a thread pool thread when the next graph starts, so it only
+// hands the reveal over to the thread that owns the player.
+void CALLBACK VideoPlayer::revealHandoff(PVOID context, BOOLEAN)
+{
+    PostMessageW(static_cast<HWND>(context), RevealMessage, 0, 0);
+}
+
+// Callbacks from other threads post to this window, so the work they ask
+// for runs on the thread that created the player, from whatever message
+// loop the app already pumps.
+bool VideoPlayer::createDispatchWindow()
+{
+    if (dispatchWindow != nullptr)
+    {
+        return true;
+    }
+
+    WNDCLASSEXW windowClass {};
+    windowClass.cbSize = sizeof(windowClass);
+    windowClass.lpfnWndProc = dispatchMessage;
+    windowClass.hInstance = GetModuleHandleW(nullptr);
+    windowClass.lpszClassName = DispatchWindowClass;
+
+    if (!RegisterClassExW(&windowClass) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+    {
+        return false;
+    }
+
+    dispatchWindow = CreateWindowExW(0, DispatchWindowClass, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, windowClass.hInstance, nullptr);
+
+    if (dispatchWindow == nullptr)
+    {
+        return false;
+    }
+
+    SetWindowLongPtrW(dispatchWindow, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
+    return true;
+}
+
+// Steps reverse playback on its timer, and reveals a prerolled clip. A
+// reveal posted just before the handoff was disarmed is dropped, so a
+// cancelled handoff stays hidden. The window rect is still empty from the
+// preroll, so this pushes the real one.
+LRESULT CALLBACK VideoPlayer::dispatchMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    const auto player { reinterpret_cast<VideoPlayer*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA)) };
+
+    if (player != nullptr && message == WM_TIMER && wParam == ReverseTimer)
+    {
+        player->advanceReverse();
+        return 0;
+    }
+
+    if (player == nullptr || message != RevealMessage)
+    {
+        return DefWindowProcW(hwnd, message, wParam, lParam);
+    }
+
+    if (player->handoffClock != nullptr)
+    {
+        for (const auto& target : player->renderTargets)
+        {
+            target.renderer->setVisible(player->visibilityMode == Visibility::Visible);
+        }
+
+        player->updateVideoWindow();
+        player->revealPosition = player->position();
+    }
+
+    return 0;
+}
+
+bool VideoPlayer::startNextVideo()
 {
-    auto returnValue {false};
+    if (nextVideo == nullptr)
+    {
+        return false;
+    }
 
-    if(mediaEvents == nullptr) 
+    if (nextVideoReady.valid() && nextVideoReady.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
     {
-        return returnValue;
+        return openNextVideo();
     }
 
-    auto param1 {0L};
-    auto param2 {0L};
-    auto evCode {0L};
+    if (nextVideoReady.valid() && !nextVideoReady.get())
+    {
+        safeDelete(&nextVideo);
+        prerollNextVideo();
+        return false;
+    }
 
-    while (SUCCEEDED(mediaEvents->GetEvent(&evCode, &param1, &param2, 0)))
+    if (!handoffScheduled && FAILED(nextVideo->mediaControl->Run()))
     {
-        auto hr = mediaEvents->FreeEventParams(evCode, param1, param2);
-        
-        if (FAILED(hr))
+        safeDelete(&nextVideo);
+        prerollNextVideo();
+        return false;
+    }
+
+    nextVideo->disarmHandoffReveal();
+    const auto revealedAt { nextVideo->revealPosition >= 0 ? nextVideo->revealPosition : nextVideo->position() };
+
+    swapGraph(*nextVideo);
+    std::swap(renderTargets, nextVideo->renderTargets);
+
+    // Targets that could not be copied, or were added after the preroll,
+    // are still wired into the graph being retired, so only they are
+    // rewired, at the cost of a stop.
+    for (const auto& target : nextVideo->renderTargets)
+    {
+        const auto copied = [&](const RenderTarget& candidate) { return candidate.registered == target.registered; };
+
+        if (!std::any_of(renderTargets.begin(), renderTargets.end(), copied))
         {
-            break;
+            renderTargets.push_back({ target.registered, target.renderer, target.window, RECT {}, false });
         }
+    }
+
+    safeDelete(&nextVideo);
+    frameCache.clear();
+
+    handoffScheduled = false;
+    state = PlaybackState::Playing;
+    playbackStats.handoffPosition = revealedAt;
+    ++playbackStats.transitions;
+
+    const auto pending = [](const RenderTarget& target) { return !target.attached; };
+
+    if (std::any_of(renderTargets.begin(), renderTargets.end(), pending))
+    {
+        reconnectGraph([&]() { return attachRenderTargets(); });
+    }
+
+    for (const auto& target : renderTargets)
+    {
+        target.renderer->setVisible(visibilityMode == Visibility::Visible);
+    }
+
+    videoRenderer->setVisible(visibilityMode == Visibility::Visible);
+    invalidateVideoWindow();
+    updateVideoWindow();
+    repaint();
+    prerollNextVideo();
+    return true;
+}
+
+// The preroll has not finished by the end of the clip, so rather than
+// block on it the file is opened again in this player, which is no slower
+// than opening it by hand.
+bool VideoPlayer::openNextVideo()
+{
+    const auto filename { nextVideoFile };
 
-        if (evCode == EC_COMPLETE) 
+    nextVideo->disarmHandoffReveal();
+    safeDelete(&nextVideo);
+    nextVideoReady = std::future<bool>();
+    nextVideoFile.clear();
+    handoffScheduled = false;
+
+    if (!openVideo(filename) || !play())
+    {
+        prerollNextVideo();
+        return false;
+    }
+
+    playbackStats.handoffPosition = position();
+    ++playbackStats.transitions;
+    prerollNextVideo();
+    return true;
+}
+
+void VideoPlayer::swapPlayer(VideoPlayer& other)
+{
+    swapGraph(other);
+    std::swap(manualClock, other.manualClock);
+    std::swap(nextVideo, other.nextVideo);
+    std::swap(nextVideoReady, other.nextVideoReady);
+    std::swap(nextVideoFile, other.nextVideoFile);
+    std::swap(dispatchWindow, other.dispatchWindow);
+    std::swap(playlist, other.playlist);
+    std::swap(frameCache, other.frameCache);
+    std::swap(playbackStats, other.playbackStats);
+    std::swap(clock, other.clock);
+    std::swap(nextReverseStep, other.nextReverseStep);
+    std::swap(reverseFrames, other.reverseFrames);
+    std::swap(reverseBufferBytes, other.reverseBufferBytes);
+    std::swap(reverseFinished, other.reverseFinished);
+    std::swap(openedAt, other.openedAt);
+    std::swap(posterTime, other.posterTime);
+    std::swap(firstFrameShown, other.firstFrameShown);
+    std::swap(lowLatency, other.lowLatency);
+    std::swap(playbackRate, other.playbackRate);
+    std::swap(windowHandle, other.windowHandle);
+    std::swap(destination, other.destination);
+    std::swap(aspectMode, other.aspectMode);
+    std::swap(visibilityMode, other.visibilityMode);
+    std::swap(priority, other.priority);
+    std::swap(error, other.error);
+    std::swap(renderTargets, other.renderTargets);
+    std::swap(readAheadBytes, other.readAheadBytes);
+    std::swap(readAheadTime, other.readAheadTime);
+    std::swap(looping, other.looping);
+    std::swap(handoffScheduled, other.handoffScheduled);
+
+    for (auto player : { this, &other })
+    {
+        if (player->dispatchWindow != nullptr)
         {
-            returnValue = true;
-            break;
+            SetWindowLongPtrW(player->dispatchWindow, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(player));
         }
     }
+}
 
-    return returnValue;
+void VideoPlayer::swapGraph(VideoPlayer& other)
+{
+    std::swap(graphBuilder, other.graphBuilder);
+    std::swap(mediaControl, other.mediaControl);
+    std::swap(mediaEvents, other.mediaEvents);
+    std::swap(mediaSeeking, other.mediaSeeking);
+    std::swap(sourceFilter, other.sourceFilter);
+    std::swap(readAheadSource, other.readAheadSource);
+    std::swap(streaming, other.streaming);
+    std::swap(framePosition, other.framePosition);
+    std::swap(graphPosition, other.graphPosition);
+    std::swap(windowRect, other.windowRect);
+    std::swap(windowDirty, other.windowDirty);
+    std::swap(repaintDue, other.repaintDue);
+    std::swap(pendingEvent, other.pendingEvent);
+    std::swap(seekIndex, other.seekIndex);
+    std::swap(pendingSeekIndex, other.pendingSeekIndex);
+    std::swap(seekIndexCancelled, other.seekIndexCancelled);
+    std::swap(seekIndexFile, other.seekIndexFile);
+    std::swap(videoRenderer, other.videoRenderer);
+    std::swap(renderersReady, other.renderersReady);
+    std::swap(state, other.state);
 }
 
-bool VideoPlayer::updateVideoWindow() const
+// Renderers are only repositioned when their rectangle has changed since
+// it was last pushed, so callers can keep calling this every frame.
+bool VideoPlayer::updateVideoWindow()
 {
-    RECT rc;
-    GetClientRect(windowHandle, &rc);
-    return SUCCEEDED(videoRenderer ? videoRenderer->updateVideoWindow(windowHandle, &rc) : S_OK);
+    auto rc { destination };
+    auto updated { true };
+    auto elided { true };
+
+    // Hidden renderers have an empty destination until they are shown
+    // again, which invalidates the window, so there is nothing to push.
+    if (visibilityMode != Visibility::Visible)
+    {
+        ++playbackStats.elidedUpdates;
+        return true;
+    }
+
+    if (IsRectEmpty(&rc))
+    {
+        GetClientRect(windowHandle, &rc);
+    }
+
+    for (auto& target : renderTargets)
+    {
+        RECT targetRect {};
+
+        if (!target.attached || target.window == nullptr || !GetClientRect(target.window, &targetRect) || (!windowDirty && EqualRect(&targetRect, &target.rect)))
+        {
+            continue;
+        }
+
+        target.rect = targetRect;
+        target.renderer->updateVideoWindow(target.window, &targetRect);
+        elided = false;
+    }
+
+    if (videoRenderer != nullptr && (windowDirty || !EqualRect(&rc, &windowRect)))
+    {
+        windowRect = rc;
+        updated = videoRenderer->updateVideoWindow(windowHandle, &rc);
+        elided = false;
+    }
+
+    if (elided)
+    {
+        ++playbackStats.elidedUpdates;
+        return true;
+    }
+
+    windowDirty = false;
+    repaintDue = true;
+    return updated;
 }
 
-bool VideoPlayer::repaint() const
+// While playing the renderer presents frames by itself, so a repaint is
+// only needed after the layout changed or the window was invalidated. A
+// paused or stopped renderer only redraws when asked, and callers cant be
+// relied on to report every exposure, so those repaints always go through.
+bool VideoPlayer::repaint()
 {
+    if (visibilityMode != Visibility::Visible || (state == PlaybackState::Playing && !repaintDue))
+    {
+        ++playbackStats.elidedRepaints;
+        return true;
+    }
+
+    repaintDue = false;
+
+    for (const auto& target : renderTargets)
+    {
+        if (target.attached)
+        {
+            target.renderer->repaint();
+        }
+    }
+
     return SUCCEEDED(videoRenderer ? videoRenderer->repaint() : S_OK);
 }
 
+void VideoPlayer::invalidateVideoWindow()
+{
+    windowDirty = true;
+    repaintDue = true;
+}
+
 HRESULT VideoPlayer::queryInterface(HRESULT prevResult, const IID& riid, void ** pvObject) const
 {
     return SUCCEEDED(prevResult) ? graphBuilder->QueryInterface(riid, pvObject) : E_FAIL;
@@ -456,6 +2985,12 @@ HRESULT VideoPlayer::queryInterface(HRESULT prevResult, const IID& riid, void **
 
 bool VideoPlayer::setupGraph()
 {
+    if (graphBuilder != nullptr && sourceFilter == nullptr)
+    {
+        state = PlaybackState::Stopped;
+        return true;
+    }
+
     releaseGraph();
 
     auto hr { CoCreateInstance(CLSID_FilterGraph, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&graphBuilder)) };
@@ -479,8 +3014,20 @@ bool VideoPlayer::setupGraph()
 
 void VideoPlayer::releaseGraph()
 {
+    stopReverse();
     state = PlaybackState::NoVideo;
+    streaming = false;
+    renderersReady = false;
+    framePosition = -1;
+    graphPosition = -1;
 
+    for (auto& target : renderTargets)
+    {
+        target.attached = false;
+    }
+
+    safeRelease(&sourceFilter);
+    safeRelease(&readAheadSource);
     safeRelease(&graphBuilder);
     safeRelease(&mediaControl);
     safeRelease(&mediaSeeking);
@@ -492,6 +3039,252 @@ PlaybackState VideoPlayer::playbackState() const
     return state;
 }
 
+ClockMode VideoPlayer::clockMode() const
+{
+    return clock;
+}
+
+PlaybackStats VideoPlayer::stats() const
+{
+    auto currentStats { playbackStats };
+    currentStats.cacheHits = frameCache.hits();
+    currentStats.cacheMisses = frameCache.misses();
+    currentStats.compressedCacheHits = frameCache.compressedHits();
+
+    if (readAheadSource != nullptr)
+    {
+        const auto readStats { readAheadSource->stats() };
+        currentStats.bytesPrefetched = readStats.bytesPrefetched;
+        currentStats.readStalls = readStats.stalls;
+        currentStats.readBlockedTime = readStats.blockedTime;
+        currentStats.frameLatency = readStats.lastLatency;
+        currentStats.averageFrameLatency = readStats.latencySamples > 0 ? readStats.totalLatency / static_cast<REFERENCE_TIME>(readStats.latencySamples) : 0;
+        currentStats.maxFrameLatency = readStats.maxLatency;
+    }
+
+    return currentStats;
+}
+
+bool VideoPlayer::setPriority(TaskPriority taskPriority)
+{
+    priority = taskPriority;
+    return true;
+}
+
+// Hidden players keep their graph running so the clock and audio carry
+// on, but renderers stop presenting and window work is skipped. Coming
+// back into view repositions, re-presents a paused frame and repaints.
+bool VideoPlayer::setVisibility(Visibility mode)
+{
+    if (mode == visibilityMode)
+    {
+        return true;
+    }
+
+    const auto visible { mode == Visibility::Visible };
+    auto applied { true };
+    visibilityMode = mode;
+
+    for (const auto& target : renderTargets)
+    {
+        applied = target.renderer->setVisible(visible) && applied;
+    }
+
+    applied = (videoRenderer == nullptr || videoRenderer->setVisible(visible)) && applied;
+
+    if (!visible)
+    {
+        return applied;
+    }
+
+    const auto cachedFrame { state == PlaybackState::Paused && framePosition >= 0 ? frameCache.find(VideoStream, framePosition) : nullptr };
+
+    if (cachedFrame != nullptr)
+    {
+        videoRenderer->presentFrame(cachedFrame);
+    }
+
+    invalidateVideoWindow();
+    return updateVideoWindow() && repaint() && applied;
+}
+
+Visibility VideoPlayer::visibility() const
+{
+    return visibilityMode;
+}
+
+// Background work for a player nobody can see yields to visible players.
+TaskPriority VideoPlayer::taskPriority() const
+{
+    return visibilityMode == Visibility::Visible ? priority : TaskPriority::Background;
+}
+
+MemoryUsage VideoPlayer::memoryUsage() const
+{
+    MemoryUsage usage { frameCache.usedBytes() + frameCache.compressedBytes(), 0 };
+
+    if (readAheadSource != nullptr)
+    {
+        usage.bufferBytes = readAheadSource->stats().bufferBytes;
+    }
+
+    usage.bufferBytes += reverseBufferBytes;
+
+    if (nextVideo != nullptr)
+    {
+        const auto nextUsage { nextVideo->memoryUsage() };
+        usage.cacheBytes += nextUsage.cacheBytes;
+        usage.bufferBytes += nextUsage.bufferBytes;
+    }
+
+    return usage;
+}
+
+PlayerError VideoPlayer::lastError() const
+{
+    return error;
+}
+
+bool VideoPlayer::setClockMode(ClockMode mode)
+{
+    if (state == PlaybackState::Playing || state == PlaybackState::Paused)
+    {
+        return false;
+    }
+
+    clock = mode;
+    return graphBuilder == nullptr || applyClockMode();
+}
+
+bool VideoPlayer::advanceClock(REFERENCE_TIME elapsed)
+{
+    if (clock != ClockMode::Manual || elapsed < 0)
+    {
+        return false;
+    }
+
+    manualClock->advance(elapsed);
+    return true;
+}
+
+bool VideoPlayer::applyClockMode()
+{
+    IMediaFilter * mediaFilter { nullptr };
+    auto hr { graphBuilder->QueryInterface(IID_PPV_ARGS(&mediaFilter)) };
+
+    const auto task = [&]() {
+        if (FAILED(hr))
+            return false;
+
+        // Without a clock every renderer presents a sample as soon as it
+        // arrives, which is what low latency mode wants from the graph.
+        switch (lowLatency ? ClockMode::Unthrottled : clock)
+        {
+        case ClockMode::Unthrottled: 
+            hr = mediaFilter->SetSyncSource(nullptr); 
+            break;
+        case ClockMode::Manual: 
+            hr = mediaFilter->SetSyncSource(manualClock); 
+            break;
+        default: 
+            hr = graphBuilder->SetDefaultSyncSource(); 
+            break;
+        }
+
+        return SUCCEEDED(hr);
+    };
+
+    return async(task, EmptyFunction, [&]() { safeRelease(&mediaFilter); });
+}
+
+bool VideoPlayer::attachRenderTargets()
+{
+    const auto pending = [](const RenderTarget& target) { return !target.attached; };
+
+    if (!std::any_of(renderTargets.begin(), renderTargets.end(), pending) || videoRenderer->filter() == nullptr)
+    {
+        return true;
+    }
+
+    // The primary renderer has to take the type; a target that cannot is
+    // left unattached, so it weighs heavier than any conversion.
+    const auto cost = [&](const AM_MEDIA_TYPE& type) {
+        auto total { videoRenderer->conversionCost(type) };
+
+        for (auto target = renderTargets.begin(); total >= 0 && target != renderTargets.end(); ++target)
+        {
+            const auto targetCost { target->attached ? 0 : target->renderer->conversionCost(type) };
+            total += targetCost >= 0 ? targetCost : UnservedTargetCost;
+        }
+
+        return total;
+    };
+
+    IBaseFilter * tee { nullptr };
+
+    if (!insertTee(graphBuilder, videoRenderer->filter(), cost, &tee))
+    {
+        return false;
+    }
+
+    auto attachedAll { true };
+
+    for (auto& target : renderTargets)
+    {
+        if (target.attached)
+        {
+            continue;
+        }
+
+        IPin * teeOutput { nullptr };
+        IPin * targetInput { nullptr };
+
+        target.attached = target.renderer->addToGraph(graphBuilder, target.window) &&
+            findUnconnectedPin(tee, PINDIR_OUTPUT, &teeOutput) &&
+            findUnconnectedPin(target.renderer->filter(), PINDIR_INPUT, &targetInput) &&
+            SUCCEEDED(graphBuilder->Connect(teeOutput, targetInput)) &&
+            target.renderer->finaliseGraph(graphBuilder);
+
+        if (!target.attached && target.renderer->filter() != nullptr)
+        {
+            graphBuilder->RemoveFilter(target.renderer->filter());
+        }
+
+        attachedAll = attachedAll && target.attached;
+
+        safeRelease(&targetInput);
+        safeRelease(&teeOutput);
+    }
+
+    tee->Release();
+    return applyClockMode() && attachedAll;
+}
+
+// Pins can only be connected while the graph is stopped, so a running player
+// is stopped around the change and put back at the same position and state.
+bool VideoPlayer::reconnectGraph(const std::function<bool()>& change)
+{
+    if (state != PlaybackState::Playing && state != PlaybackState::Paused)
+    {
+        return change();
+    }
+
+    if (streaming)
+    {
+        return false;
+    }
+
+    cancelHandoff();
+
+    auto resumeAt { framePosition >= 0 ? framePosition : position() };
+    const auto changed { SUCCEEDED(mediaControl->Stop()) && change() };
+
+    mediaSeeking->SetPositions(&resumeAt, AM_SEEKING_AbsolutePositioning | (looping ? AM_SEEKING_Segment : 0), nullptr, AM_SEEKING_NoPositioning);
+
+    const auto hr { state == PlaybackState::Playing && playbackRate >= 0.0 ? mediaControl->Run() : mediaControl->Pause() };
+    return changed && SUCCEEDED(hr);
+}
+
 bool VideoPlayer::createVideoRenderer() const
 {
     auto hr { E_FAIL };
@@ -502,7 +3295,9 @@ bool VideoPlayer::createVideoRenderer() const
         return false;
     }
 
-    return SUCCEEDED(videoRenderer->addToGraph(graphBuilder, windowHandle));
+    videoRenderer->setAspectMode(aspectMode);
+    videoRenderer->setVisible(visibilityMode == Visibility::Visible);
+    return videoRenderer->addToGraph(graphBuilder, windowHandle);
 }
 
 bool VideoPlayer::renderStreams(RenderStreamsParams * params) const
@@ -512,14 +3307,16 @@ bool VideoPlayer::renderStreams(RenderStreamsParams * params) const
         return false;
     }
 
-    params->hr = createVideoRenderer();
+    params->hr = renderersReady || createVideoRenderer() ? S_OK : E_FAIL;
 
     if (FAILED(params->hr))
     {
         return false;
     }
 
-    params->hr = addFilterByCLSID(graphBuilder, CLSID_DSoundRender, &params->audioRenderer, L"Audio Renderer");
+    params->hr = renderersReady ?
+        graphBuilder->FindFilterByName(AudioRendererName, &params->audioRenderer) :
+        addFilterByCLSID(graphBuilder, CLSID_DSoundRender, &params->audioRenderer, AudioRendererName);
 
     if (FAILED(params->hr))
     {
@@ -580,10 +3377,65 @@ bool VideoPlayer::renderStreams(IBaseFilter * source)
             enumPins, hr, renderedAnyPin
         };
 
-        return renderStreams(&params);
+        const auto rendered { renderStreams(&params) };
+        audioRenderer = params.audioRenderer;
+        enumPins = params.pins;
+        return rendered;
     };
 
-    return async(task, cleanup);
+    const auto rendered { async(task, cleanup) };
+    renderersReady = false;
+
+    if (rendered)
+    {
+        attachRenderTargets();
+        invalidateVideoWindow();
+
+        if (lowLatency)
+        {
+            capSampleQueues(graphBuilder, LowLatencyBuffers);
+        }
+    }
+
+    return rendered;
+}
+
+PlayerPool::PlayerPool(size_t count, HWND hwnd)
+{
+    players.reserve(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        players.emplace_back(hwnd);
+        players.back().warmUp();
+    }
+}
+
+VideoPlayer PlayerPool::acquire(HWND hwnd)
+{
+    if (players.empty())
+    {
+        VideoPlayer player(hwnd);
+        player.warmUp();
+        return player;
+    }
+
+    auto player { std::move(players.back()) };
+    players.pop_back();
+    player.setVideoWindow(hwnd);
+    return player;
+}
+
+void PlayerPool::release(VideoPlayer&& player)
+{
+    player.reset();
+    player.warmUp();
+    players.push_back(std::move(player));
+}
+
+size_t PlayerPool::available() const
+{
+    return players.size();
 }
 
 Version getVersion()
@@ -11,17 +11,126 @@
 #include <Windows.h>
 #include <dshow.h>
 #include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <functional>
 #include <Evr.h>
 
 #pragma comment(lib, "strmiids.lib")
 
+// Exported classes hold standard library members, which MSVC warns about
+// with C4251. Their layout is only shared safely when the library and its
+// clients are built with the same compiler and CRT, which is assumed here.
+#ifdef _MSC_VER
+    #pragma warning(push)
+    #pragma warning(disable: 4251)
+#endif
+
 namespace wpl {
     struct Version {
         unsigned int majorVersion;
         unsigned int minorVersion;
     };
 
+    struct PlaybackStats {
+        unsigned int loops;
+        unsigned int transitions;
+        unsigned int softReopens;
+        unsigned long long cacheHits;
+        unsigned long long cacheMisses;
+        unsigned long long compressedCacheHits;
+        unsigned long long bytesPrefetched;
+        unsigned long long readStalls;
+        REFERENCE_TIME readBlockedTime;
+        unsigned long long elidedUpdates;
+        unsigned long long elidedRepaints;
+        REFERENCE_TIME firstPaintTime;
+        REFERENCE_TIME frameLatency;
+        REFERENCE_TIME averageFrameLatency;
+        REFERENCE_TIME maxFrameLatency;
+        REFERENCE_TIME handoffPosition;
+        unsigned long long reverseDecodes;
+    };
+
+    struct ReadAheadStats {
+        unsigned long long bytesRead;
+        unsigned long long bytesPrefetched;
+        unsigned long long stalls;
+        REFERENCE_TIME blockedTime;
+        size_t bufferBytes;
+        unsigned long long latencySamples;
+        REFERENCE_TIME lastLatency;
+        REFERENCE_TIME totalLatency;
+        REFERENCE_TIME maxLatency;
+    };
+
+    struct MemoryUsage {
+        size_t cacheBytes;
+        size_t bufferBytes;
+    };
+
+    struct VideoFrame {
+        int stream;
+        REFERENCE_TIME pts;
+        REFERENCE_TIME duration;
+        LONG width;
+        LONG height;
+        LONG stride;
+        bool keyFrame;
+        std::vector<BYTE> pixels;
+    };
+
+    enum class ContainerType { Unknown, Avi, Asf };
+    enum class StreamType { Video, Audio, Other };
+
+    struct StreamInfo {
+        StreamType type;
+        std::string codec;
+        REFERENCE_TIME duration;
+        LONG width;
+        LONG height;
+        double frameRate;
+        DWORD sampleRate;
+        WORD channels;
+    };
+
+    struct MediaInfo {
+        std::string filename;
+        ContainerType container;
+        REFERENCE_TIME duration;
+        std::vector<StreamInfo> streams;
+    };
+
     enum class PlaybackState { NoVideo, Playing, Paused, Stopped };
+    enum class ClockMode { RealTime, Unthrottled, Manual };
+    enum class TaskPriority { Foreground, Background };
+    enum class PlayerError { None, NotFound, OutOfMemory, Unsupported };
+    enum class PixelFormat { Bgra, I420, Nv12 };
+    enum class ScaleFilter { Bilinear, Bicubic, Box };
+    enum class AspectMode { Stretch, Letterbox, Crop };
+    enum class Visibility { Visible, Occluded, Minimised };
+
+    struct Image {
+        PixelFormat format;
+        LONG width;
+        LONG height;
+        BYTE * planes[3];
+        LONG strides[3];
+    };
+
+    struct VideoLayout {
+        RECT picture;
+        RECT source;
+    };
 
     class VideoRenderer 
     {
@@ -32,12 +141,24 @@ namespace wpl {
         virtual bool updateVideoWindow(HWND hwnd, const LPRECT prc) = 0;
         virtual bool hasVideo() const = 0;
         virtual bool repaint() = 0;
+        virtual REFERENCE_TIME frameDuration() const = 0;
+        virtual bool captureFrame(VideoFrame * frame) = 0;
+        virtual bool presentFrame(const VideoFrame * frame) = 0;
+        virtual bool setAspectMode(AspectMode mode) = 0;
+        virtual bool setVisible(bool visible) = 0;
+        virtual int conversionCost(const AM_MEDIA_TYPE& type) const = 0;
+        virtual IBaseFilter * filter() const = 0;
+        virtual std::shared_ptr<VideoRenderer> clone() const { return nullptr; }
     };
 
-    class EVR : public VideoRenderer
-    {
+    class WPL_API EVR : public VideoRenderer {
         IMFVideoDisplayControl * videoDisplay;
         IBaseFilter * evr;
+        AspectMode aspectMode;
+        RECT position;
+        bool visible;
+
+        bool applyLayout();
     public:
         EVR();
         ~EVR();
@@ -47,6 +168,545 @@ namespace wpl {
         bool updateVideoWindow(HWND hwnd, const LPRECT prc) override;
         bool hasVideo() const override;
         bool repaint() override;
+        REFERENCE_TIME frameDuration() const override;
+        bool captureFrame(VideoFrame * frame) override;
+        bool presentFrame(const VideoFrame * frame) override;
+        bool setAspectMode(AspectMode mode) override;
+        bool setVisible(bool visible) override;
+        int conversionCost(const AM_MEDIA_TYPE& type) const override;
+        IBaseFilter * filter() const override;
+        std::shared_ptr<VideoRenderer> clone() const override;
+    };
+
+    struct FormatChain {
+        PixelFormat decoded;
+        PixelFormat delivered;
+        bool converted;
+    };
+
+    struct SinkStats {
+        unsigned long long delivered;
+        unsigned long long dropped;
+        unsigned long long converted;
+        FormatChain chain;
+        bool negotiated;
+    };
+
+    class WPL_API FrameView {
+        IMediaSample * sample;
+        Image picture;
+        REFERENCE_TIME presentationTime;
+        AspectMode layout;
+    public:
+        FrameView();
+        FrameView(IMediaSample * source, const Image& image, REFERENCE_TIME pts, AspectMode mode = AspectMode::Stretch);
+        FrameView(FrameView&& other);
+        FrameView(const FrameView&) = delete;
+        ~FrameView();
+
+        FrameView& operator=(FrameView&& other);
+        FrameView& operator=(const FrameView&) = delete;
+
+        void release();
+        bool empty() const;
+
+        PixelFormat format() const;
+        LONG width() const;
+        LONG height() const;
+        const BYTE * plane(int index) const;
+        LONG stride(int index) const;
+        REFERENCE_TIME pts() const;
+        AspectMode aspectMode() const;
+        const Image& image() const;
+    };
+
+    class FrameSink {
+    public:
+        virtual ~FrameSink() = default;
+        virtual void onFrame(FrameView frame) = 0;
+    };
+
+    class FrameSinkFilter;
+
+    class WPL_API SinkRenderer : public VideoRenderer {
+        std::shared_ptr<FrameSink> sink;
+        std::vector<PixelFormat> formats;
+        LONG alignment;
+        FrameSinkFilter * sinkFilter;
+        AspectMode layout;
+        bool visible;
+    public:
+        explicit SinkRenderer(std::shared_ptr<FrameSink> frameSink, std::vector<PixelFormat> preferredFormats = {}, LONG strideAlignment = 1);
+        SinkRenderer(const SinkRenderer&) = delete;
+        ~SinkRenderer();
+
+        SinkRenderer& operator=(const SinkRenderer&) = delete;
+
+        bool addToGraph(IGraphBuilder * graph, HWND hwnd) override;
+        bool finaliseGraph(IGraphBuilder * graph) override;
+        bool updateVideoWindow(HWND hwnd, const LPRECT prc) override;
+        bool hasVideo() const override;
+        bool repaint() override;
+        REFERENCE_TIME frameDuration() const override;
+        bool captureFrame(VideoFrame * frame) override;
+        bool presentFrame(const VideoFrame * frame) override;
+        bool setAspectMode(AspectMode mode) override;
+        bool setVisible(bool visible) override;
+        int conversionCost(const AM_MEDIA_TYPE& type) const override;
+        IBaseFilter * filter() const override;
+        std::shared_ptr<VideoRenderer> clone() const override;
+
+        SinkStats stats() const;
+    };
+
+    struct RenderTarget {
+        std::shared_ptr<VideoRenderer> registered;
+        std::shared_ptr<VideoRenderer> renderer;
+        HWND window;
+        RECT rect;
+        bool attached;
+    };
+
+    class WPL_API FrameCanvas {
+        AspectMode aspectMode;
+        RECT destination;
+        RECT filledBounds;
+        RECT filledPicture;
+        const BYTE * filledTarget;
+        unsigned long long fills;
+    public:
+        FrameCanvas();
+
+        void setAspectMode(AspectMode mode);
+        void setDestination(const RECT * rect);
+        void invalidate();
+        bool draw(const Image& frame, const Image& target, ScaleFilter filter = ScaleFilter::Bilinear);
+
+        unsigned long long barFills() const;
+    };
+
+    class WPL_API MemoryGovernor {
+        mutable std::mutex usageLock;
+        size_t limit;
+        MemoryUsage total;
+        unsigned long long refusals;
+        unsigned long long trims;
+    public:
+        MemoryGovernor();
+        MemoryGovernor(const MemoryGovernor&) = delete;
+
+        MemoryGovernor& operator=(const MemoryGovernor&) = delete;
+
+        void setLimit(size_t bytes);
+        size_t limitBytes() const;
+        MemoryUsage usage() const;
+        unsigned long long refusedOpens() const;
+
+        bool admitOpen();
+        size_t cacheAllowance(size_t heldBytes) const;
+        void adjustCache(size_t previousBytes, size_t currentBytes);
+        size_t reserveBuffer(size_t wantedBytes, size_t minimumBytes);
+        void releaseBuffer(size_t bytes);
+        unsigned long long trimRequests() const;
+
+        static MemoryGovernor& shared();
+    };
+
+    class WPL_API FrameCache {
+        using FrameList = std::list<VideoFrame>;
+        using FrameKey = std::pair<int, REFERENCE_TIME>;
+        using FrameIndex = std::map<FrameKey, FrameList::iterator>;
+
+        FrameList keyFrames;
+        FrameList frames;
+        FrameList compressedFrames;
+        FrameIndex index;
+        FrameIndex compressedIndex;
+        size_t budget;
+        size_t used;
+        size_t compressedBudget;
+        size_t compressedUsed;
+        size_t reported;
+        unsigned long long trimmedAt;
+        unsigned long long hitCount;
+        unsigned long long missCount;
+        unsigned long long compressedHitCount;
+
+        FrameList& listFor(const VideoFrame& frame);
+        FrameIndex::iterator covering(FrameIndex& frameIndex, int stream, REFERENCE_TIME position);
+        const VideoFrame * promote(FrameIndex::iterator entry);
+        void erase(FrameIndex::iterator entry);
+        void eraseCompressed(FrameIndex::iterator entry);
+        void compress(VideoFrame frame);
+        void evict(size_t required, size_t limit);
+        void evictCompressed(size_t required);
+        void shrink(size_t limit);
+        void report();
+        void swap(FrameCache& other);
+    public:
+        explicit FrameCache(size_t budgetBytes = 0, size_t compressedBudgetBytes = 0);
+        FrameCache(FrameCache&& other);
+        FrameCache(const FrameCache&) = delete;
+        ~FrameCache();
+
+        FrameCache& operator=(FrameCache&& other);
+        FrameCache& operator=(const FrameCache&) = delete;
+
+        const VideoFrame * find(int stream, REFERENCE_TIME position);
+        bool insert(VideoFrame frame);
+        void setBudget(size_t budgetBytes);
+        void setCompressedBudget(size_t budgetBytes);
+        void trim();
+        void clear();
+
+        size_t budgetBytes() const;
+        size_t usedBytes() const;
+        size_t compressedBudgetBytes() const;
+        size_t compressedBytes() const;
+        size_t size() const;
+        size_t compressedSize() const;
+        unsigned long long hits() const;
+        unsigned long long misses() const;
+        unsigned long long compressedHits() const;
+    };
+
+    class MappedFile
+    {
+        HANDLE file;
+        HANDLE mapping;
+        const BYTE * view;
+        size_t length;
+        unsigned long long fileLength;
+    public:
+        MappedFile();
+        MappedFile(MappedFile&& other);
+        MappedFile(const MappedFile&) = delete;
+        ~MappedFile();
+
+        MappedFile& operator=(MappedFile&& other);
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& filename, size_t window = 0);
+        void close();
+
+        const BYTE * data() const;
+        size_t size() const;
+        unsigned long long fileSize() const;
+    };
+
+    struct SeekPoint {
+        REFERENCE_TIME time;
+        unsigned long long offset;
+    };
+
+    class WPL_API SeekIndex {
+        MappedFile cacheFile;
+        std::vector<SeekPoint> builtPoints;
+        const SeekPoint * points;
+        size_t count;
+        bool cached;
+    public:
+        SeekIndex();
+        SeekIndex(SeekIndex&& other);
+        SeekIndex(const SeekIndex&) = delete;
+
+        SeekIndex& operator=(SeekIndex&& other);
+        SeekIndex& operator=(const SeekIndex&) = delete;
+
+        bool open(const std::string& filename, const std::atomic<bool> * cancelled = nullptr);
+        void clear();
+
+        const SeekPoint * keyFrameBefore(REFERENCE_TIME time) const;
+        bool isKeyFrame(REFERENCE_TIME time, REFERENCE_TIME tolerance) const;
+        bool fromCache() const;
+        size_t size() const;
+
+        static std::string cachePath(const std::string& filename);
+    };
+
+    class WPL_API ByteReader {
+    public:
+        virtual ~ByteReader() = default;
+
+        virtual size_t read(unsigned long long offset, size_t length, BYTE * buffer) = 0;
+        virtual unsigned long long size() const = 0;
+        virtual unsigned long long available() const = 0;
+        virtual void setFlushing(bool flushing) = 0;
+        virtual ReadAheadStats stats() const = 0;
+    };
+
+    class WPL_API ReadAheadReader : public ByteReader {
+        std::map<unsigned long long, std::vector<BYTE>> blocks;
+        mutable std::mutex blockLock;
+        std::condition_variable blockReady;
+        std::thread worker;
+        HANDLE prefetchFile;
+        HANDLE demandFile;
+        unsigned long long fileLength;
+        unsigned long long cursor;
+        unsigned long long pendingBlock;
+        size_t window;
+        bool stopping;
+        ReadAheadStats readStats;
+
+        void prefetch();
+        bool readBlock(HANDLE file, unsigned long long block, std::vector<BYTE>& data) const;
+    public:
+        ReadAheadReader();
+        ReadAheadReader(const ReadAheadReader&) = delete;
+        ~ReadAheadReader();
+
+        ReadAheadReader& operator=(const ReadAheadReader&) = delete;
+
+        bool open(const std::string& filename, size_t windowBytes);
+        void close();
+        size_t read(unsigned long long offset, size_t length, BYTE * buffer) override;
+        unsigned long long size() const override;
+        unsigned long long available() const override;
+        void setFlushing(bool flushing) override;
+        ReadAheadStats stats() const override;
+    };
+
+    class WPL_API StreamReader : public ByteReader {
+        using Arrival = std::pair<unsigned long long, std::chrono::steady_clock::time_point>;
+
+        std::vector<BYTE> ring;
+        std::deque<Arrival> arrivals;
+        mutable std::mutex ringLock;
+        std::condition_variable ringChanged;
+        std::thread worker;
+        HANDLE stream;
+        unsigned long long ringStart;
+        unsigned long long ringEnd;
+        unsigned long long cursor;
+        bool ended;
+        bool flushing;
+        bool stopping;
+        bool finished;
+        ReadAheadStats readStats;
+
+        void fill();
+        size_t discardable() const;
+    public:
+        StreamReader();
+        StreamReader(const StreamReader&) = delete;
+        ~StreamReader();
+
+        StreamReader& operator=(const StreamReader&) = delete;
+
+        bool open(HANDLE input, size_t bufferBytes, PlayerError * reason = nullptr);
+        void close();
+        size_t read(unsigned long long offset, size_t length, BYTE * buffer) override;
+        unsigned long long size() const override;
+        unsigned long long available() const override;
+        void setFlushing(bool flushing) override;
+        ReadAheadStats stats() const override;
+    };
+
+    struct PackEntry {
+        const BYTE * data;
+        unsigned long long size;
+    };
+
+    class WPL_API PackArchive {
+        MappedFile mappedFile;
+        const BYTE * index;
+        const char * nameTable;
+        size_t count;
+        unsigned long long namesSize;
+    public:
+        PackArchive();
+        PackArchive(const PackArchive&) = delete;
+
+        PackArchive& operator=(const PackArchive&) = delete;
+
+        bool open(const std::string& filename);
+        void close();
+        bool find(const std::string& name, PackEntry * entry) const;
+        std::vector<std::string> names() const;
+        size_t size() const;
+
+        static bool build(const std::string& filename, const std::vector<std::string>& files);
+    };
+
+    class MemoryReader : public ByteReader {
+        std::shared_ptr<const PackArchive> archive;
+        PackEntry entry;
+        mutable std::mutex statsLock;
+        ReadAheadStats readStats;
+    public:
+        MemoryReader(std::shared_ptr<const PackArchive> source, const PackEntry& span);
+
+        size_t read(unsigned long long offset, size_t length, BYTE * buffer) override;
+        unsigned long long size() const override;
+        unsigned long long available() const override;
+        void setFlushing(bool flushing) override;
+        ReadAheadStats stats() const override;
+    };
+
+    class PinEnumerator : public IEnumPins
+    {
+        IPin * pin;
+        ULONG position;
+        LONG referenceCount;
+    public:
+        PinEnumerator(IPin * onlyPin, ULONG start);
+        ~PinEnumerator();
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+        ULONG STDMETHODCALLTYPE AddRef() override;
+        ULONG STDMETHODCALLTYPE Release() override;
+
+        HRESULT STDMETHODCALLTYPE Next(ULONG count, IPin ** pins, ULONG * fetched) override;
+        HRESULT STDMETHODCALLTYPE Skip(ULONG count) override;
+        HRESULT STDMETHODCALLTYPE Reset() override;
+        HRESULT STDMETHODCALLTYPE Clone(IEnumPins ** pins) override;
+    };
+
+    class MediaTypeEnumerator : public IEnumMediaTypes
+    {
+        std::vector<AM_MEDIA_TYPE> mediaTypes;
+        ULONG position;
+        LONG referenceCount;
+    public:
+        MediaTypeEnumerator(const AM_MEDIA_TYPE& onlyType, ULONG start);
+        MediaTypeEnumerator(std::vector<AM_MEDIA_TYPE> types, ULONG start);
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+        ULONG STDMETHODCALLTYPE AddRef() override;
+        ULONG STDMETHODCALLTYPE Release() override;
+
+        HRESULT STDMETHODCALLTYPE Next(ULONG count, AM_MEDIA_TYPE ** types, ULONG * fetched) override;
+        HRESULT STDMETHODCALLTYPE Skip(ULONG count) override;
+        HRESULT STDMETHODCALLTYPE Reset() override;
+        HRESULT STDMETHODCALLTYPE Clone(IEnumMediaTypes ** types) override;
+    };
+
+    class ReadAheadPin;
+
+    class ReadAheadSource : public IBaseFilter
+    {
+        std::unique_ptr<ByteReader> reader;
+        ReadAheadPin * outputPin;
+        IReferenceClock * syncSource;
+        IFilterGraph * filterGraph;
+        std::wstring filterName;
+        FILTER_STATE filterState;
+        LONG referenceCount;
+    public:
+        ReadAheadSource();
+        ~ReadAheadSource();
+
+        bool open(const std::string& filename, const GUID& subtype, size_t windowBytes);
+        bool open(std::unique_ptr<ByteReader> source);
+        ReadAheadStats stats() const;
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+        ULONG STDMETHODCALLTYPE AddRef() override;
+        ULONG STDMETHODCALLTYPE Release() override;
+
+        HRESULT STDMETHODCALLTYPE GetClassID(CLSID * classId) override;
+        HRESULT STDMETHODCALLTYPE Stop() override;
+        HRESULT STDMETHODCALLTYPE Pause() override;
+        HRESULT STDMETHODCALLTYPE Run(REFERENCE_TIME start) override;
+        HRESULT STDMETHODCALLTYPE GetState(DWORD timeout, FILTER_STATE * state) override;
+        HRESULT STDMETHODCALLTYPE SetSyncSource(IReferenceClock * clock) override;
+        HRESULT STDMETHODCALLTYPE GetSyncSource(IReferenceClock ** clock) override;
+        HRESULT STDMETHODCALLTYPE EnumPins(IEnumPins ** pins) override;
+        HRESULT STDMETHODCALLTYPE FindPin(LPCWSTR id, IPin ** pin) override;
+        HRESULT STDMETHODCALLTYPE QueryFilterInfo(FILTER_INFO * info) override;
+        HRESULT STDMETHODCALLTYPE JoinFilterGraph(IFilterGraph * graph, LPCWSTR name) override;
+        HRESULT STDMETHODCALLTYPE QueryVendorInfo(LPWSTR * vendorInfo) override;
+    };
+
+    class ManualClock : public IReferenceClock
+    {
+        struct AdviseRequest {
+            DWORD_PTR cookie;
+            REFERENCE_TIME dueTime;
+            REFERENCE_TIME period;
+            HANDLE handle;
+        };
+
+        std::vector<AdviseRequest> requests;
+        std::mutex requestLock;
+        REFERENCE_TIME currentTime;
+        DWORD_PTR nextCookie;
+        LONG referenceCount;
+
+        void signalDueRequests();
+    public:
+        ManualClock();
+
+        void advance(REFERENCE_TIME elapsed);
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void ** object) override;
+        ULONG STDMETHODCALLTYPE AddRef() override;
+        ULONG STDMETHODCALLTYPE Release() override;
+
+        HRESULT STDMETHODCALLTYPE GetTime(REFERENCE_TIME * time) override;
+        HRESULT STDMETHODCALLTYPE AdviseTime(REFERENCE_TIME baseTime, REFERENCE_TIME streamTime, HEVENT event, DWORD_PTR * cookie) override;
+        HRESULT STDMETHODCALLTYPE AdvisePeriodic(REFERENCE_TIME startTime, REFERENCE_TIME periodTime, HSEMAPHORE semaphore, DWORD_PTR * cookie) override;
+        HRESULT STDMETHODCALLTYPE Unadvise(DWORD_PTR cookie) override;
+    };
+
+    struct SchedulerStats {
+        unsigned long long completed;
+        unsigned long long stolen;
+        unsigned long long late;
+    };
+
+    class WPL_API TaskScheduler {
+        struct Task {
+            std::function<void()> work;
+            std::chrono::steady_clock::time_point deadline;
+            TaskPriority priority;
+            unsigned long long sequence;
+        };
+
+        struct TaskQueue {
+            std::mutex lock;
+            std::vector<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<TaskQueue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex wakeLock;
+        std::condition_variable wake;
+        std::atomic<unsigned long long> sequence;
+        std::atomic<size_t> pending;
+        std::atomic<size_t> nextQueue;
+        std::atomic<bool> stopping;
+        mutable std::mutex statsLock;
+        SchedulerStats schedulerStats;
+
+        static bool runsBefore(const Task& first, const Task& second);
+
+        void enqueue(std::function<void()> work, std::chrono::steady_clock::time_point deadline, TaskPriority priority);
+        bool take(size_t worker, Task * task);
+        void run(size_t worker);
+    public:
+        explicit TaskScheduler(size_t threads = 0);
+        TaskScheduler(const TaskScheduler&) = delete;
+        ~TaskScheduler();
+
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+        template <typename Work>
+        std::future<typename std::result_of<Work()>::type> submit(Work work, std::chrono::steady_clock::time_point deadline, TaskPriority priority = TaskPriority::Foreground)
+        {
+            const auto task { std::make_shared<std::packaged_task<typename std::result_of<Work()>::type()>>(std::move(work)) };
+            auto result { task->get_future() };
+            enqueue([task]() { (*task)(); }, deadline, priority);
+            return result;
+        }
+
+        void parallelFor(size_t count, const std::function<void(size_t)>& work);
+
+        size_t threads() const;
+        SchedulerStats stats() const;
+
+        static TaskScheduler& shared();
     };
 
     class WPL_API VideoPlayer {
@@ -54,24 +714,118 @@ namespace wpl {
         IMediaControl * mediaControl;
         IMediaEventEx * mediaEvents;
         IMediaSeeking * mediaSeeking;
+        IBaseFilter * sourceFilter;
+        ReadAheadSource * readAheadSource;
         VideoRenderer * videoRenderer;
+        std::vector<RenderTarget> renderTargets;
+        ManualClock * manualClock;
+        VideoPlayer * nextVideo;
+        std::future<bool> nextVideoReady;
+        std::string nextVideoFile;
+        IReferenceClock * handoffClock;
+        DWORD_PTR handoffAdvise;
+        HANDLE handoffEvent;
+        HANDLE handoffWait;
+        HWND dispatchWindow;
+        REFERENCE_TIME revealPosition;
+        std::deque<std::string> playlist;
+        FrameCache frameCache;
+        SeekIndex seekIndex;
+        std::future<SeekIndex> pendingSeekIndex;
+        std::shared_ptr<std::atomic<bool>> seekIndexCancelled;
+        std::string seekIndexFile;
+        PlaybackStats playbackStats;
         PlaybackState state;
+        ClockMode clock;
+        REFERENCE_TIME framePosition;
+        REFERENCE_TIME graphPosition;
+        std::chrono::steady_clock::time_point nextReverseStep;
+        std::deque<VideoFrame> reverseFrames;
+        size_t reverseBufferBytes;
+        std::chrono::steady_clock::time_point openedAt;
+        REFERENCE_TIME posterTime;
+        double playbackRate;
+        long pendingEvent;
         HWND windowHandle;
+        RECT destination;
+        RECT windowRect;
+        AspectMode aspectMode;
+        Visibility visibilityMode;
+        TaskPriority priority;
+        size_t readAheadBytes;
+        REFERENCE_TIME readAheadTime;
+        PlayerError error;
+        bool looping;
+        bool handoffScheduled;
+        bool streaming;
+        bool windowDirty;
+        bool repaintDue;
+        bool firstFrameShown;
+        bool lowLatency;
+        bool renderersReady;
+        bool reverseFinished;
     public:
         explicit VideoPlayer(HWND hwnd = nullptr);
+        VideoPlayer(VideoPlayer&& other);
+        VideoPlayer(const VideoPlayer&) = delete;
         ~VideoPlayer();
 
+        VideoPlayer& operator=(VideoPlayer&& other);
+        VideoPlayer& operator=(const VideoPlayer&) = delete;
+
         PlaybackState playbackState() const;
+        ClockMode clockMode() const;
+        PlaybackStats stats() const;
+        MemoryUsage memoryUsage() const;
+        PlayerError lastError() const;
+        Visibility visibility() const;
 
+        bool warmUp();
         bool openVideo(const std::string& filename);
-        bool updateVideoWindow() const;
-        bool repaint() const;
+        bool openStream(HANDLE stream, size_t bufferBytes = 8 * 1024 * 1024);
+        bool isSeekable() const;
+        bool setVideoWindow(HWND hwnd);
+        bool addRenderTarget(std::shared_ptr<VideoRenderer> renderer, HWND hwnd = nullptr);
+        bool removeRenderTarget(const std::shared_ptr<VideoRenderer>& renderer);
+        size_t renderTargetCount() const;
+        bool setAspectMode(AspectMode mode);
+        bool setDestination(const RECT * rect);
+        void closeVideo();
+        void reset();
+        bool updateVideoWindow();
+        bool repaint();
+        void invalidateVideoWindow();
         bool pause();
         bool play();
         bool stop();
+        bool seek(REFERENCE_TIME position);
+        bool stepForward();
+        bool stepBackward();
+        bool setRate(double rate);
+
+        REFERENCE_TIME position() const;
+        REFERENCE_TIME duration() const;
+        double rate() const;
+
+        bool setFrameCacheBudget(size_t bytes, size_t compressedBytes = 0);
+        bool setReadAhead(size_t windowBytes, REFERENCE_TIME windowTime = 0);
+        bool setPriority(TaskPriority taskPriority);
+        bool setVisibility(Visibility mode);
+        bool setClockMode(ClockMode mode);
+        bool advanceClock(REFERENCE_TIME elapsed);
+        bool setLooping(bool loop);
+        bool setPosterFrame(bool enabled, REFERENCE_TIME time = 0);
+        bool setLowLatency(bool enabled);
 
-        bool hasFinished() const;
+        bool queueVideo(const std::string& filename);
+        void clearQueue();
+        size_t queuedVideos() const;
+
+        bool hasFinished();
         bool hasVideo() const;
+        bool hasFirstFrame() const;
+        bool isLooping() const;
+        bool isLowLatency() const;
     private:    
         struct RenderStreamsParams {
             IFilterGraph2 * filterGraph2;
@@ -83,7 +837,51 @@ namespace wpl {
         };
 
         bool setupGraph();
+        bool softReopen(const std::string& filename);
+        HRESULT addSourceFilter(const std::string& filename, IBaseFilter ** source, ReadAheadSource ** readAhead) const;
         bool createVideoRenderer() const;
+        bool applyClockMode();
+        bool presentPoster();
+        void beginOpen();
+        void markFirstFrame();
+        TaskPriority taskPriority() const;
+        bool attachRenderTargets();
+        bool reconnectGraph(const std::function<bool()>& change);
+        bool armLoopSegment();
+        bool restartLoop(DWORD flags);
+        bool handleEvent(long evCode);
+        bool waitForEvent(long evCode);
+
+        bool stepFrame(int direction);
+        bool stepGraphForward(REFERENCE_TIME target);
+        bool decodeGroupOfPictures(REFERENCE_TIME target, std::deque<VideoFrame> * frames = nullptr);
+        bool captureDisplayedFrame(bool keyFrame, std::deque<VideoFrame> * frames = nullptr);
+        void startReverse();
+        void stopReverse();
+        bool advanceReverse();
+        bool stepReverse();
+        bool fillReverseBuffer();
+        void syncGraphPosition();
+        REFERENCE_TIME currentFrameDuration() const;
+
+        void loadSeekIndex();
+        void cancelSeekIndex();
+        bool collectSeekIndex();
+
+        void prerollNextVideo();
+        bool preroll();
+        bool shareClock(VideoPlayer& next) const;
+        bool scheduleHandoff();
+        void cancelHandoff();
+        bool armHandoffReveal(IReferenceClock * referenceClock, REFERENCE_TIME baseTime, REFERENCE_TIME delay);
+        void disarmHandoffReveal();
+        static void CALLBACK revealHandoff(PVOID context, BOOLEAN timedOut);
+        bool createDispatchWindow();
+        static LRESULT CALLBACK dispatchMessage(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
+        bool startNextVideo();
+        bool openNextVideo();
+        void swapGraph(VideoPlayer& other);
+        void swapPlayer(VideoPlayer& other);
 
         HRESULT queryInterface(HRESULT prevResult, const IID& riid, void ** pvObject) const;
 
@@ -93,7 +891,37 @@ namespace wpl {
         void releaseGraph();
     };
 
+    class WPL_API PlayerPool {
+        std::vector<VideoPlayer> players;
+    public:
+        explicit PlayerPool(size_t count, HWND hwnd = nullptr);
+        PlayerPool(const PlayerPool&) = delete;
+        PlayerPool(PlayerPool&&) = default;
+
+        PlayerPool& operator=(const PlayerPool&) = delete;
+        PlayerPool& operator=(PlayerPool&&) = default;
+
+        VideoPlayer acquire(HWND hwnd);
+        void release(VideoPlayer&& player);
+        size_t available() const;
+    };
+
+    WPL_API bool mountPack(const std::string& filename);
+    WPL_API void unmountPacks();
+    WPL_API std::shared_ptr<const PackArchive> findPackEntry(const std::string& filename, PackEntry * entry);
+
+    WPL_API VideoLayout layoutVideo(AspectMode mode, const RECT& bounds, LONG width, LONG height);
+    WPL_API bool scaleImage(const Image& source, const Image& destination, ScaleFilter filter = ScaleFilter::Bilinear);
+    WPL_API bool convertImage(const Image& source, const Image& destination);
+    WPL_API bool scaleFrame(const VideoFrame& source, VideoFrame * destination, LONG width, LONG height, ScaleFilter filter = ScaleFilter::Bilinear);
+
+    WPL_API bool probe(const std::string& filename, MediaInfo * info);
+    WPL_API std::vector<MediaInfo> probeDirectory(const std::string& directory, size_t maxConcurrent = 4);
     WPL_API Version getVersion();
 }
 
+#ifdef _MSC_VER
+    #pragma warning(pop)
+#endif
+
 #endif
\ No newline at end of file